@@ -1,5 +1,12 @@
 #!/bin/sh
 # SUPER-DUPER PRIMITIVE MAKEFILE HOORAY!
+# FIXED_POINT=1 builds the physics in fixed point (see include/Fixed.h)
+
+DEFINES="-DPLATFORMER_CLIENT"
+if [ "$FIXED_POINT" = "1" ]
+then
+DEFINES="$DEFINES -DPLATFORMER_FIXED_POINT -msse2 -mfpmath=sse"
+fi
 
 mkdir obj
 mkdir bin
@@ -7,11 +14,11 @@ mkdir bin
 cd obj
 
 echo "COMPILING"
-g++ -Wall -c ../main_client.cpp ../src/*.cpp ../src/cpGUI/*.cpp -I../include/ -I../include/cpGUI/ -DPLATFORMER_CLIENT
+g++ -Wall -c ../main_client.cpp ../src/*.cpp ../src/cpGUI/*.cpp -I../include/ -I../include/cpGUI/ $DEFINES
 #g++ -Wall -c ../main_client.cpp ../src/*.cpp -I../include/
 
 echo "LINKING"
-g++ *.o -o ../bin/Platformer_Client -lsfml-graphics -lsfml-window -lsfml-system -lsfml-network
+g++ *.o -o ../bin/Platformer_Client -lsfml-graphics -lsfml-window -lsfml-system -lsfml-network -lpthread
 
 echo "CLEANING"
 cd ..
@@ -42,6 +42,9 @@ namespace pf {
             int GetFramerate();
             void SetFramerate(int framerate);
 
+            // Call after the image has been reloaded with a different size
+            void UpdateFrameSize();
+
         private:
             int framerate;
             int frames;
@@ -0,0 +1,93 @@
+/*
+ * Bodies.h
+ * Struct-of-arrays storage for entity position, size, velocity and flags
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BODIES_H
+#define BODIES_H
+
+#include "Entity.h"
+#include "Fixed.h"
+#include <stdint.h>
+#include <vector>
+
+namespace pf {
+    // Every entity in a world keeps its physical state here, one array per
+    // component, and refers to it by the index (body) it was created with.
+    // Bodies stay at the same index until destroyed, but references into the
+    // arrays are only good until the next Create.
+    class Bodies {
+        public:
+            enum {
+                ACTIVE = 0x01,      // In the world and ticked
+                SOLID = 0x02,
+                GRAVITY = 0x04,
+                PUSHABLE = 0x08,
+                STAIRS = 0x10,
+                ON_GROUND = 0x20,
+                IN_LIQUID = 0x40,
+                SLEEPING = 0x80,    // At rest, and skipped until woken
+                CAN_SLEEP = 0x100,
+                KINEMATIC = 0x200   // Placed by World::Tick, never moved by collisions
+            };
+
+            // Bodies slower than this (in pixels per second) count as resting
+            const static float SLEEP_SPEED = 2.f;
+
+            // Seconds a body has to rest on the ground before it sleeps
+            const static float SLEEP_DELAY = 1.f;
+
+            Bodies();
+            ~Bodies();
+
+            int Create(pf::Entity *owner);
+            void Destroy(int body);
+
+            // Number of bodies, including destroyed ones waiting to be reused
+            int GetCount();
+
+            bool HasFlag(int body, uint16_t flag);
+            void SetFlag(int body, uint16_t flag, bool set);
+
+            // Asleep or frozen, so it can't have moved this tick
+            bool IsResting(int body);
+
+            // The per-tick passes over every active body, each advancing it
+            // by its own step
+            void ApplyForces(pf::Scalar gravity);
+            void IntegrateNonSolid();
+            void ClipVelocities();
+            void UpdateSleep();
+
+            std::vector<pf::Scalar> x, y;
+            std::vector<pf::Scalar> veloX, veloY;
+            std::vector<int> width, height;
+            std::vector<uint16_t> flags;
+            std::vector<pf::CollisionMask> category, mask;
+            std::vector<pf::Scalar> restTime;   // Seconds spent resting so far
+            std::vector<pf::Scalar> step;       // Seconds to advance this tick
+            std::vector<pf::Scalar> submerged;  // Fraction of its height in liquid
+            std::vector<int> support;       // Body it last landed on, or -1
+            std::vector<pf::Entity*> owner;
+
+        private:
+            std::vector<int> freeBodies;
+    };
+}; // namespace pf
+
+#endif // BODIES_H
@@ -81,11 +81,10 @@ namespace pf {
 
             pf::CharacterSkin *GetSkin();
             pf::Animation *GetImage();
+            void ReloadSkin();
 
             void SetIsolateAnimation(bool isolateAnimation);
 
-            bool CanCollideWith(pf::Entity *entity);
-
         private:
             static sf::Font *nameFont;
 
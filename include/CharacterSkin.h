@@ -34,6 +34,9 @@ namespace pf {
         CharacterSkin(char *name, pf::Resource *skin, int framerate, int frames);
         ~CharacterSkin();
         
+        // Re-reads the frame size after the skin's resource has changed
+        void Reload();
+        
         char *GetName();
         pf::Resource *GetResource();
         int GetWidth();
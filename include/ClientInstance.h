@@ -33,6 +33,7 @@ namespace pf {
     class Resource;
     class Character;
     class Server;
+    class Latency;
 
     class ClientInstance {
     public:
@@ -61,6 +62,8 @@ namespace pf {
         void SetCharacter(pf::Character *character);
         pf::Character *GetCharacter();
 
+        pf::Latency *GetLatency();
+
     private:
         sf::SocketTCP *socket;
         sf::IPAddress clientIP;
@@ -74,6 +77,7 @@ namespace pf {
         bool wasKicked;
 
         pf::Character *character;
+        pf::Latency *latency;
     };
 }; // namespace pf
 
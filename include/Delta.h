@@ -0,0 +1,58 @@
+/*
+ * Delta.h
+ * Block-level binary deltas between two versions of a resource
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace pf {
+    // A patch is a sequence of operations that rebuild the new version of a
+    // file from the old one: either copy a run of bytes from the old version,
+    // or insert literal bytes that weren't found in it.
+    namespace Delta {
+        // Size of the blocks of the old version that are searched for
+        const static int BLOCK_SIZE = 32;
+
+        enum Operation {
+            OP_COPY = 0,   // uint32 offset into old version, uint32 length
+            OP_INSERT = 1  // uint32 length, followed by that many bytes
+        };
+
+        // Adler-32 of the data, used to make sure a patch is applied to the
+        // version it was made against
+        uint32_t Checksum(const char *data, uint32_t length);
+
+        // Appends the operations that turn base into target to patch
+        void Compute(const char *base, uint32_t baseLength,
+                     const char *target, uint32_t targetLength,
+                     std::vector<char>& patch);
+
+        // Returns a new[]'d buffer of targetLength bytes, or NULL if the patch
+        // is malformed, doesn't produce exactly targetLength bytes, or
+        // targetLength is over Resource::MAX_LENGTH
+        char *Apply(const char *base, uint32_t baseLength,
+                    const char *patch, uint32_t patchLength,
+                    uint32_t targetLength);
+    }; // namespace Delta
+}; // namespace pf
+
+#endif // DELTA_H
@@ -1,6 +1,6 @@
 /*
  * Elevator.h
- * A PhysicsEntity that moves up and down until it hits something
+ * A kinematic platform that follows a path of waypoints
  * Copyright (c) 2010-2011 Drew Gottlieb
  * 
  * This program is free software: you can redistribute it and/or modify
@@ -23,20 +23,70 @@
 
 #include <SFML/Graphics.hpp>
 #include "PhysicsEntity.h"
+#include <vector>
 
 namespace pf {
     class Animation;
+    class Resource;
     
+    // Elevators never collide as they move. Where one is depends only on
+    // its path and the world's time, so World::Tick puts it there, carrying
+    // whatever's standing on it. Clients keep their world's time on the
+    // server's clock, so a copy that knows the same path is always in the
+    // same place.
     class Elevator : public pf::PhysicsEntity {
     public:
+        enum {
+            PATH_PING_PONG,     // There and back again
+            PATH_LOOP           // Round past the last waypoint to the first
+        };
+
+        // Pixels per second
+        const static float DEFAULT_SPEED = 50.f;
+
         Elevator(pf::World *world, pf::Animation *image, float x, float y);
+        Elevator(pf::World *world, pf::Resource *image, float x, float y);
         ~Elevator();
         
         void Tick(float frametime);
-    
+
+        // Waypoints are where the elevator's top left corner passes, in
+        // order. The first is where it starts.
+        void AddWaypoint(float x, float y);
+        void ClearWaypoints();
+        int GetWaypointCount();
+        float GetWaypointX(int waypoint);
+        float GetWaypointY(int waypoint);
+
+        void SetSpeed(float speed);
+        float GetSpeed();
+        void SetPathMode(int mode);
+        int GetPathMode();
+
+        // The world time at which the elevator was at its first waypoint
+        void SetPathStart(double time);
+        double GetPathStart();
+
+        // Where the path puts the elevator at a given world time
+        void GetPathPosition(double time, float& x, float& y);
+
+        pf::Resource *GetImageResource();
+
     private:
-        int direction;
+        static pf::Animation *LoadAnimation(pf::Resource *image);
+        void Init();
+        void BuildPath();
+
+        std::vector<float> waypointX, waypointY;
+
+        // Waypoints again (with the first repeated at the end of a loop),
+        // and how far along the path each one is
+        std::vector<float> pathX, pathY, pathDistance;
+
         float speed;
+        double start;
+        int mode;
+        pf::Resource *imageResource;
     };
 }; // namespace pf
 
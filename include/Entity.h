@@ -21,11 +21,40 @@
 #ifndef ENTITY_H
 #define ENTITY_H
 
+#include <stdint.h>
+
 namespace pf {
     class World;
+    class Bodies;
+
+    // Identifies an entity within its world; see EntitySlots. Zero is never
+    // a valid handle.
+    typedef uint32_t EntityHandle;
+
+    // Collision categories. Every entity and tile is in some of these, and
+    // a moving entity only collides with things in a category its mask has.
+    typedef uint16_t CollisionMask;
+    enum {
+        CATEGORY_LEVEL = 0x0001,        // Solid tiles
+        CATEGORY_LIQUID = 0x0002,       // Liquid tiles
+        CATEGORY_OBJECT = 0x0004,
+        CATEGORY_CHARACTER = 0x0008,
+        CATEGORY_PLATFORM = 0x0010,
+        CATEGORY_ALL = 0xFFFF
+    };
 
     class Entity {
         public:
+            // Type tags, so an entity's class can be told without RTTI. Each
+            // class adds its own tag to its parent's.
+            enum {
+                TYPE_PHYSICS = 0x01,
+                TYPE_CHARACTER = 0x02,
+                TYPE_PLATFORM = 0x04
+            };
+
+            // Creates the entity's body, so never while the world is
+            // ticking (see World::AddEntity)
             Entity(pf::World *world);
             Entity(pf::World *world, float x, float y, int width, int height);
             ~Entity();
@@ -45,18 +74,36 @@ namespace pf {
             int GetWidth();
             int GetHeight();
 
-            int GetID();
-            void SetID(int id);
+            // The entity's handle, or 0 if it isn't in its world. Setting it
+            // before the entity is added picks the handle it's added under.
+            pf::EntityHandle GetID();
+            void SetID(pf::EntityHandle id);
 
-        protected:
-            static unsigned int NEXT_ENT_ID;
+            // The entity's handle in its world's broadphase, or -1
+            int GetBroadphaseProxy();
+            void SetBroadphaseProxy(int proxy);
+
+            // Index of this entity's components in its world's Bodies
+            int GetBody();
+
+            int GetType();
+            bool IsType(int type);
 
+            pf::CollisionMask GetCollisionCategory();
+            void SetCollisionCategory(pf::CollisionMask category);
+            pf::CollisionMask GetCollisionMask();
+            void SetCollisionMask(pf::CollisionMask mask);
+            bool CanCollideWith(pf::Entity *entity);
+
+        protected:
             void Init(pf::World *world, float x, float y, int width, int height);
 
-            unsigned int id;
+            pf::EntityHandle id;
+            int type;
+            int broadphaseProxy;
             pf::World *world;
-            float x, y;
-            int width, height;
+            pf::Bodies *bodies;
+            int body;
     };
 }; // namespace pf
 
@@ -0,0 +1,85 @@
+/*
+ * EntitySlots.h
+ * Slot map from generation-checked entity handles to entities
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ENTITYSLOTS_H
+#define ENTITYSLOTS_H
+
+#include "Entity.h"
+#include <stdint.h>
+#include <vector>
+
+namespace pf {
+    // Maps entity handles to entities in constant time. The low SLOT_BITS of
+    // a handle pick a slot and the rest hold the slot's generation, which
+    // changes every time the slot is emptied, so a handle to a removed entity
+    // never finds whatever takes its place. Generations start at 1, so no
+    // valid handle is 0.
+    //
+    // Live entities are also kept packed in one array for iteration. Removing
+    // an entity moves the last one into its place, so iteration order isn't
+    // stable across removals.
+    class EntitySlots {
+        public:
+            const static int SLOT_BITS = 20;
+            const static int MAX_SLOTS = 1 << SLOT_BITS;
+            const static int MAX_GENERATION = (1 << (32 - SLOT_BITS)) - 1;
+
+            EntitySlots();
+            ~EntitySlots();
+
+            // Returns the new handle, or 0 if every slot is taken
+            pf::EntityHandle Insert(pf::Entity *entity);
+
+            // Stores the entity under a handle chosen elsewhere (by the server,
+            // for the client's copy of its entities). Whatever was in the slot
+            // is taken out and returned in displaced.
+            bool InsertAt(pf::EntityHandle handle, pf::Entity *entity, pf::Entity *&displaced);
+
+            bool Remove(pf::EntityHandle handle);
+
+            // NULL if the handle is stale or was never valid
+            pf::Entity *Get(pf::EntityHandle handle);
+
+            // Live entities, packed
+            int GetCount();
+            pf::Entity *GetAt(int index);
+
+            static int SlotOf(pf::EntityHandle handle);
+            static int GenerationOf(pf::EntityHandle handle);
+            static pf::EntityHandle MakeHandle(int slot, int generation);
+
+        private:
+            struct Slot {
+                pf::Entity *entity;
+                int generation;
+                int dense;
+            };
+
+            void AddDense(int slot);
+            void RemoveDense(int slot);
+
+            std::vector<Slot> slots;
+            std::vector<int> freeSlots;
+            std::vector<pf::Entity*> dense;
+            std::vector<int> denseSlots;
+    };
+}; // namespace pf
+
+#endif // ENTITYSLOTS_H
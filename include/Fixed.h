@@ -0,0 +1,105 @@
+/*
+ * Fixed.h
+ * Fixed-point numbers, and the scalar type the physics is kept in
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <stdint.h>
+#include <cmath>
+
+namespace pf {
+    // A 16.16 fixed-point number. Arithmetic is done on integers and always
+    // rounds the same way, so the same operations give the same bits on
+    // every machine and with every compiler. Converting from a float rounds
+    // to the nearest step; converting back is only for drawing and queries.
+    class Fixed {
+        public:
+            const static int FRACTION_BITS = 16;
+            const static int32_t ONE = 1 << FRACTION_BITS;
+
+            Fixed() : raw(0) {}
+            Fixed(int value) : raw(value * ONE) {}
+            Fixed(float value) : raw(Round(value)) {}
+            Fixed(double value) : raw(Round(value)) {}
+
+            static Fixed FromRaw(int32_t raw) {
+                Fixed result;
+                result.raw = raw;
+                return result;
+            }
+
+            int32_t GetRaw() const { return raw; }
+            float ToFloat() const { return (float)raw / ONE; }
+
+            Fixed operator-() const { return FromRaw(-raw); }
+            Fixed& operator+=(Fixed other) { raw += other.raw; return *this; }
+            Fixed& operator-=(Fixed other) { raw -= other.raw; return *this; }
+
+            // Products and quotients go through 64 bits, rounding to nearest
+            Fixed& operator*=(Fixed other) {
+                raw = (int32_t)(((int64_t)raw * other.raw + ONE / 2) >> FRACTION_BITS);
+                return *this;
+            }
+            Fixed& operator/=(Fixed other) {
+                raw = (int32_t)(((int64_t)raw << FRACTION_BITS) / other.raw);
+                return *this;
+            }
+
+        private:
+            static int32_t Round(double value) {
+                return (int32_t)std::floor(value * ONE + 0.5);
+            }
+
+            int32_t raw;
+    };
+
+    inline Fixed operator+(Fixed a, Fixed b) { return a += b; }
+    inline Fixed operator-(Fixed a, Fixed b) { return a -= b; }
+    inline Fixed operator*(Fixed a, Fixed b) { return a *= b; }
+    inline Fixed operator/(Fixed a, Fixed b) { return a /= b; }
+    inline bool operator==(Fixed a, Fixed b) { return a.GetRaw() == b.GetRaw(); }
+    inline bool operator!=(Fixed a, Fixed b) { return a.GetRaw() != b.GetRaw(); }
+    inline bool operator<(Fixed a, Fixed b) { return a.GetRaw() < b.GetRaw(); }
+    inline bool operator>(Fixed a, Fixed b) { return a.GetRaw() > b.GetRaw(); }
+    inline bool operator<=(Fixed a, Fixed b) { return a.GetRaw() <= b.GetRaw(); }
+    inline bool operator>=(Fixed a, Fixed b) { return a.GetRaw() >= b.GetRaw(); }
+
+    // Bodies keep their positions, velocities and steps in Scalar. Building
+    // with PLATFORMER_FIXED_POINT makes it Fixed and has the world tick in
+    // fixed steps, so bodies no longer drift with frame timing or float
+    // rounding as they integrate. Queries, sweep times and elevator paths
+    // are still worked out in floats, so a simulation only replays exactly
+    // on builds that do float math the same way (SSE2, not x87, which the
+    // fixed-point build targets ask for), and elevators follow the clock
+    // the world is set to.
+#ifdef PLATFORMER_FIXED_POINT
+    typedef pf::Fixed Scalar;
+#else
+    typedef float Scalar;
+#endif
+
+    // The same calls work whichever Scalar is
+    inline float ToFloat(float value) { return value; }
+    inline float ToFloat(pf::Fixed value) { return value.ToFloat(); }
+    inline float Abs(float value) { return std::fabs(value); }
+    inline pf::Fixed Abs(pf::Fixed value) { return value < pf::Fixed() ? -value : value; }
+}; // namespace pf
+
+#endif // FIXED_H
@@ -26,6 +26,7 @@
 
 #include <map>
 #include <list>
+#include <stdint.h>
 
 namespace cp {
     class cpGuiContainer;
@@ -40,6 +41,7 @@ namespace pf {
     class PhysicsEntity;
     class Particle;
     class World;
+    class Latency;
 
     enum Screen {
         Screen_Game,
@@ -90,6 +92,8 @@ namespace pf {
             void SetScreen(Screen screen);
             Screen GetScreen();
 
+            pf::Latency *GetLatency();
+
         private:
             pf::World *world;
             sf::View *view;
@@ -110,6 +114,8 @@ namespace pf {
             unsigned short serverPort;
             sf::SocketTCP *socket;
             sf::SelectorTCP *socketSelector;
+            pf::Latency *latency;
+            uint32_t tick;
 
             int resourcesToLoad, resourcesLoaded;
             PropertyMap properties;
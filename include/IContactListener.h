@@ -0,0 +1,39 @@
+/*
+ * IContactListener.h
+ * Interface for anything that reacts to entities touching
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ICONTACTLISTENER_H
+#define ICONTACTLISTENER_H
+
+#include "Entity.h"
+
+namespace pf {
+    // Told about pairs of entities as they start touching, on every tick
+    // they stay touching, and once they stop. The lower handle comes first.
+    class IContactListener {
+        public:
+            virtual void ContactBegin(pf::Entity *a, pf::Entity *b) {}
+            virtual void ContactStay(pf::Entity *a, pf::Entity *b) {}
+
+            // Either entity may have been removed by now
+            virtual void ContactEnd(pf::EntityHandle a, pf::EntityHandle b) {}
+    };
+}; // namespace pf
+
+#endif // ICONTACTLISTENER_H
@@ -0,0 +1,34 @@
+/*
+ * IHitVisitor.h
+ * An interface for objects that receive the results of collision queries
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef IHITVISITOR_H
+#define IHITVISITOR_H
+
+namespace pf {
+    struct Hit;
+
+    class IHitVisitor {
+        public:
+            // Called once per hit. Return false to stop the query.
+            virtual bool Visit(const pf::Hit& hit) = 0;
+    };
+}; // namespace pf
+
+#endif // IHITVISITOR_H
@@ -0,0 +1,87 @@
+/*
+ * JobPool.h
+ * Work-stealing thread pool for running batches of jobs in parallel
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef JOBPOOL_H
+#define JOBPOOL_H
+
+#include <SFML/System.hpp>
+#include <deque>
+#include <vector>
+
+namespace pf {
+    class IJob;
+
+    // Runs batches of jobs on a fixed set of threads. Each thread has its own
+    // queue, working from the back of it and stealing from the front of the
+    // others' once it runs dry. The thread that submits a batch works on it
+    // too, as thread 0. Between batches, workers block until the next one.
+    class JobPool {
+        public:
+            // threads counts the calling thread, so 1 runs everything inline
+            JobPool(int threads);
+            ~JobPool();
+
+            static int GetProcessorCount();
+
+            // Index of the pool thread this is called from, or 0 from any
+            // thread that isn't a worker
+            static int GetThreadIndex();
+
+            int GetThreadCount();
+
+            // Runs every job, returning once they've all finished. Jobs must
+            // not submit batches of their own.
+            void Run(pf::IJob **jobs, int count);
+
+        private:
+            class Worker : public sf::Thread {
+                public:
+                    Worker(pf::JobPool *pool, int index);
+
+                private:
+                    void Run();
+
+                    pf::JobPool *pool;
+                    int index;
+            };
+
+            struct Queue {
+                sf::Mutex lock;
+                std::deque<pf::IJob*> jobs;
+            };
+
+            // A counting semaphore, which SFML doesn't have
+            class Signal;
+
+            pf::IJob *Take(int index);
+            bool RunOne(int index);
+
+            // Reads a counter shared between threads, with a full barrier
+            static int Load(volatile int& value);
+
+            std::vector<Queue*> queues;
+            std::vector<Worker*> workers;
+            Signal *wakeup;
+            volatile int pending;
+            volatile int running;
+    };
+}; // namespace pf
+
+#endif // JOBPOOL_H
@@ -0,0 +1,79 @@
+/*
+ * Latency.h
+ * Estimates round-trip time, jitter, and clock offset from ping/pong samples
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+namespace pf {
+    class Latency {
+        public:
+            // Seconds between pings sent by either side
+            const static float PING_INTERVAL = 1.f;
+
+            // Number of recent samples the clock offset is picked from
+            const static int OFFSET_SAMPLES = 8;
+
+            Latency();
+            ~Latency();
+
+            // Milliseconds since the process started. All ping timestamps use this.
+            static uint32_t GetTime();
+
+            bool ShouldPing();
+            uint32_t NextSequence();
+
+            void AddSample(uint32_t sentTime, uint32_t remoteTime, uint32_t receivedTime);
+            void SetRemoteTick(uint32_t tick);
+
+            // Until the first sample comes in, takes the clock offset from a
+            // remote timestamp alone, ignoring how long it took to arrive
+            void SeedClockOffset(uint32_t remoteTime);
+
+            bool HasSamples();
+            bool HasClockOffset();
+            float GetRTT();
+            float GetMinRTT();
+            float GetJitter();
+            int32_t GetClockOffset();
+            uint32_t GetRemoteTime();
+            uint32_t GetRemoteTick();
+
+        private:
+            struct OffsetSample {
+                uint32_t rtt;
+                int32_t offset;
+            };
+
+            uint32_t lastPingTime;
+            uint32_t sequence;
+            int samples;
+            bool seeded;
+
+            float rtt, minRTT, jitter;
+            int32_t clockOffset;
+            uint32_t remoteTick;
+
+            OffsetSample offsetSamples[OFFSET_SAMPLES];
+    };
+}; // namespace pf
+
+#endif // LATENCY_H
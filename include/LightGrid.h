@@ -0,0 +1,88 @@
+/*
+ * LightGrid.h
+ * Flood-fill tile lighting from lights and the open sky
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LIGHTGRID_H
+#define LIGHTGRID_H
+
+#include "World.h"
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace pf {
+    // A light level, up to World::LIGHT_MAX, for every tile of a level.
+    // Light spreads from lights and the open sky through every tile but
+    // full solid ones, dimming by one a tile, and lights the faces of the
+    // solid tiles it reaches. Changes are queued and only the area around
+    // them is relit, when Update is called. Coordinates are in tiles.
+    class LightGrid {
+        public:
+            LightGrid();
+            ~LightGrid();
+
+            // Starts over on a level's tiles (or none, if tiles is NULL),
+            // which the grid keeps, and lights all of it. Lights are kept.
+            void Load(const pf::TileCell *tiles, int width, int height);
+
+            // The tile must be inside the level
+            int GetLevel(int x, int y);
+
+            // Lights from the level are dropped by RemoveLevelLights, for
+            // when it's about to be loaded again
+            int AddLight(int x, int y, int level, bool fromLevel = false);
+            void SetLightPosition(int light, int x, int y);
+            void RemoveLight(int light);
+            void RemoveLevelLights();
+
+            // Queues relighting around a tile that was just edited
+            void TileChanged(int x, int y);
+
+            // Relights around everything that changed since the last call
+            void Update();
+
+        private:
+            struct Light {
+                int x, y;
+                int level;
+                bool used, fromLevel;
+            };
+
+            void Spread();
+            void UpdateSky(int x);
+            void Change(int x, int y);
+            bool IsOpaque(int tile);
+
+            const pf::TileCell *tiles;
+            int width, height;
+            std::vector<Light> lights;
+
+            // emit is the light each tile gives off itself, and skyDepth the
+            // first opaque row of each column, above which the sky lights
+            // everything. Tiles that changed are queued in changes:
+            // everything they might have lit is cleared, then light spreads
+            // back in from around the cleared area.
+            std::vector<uint8_t> levels, emit;
+            std::vector<int> skyDepth;
+            std::vector<int> changes, queue, seeds, opaque;
+            std::vector< std::pair<int, int> > removal;     // Tile, and the light it had
+    };
+}; // namespace pf
+
+#endif // LIGHTGRID_H
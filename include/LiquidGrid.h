@@ -0,0 +1,124 @@
+/*
+ * LiquidGrid.h
+ * Cellular automaton for liquid flowing through the tile grid
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LIQUIDGRID_H
+#define LIQUIDGRID_H
+
+#include "World.h"
+#include <stdint.h>
+#include <vector>
+
+namespace pf {
+    class IJob;
+    class JobPool;
+
+    // A fill level, up to World::LIQUID_FULL, for every tile of a level.
+    // Tiles are empty or liquid by whether they hold any, so the grid sets
+    // them as liquid flows in and out. The level is split into chunks
+    // World::LIQUID_CHUNK tiles across, and only chunks where liquid moved
+    // last step (and the chunks around them) are stepped. Coordinates are
+    // in tiles.
+    class LiquidGrid {
+        public:
+            LiquidGrid();
+            ~LiquidGrid();
+
+            // Starts over on a level's tiles (or none, if tiles is NULL),
+            // which the grid keeps and edits. Liquid tiles start full, and
+            // empty ones become liquidTile as liquid flows in. Nothing holds
+            // liquid if liquidTile is 0.
+            void Load(pf::TileCell *tiles, int width, int height, pf::TileCell liquidTile);
+
+            // The tile must be inside the level
+            int GetLevel(int x, int y);
+
+            // Returns true if the tile filled or emptied, changing what
+            // overlaps it. Tiles that can't hold liquid are left alone.
+            bool SetLevel(int x, int y, int level);
+
+            // Loses the tile's liquid (as it will on clients), for when the
+            // tile is about to be edited
+            void Drain(int x, int y);
+
+            // Has the chunks around the tiles from (minX, minY) to (maxX,
+            // maxY) stepped again, for when they may be able to flow
+            void Activate(int minX, int minY, int maxX, int maxY);
+
+            // Off, nothing flows or is kept active, and levels only change
+            // when set. Turned back on, everything holding liquid is active.
+            void SetSimulation(bool enabled);
+
+            // Takes as many steps as frametime covers, running each pass on
+            // the pool when there are enough chunks and it's been started.
+            // Chunks where tiles filled or emptied are appended to flipped.
+            void Step(float frametime, pf::JobPool *pool, std::vector<int>& flipped);
+
+            // Chunks that would be stepped next
+            int GetActiveCount();
+
+            // Tiles whose liquid has changed since the last call, a chunk at
+            // a time
+            void TakeDeltas(std::vector<pf::LiquidDelta>& deltas);
+
+            // Every tile of every chunk whose liquid has changed since the
+            // grid was loaded
+            void GetSnapshot(std::vector<pf::LiquidDelta>& deltas);
+
+        private:
+            class FlowJob;
+
+            // A pass writes next for its chunks, and a commit pass copies it
+            // back
+            enum { PASS_FALL, PASS_SPREAD, PASS_COMMIT };
+            enum {
+                CHUNK_ACTIVE = 0x01,    // In activeChunks
+                CHUNK_MOVED = 0x02,     // Liquid flowed in or out this step
+                CHUNK_FLIPPED = 0x04,   // A tile filled or emptied this step
+                CHUNK_UNSENT = 0x08,    // In unsentChunks
+                CHUNK_TOUCHED = 0x10    // Changed since the grid was loaded
+            };
+
+            void RunPass(int pass, pf::JobPool *pool);
+            void Flow(int chunk, int pass);
+            bool Holds(int x, int y);
+            bool Settled(int x, int y);
+            int Fall(int x, int y);
+            int Spread(int fromX, int toX, int y);
+            void ActivateChunk(int chunkX, int chunkY);
+            void MarkUnsent(int chunk);
+
+            pf::TileCell *tiles;
+            int width, height;
+            pf::TileCell liquidTile;
+            bool simulation;
+            float credit;
+
+            // sent is as of the last deltas taken. Chunks are stepped in the
+            // order of activeChunks, and flagged as they go.
+            int chunksX, chunksY;
+            std::vector<uint8_t> levels, next, sent;
+            std::vector<uint8_t> chunkFlags;
+            std::vector<int> activeChunks, chunkScratch, unsentChunks;
+            std::vector<FlowJob*> jobs;
+            std::vector<pf::IJob*> jobList;
+    };
+}; // namespace pf
+
+#endif // LIQUIDGRID_H
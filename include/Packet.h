@@ -23,6 +23,8 @@
 
 #include <cstring>
 #include <stdint.h>
+#include <vector>
+#include "PacketSchema.h"
 
 namespace sf {
     class SocketTCP;
@@ -33,13 +35,13 @@ namespace pf {
     class CharacterSkin;
     class Character;
     class Entity;
+    class Elevator;
+    class World;
+    struct LiquidDelta;
+    struct TileRun;
 
     namespace Packet {
-        static const char PROTOCOL_VERSION = 2;
-
-        struct BasePacket {
-            virtual void Send(sf::SocketTCP *socket) {};
-        };
+        static const char PROTOCOL_VERSION = 8;
 
         struct PacketString {
             uint16_t length;
@@ -52,102 +54,124 @@ namespace pf {
             }
 
             PacketString(sf::SocketTCP *socket);
-            void Send(sf::SocketTCP *socket);
 
             ~PacketString() {
                 delete [] string;
             }
         };
 
-        struct LoginRequest : BasePacket {
-            static const char packetType = 0x01;
+        struct LoginRequest : SchemaPacket<LoginRequest, 0x01> {
             char clientProtocolVersion;
             PacketString *username;
 
+            typedef Schema::Fields<
+                Schema::Field<LoginRequest, char, &LoginRequest::clientProtocolVersion>,
+                Schema::String<LoginRequest, &LoginRequest::username> > Layout;
+
             LoginRequest(char *username) {
                 clientProtocolVersion = PROTOCOL_VERSION;
                 this->username = new PacketString(username);
             }
 
-            LoginRequest(sf::SocketTCP *socket);
-            void Send(sf::SocketTCP *socket);
+            LoginRequest(sf::SocketTCP *socket) { Receive(socket); }
 
             ~LoginRequest() {
                 delete username;
             }
         };
 
-        struct Kick : BasePacket {
-            static const char packetType = 0x07;
+        struct Kick : SchemaPacket<Kick, 0x07> {
             PacketString *reason;
 
+            typedef Schema::Fields<
+                Schema::String<Kick, &Kick::reason> > Layout;
+
             Kick(char *reason) {
                 this->reason = new PacketString(reason);
             }
 
-            Kick(sf::SocketTCP *socket);
-            void Send(sf::SocketTCP *socket);
+            Kick(sf::SocketTCP *socket) { Receive(socket); }
 
             ~Kick() {
                 delete reason;
             }
         };
 
-        struct BeginLoad : BasePacket {
-            static const char packetType = 0x02;
+        struct BeginLoad : SchemaPacket<BeginLoad, 0x02> {
             uint16_t numResources;
 
+            typedef Schema::Fields<
+                Schema::Field<BeginLoad, uint16_t, &BeginLoad::numResources> > Layout;
+
             BeginLoad(uint16_t numResources) {
                 this->numResources = numResources;
             }
 
-            BeginLoad(sf::SocketTCP *socket);
-            void Send(sf::SocketTCP *socket);
+            BeginLoad(sf::SocketTCP *socket) { Receive(socket); }
 
             ~BeginLoad() {}
         };
 
-        struct EndLoad : BasePacket {
-            static const char packetType = 0x03;
+        struct EndLoad : SchemaPacket<EndLoad, 0x03> {
+            typedef Schema::Fields<> Layout;
 
             EndLoad() {}
 
-            EndLoad(sf::SocketTCP *socket);
-            void Send(sf::SocketTCP *socket);
+            EndLoad(sf::SocketTCP *socket) { Receive(socket); }
 
             ~EndLoad() {}
         };
 
-        struct Resource : BasePacket {
-            static const char packetType = 0x04;
+        // When sending, data belongs to the source resource and is sent
+        // straight from it. The resource's contents at the time of sending
+        // are used, since it may be reloaded while queued. When receiving,
+        // data is owned by the packet until GetResource() hands it over.
+        struct Resource : SchemaPacket<Resource, 0x04> {
             PacketString *filename;
             uint32_t length;
             char *data;
+            pf::Resource *resource;
+
+            typedef Schema::Fields<
+                Schema::String<Resource, &Resource::filename>,
+                Schema::Blob<Resource, &Resource::length, &Resource::data> > Layout;
+
+            // Everything in Layout up to the file contents
+            typedef Schema::Fields<
+                Schema::String<Resource, &Resource::filename>,
+                Schema::Field<Resource, uint32_t, &Resource::length> > Header;
 
             Resource(pf::Resource *resource);
 
-            Resource(sf::SocketTCP *socket);
+            Resource(sf::SocketTCP *socket) {
+                resource = NULL;
+                Receive(socket);
+            }
+
             void Send(sf::SocketTCP *socket);
 
             pf::Resource *GetResource();
 
             ~Resource() {
                 delete filename;
+                if (!resource) delete [] data;
             }
         };
 
-        struct Property : BasePacket {
-            static const char packetType = 0x05;
+        struct Property : SchemaPacket<Property, 0x05> {
             PacketString *name;
             PacketString *value;
 
+            typedef Schema::Fields<
+                Schema::String<Property, &Property::name>,
+                Schema::String<Property, &Property::value> > Layout;
+
             Property(char *name, char *value) {
                 this->name = new PacketString(name);
                 this->value = new PacketString(value);
             }
 
-            Property(sf::SocketTCP *socket);
-            void Send(sf::SocketTCP *socket);
+            Property(sf::SocketTCP *socket) { Receive(socket); }
 
             ~Property() {
                 delete name;
@@ -155,13 +179,19 @@ namespace pf {
             }
         };
 
-        struct SpawnCharacter : BasePacket {
-            static const char packetType = 0x08;
+        struct SpawnCharacter : SchemaPacket<SpawnCharacter, 0x08> {
             uint32_t entityID;
             PacketString *username;
             PacketString *skin;
             uint16_t x, y;
 
+            typedef Schema::Fields<
+                Schema::Field<SpawnCharacter, uint32_t, &SpawnCharacter::entityID>,
+                Schema::String<SpawnCharacter, &SpawnCharacter::username>,
+                Schema::String<SpawnCharacter, &SpawnCharacter::skin>,
+                Schema::Field<SpawnCharacter, uint16_t, &SpawnCharacter::x>,
+                Schema::Field<SpawnCharacter, uint16_t, &SpawnCharacter::y> > Layout;
+
             SpawnCharacter(int entityID, char *username, char *skin, int x, int y) {
                 this->entityID = entityID;
                 this->username = new PacketString(username);
@@ -172,8 +202,7 @@ namespace pf {
 
             SpawnCharacter(pf::Character *character);
 
-            SpawnCharacter(sf::SocketTCP *socket);
-            void Send(sf::SocketTCP *socket);
+            SpawnCharacter(sf::SocketTCP *socket) { Receive(socket); }
 
             ~SpawnCharacter() {
                 delete username;
@@ -181,14 +210,21 @@ namespace pf {
             }
         };
 
-        struct CharacterSkin : BasePacket {
-            static const char packetType = 0x09;
+        struct CharacterSkin : SchemaPacket<CharacterSkin, 0x09> {
             PacketString *name;
             PacketString *resource;
             uint16_t width, height;
             char framerate;
             uint16_t frames;
 
+            typedef Schema::Fields<
+                Schema::String<CharacterSkin, &CharacterSkin::name>,
+                Schema::String<CharacterSkin, &CharacterSkin::resource>,
+                Schema::Field<CharacterSkin, uint16_t, &CharacterSkin::width>,
+                Schema::Field<CharacterSkin, uint16_t, &CharacterSkin::height>,
+                Schema::Field<CharacterSkin, char, &CharacterSkin::framerate>,
+                Schema::Field<CharacterSkin, uint16_t, &CharacterSkin::frames> > Layout;
+
             CharacterSkin(char *name, char *resource, unsigned short width, unsigned short height, char framerate, unsigned short frames) {
                 this->name = new PacketString(name);
                 this->resource = new PacketString(resource);
@@ -200,8 +236,7 @@ namespace pf {
 
             CharacterSkin(pf::CharacterSkin *skin);
 
-            CharacterSkin(sf::SocketTCP *socket);
-            void Send(sf::SocketTCP *socket);
+            CharacterSkin(sf::SocketTCP *socket) { Receive(socket); }
 
             pf::CharacterSkin *GetCharacterSkin();
 
@@ -211,11 +246,16 @@ namespace pf {
             }
         };
 
-        struct CharacterAnimation : BasePacket {
-            static const char packetType = 0x0A;
+        // The frame is always sent (even when gotoFrame is clear) so that the
+        // packet stays fixed-size.
+        struct CharacterAnimation : SchemaPacket<CharacterAnimation, 0x0A> {
             char data;
             uint16_t frame;
 
+            typedef Schema::Fields<
+                Schema::Field<CharacterAnimation, char, &CharacterAnimation::data>,
+                Schema::Field<CharacterAnimation, uint16_t, &CharacterAnimation::frame> > Layout;
+
             static char MakeData(bool facingRight, bool playing, bool gotoFrame) {
                 char data = 0;
 
@@ -238,8 +278,7 @@ namespace pf {
 
             CharacterAnimation(pf::Character *character);
 
-            CharacterAnimation(sf::SocketTCP *socket);
-            void Send(sf::SocketTCP *socket);
+            CharacterAnimation(sf::SocketTCP *socket) { Receive(socket); }
 
             bool IsFacingRight();
             bool IsPlaying();
@@ -248,38 +287,31 @@ namespace pf {
             ~CharacterAnimation() {}
         };
 
-        struct OtherCharacterAnimation : BasePacket {
-            static const char packetType = 0x0F;
+        struct OtherCharacterAnimation : SchemaPacket<OtherCharacterAnimation, 0x0F> {
             uint32_t entityID;
             char data;
             uint16_t frame;
 
-            static char MakeData(bool facingRight, bool playing, bool gotoFrame) {
-                char data = 0;
-
-                if (facingRight) data |= 0x01;
-                if (playing) data |= 0x02;
-                if (gotoFrame) data |= 0x04;
-
-                return data;
-            }
+            typedef Schema::Fields<
+                Schema::Field<OtherCharacterAnimation, uint32_t, &OtherCharacterAnimation::entityID>,
+                Schema::Field<OtherCharacterAnimation, char, &OtherCharacterAnimation::data>,
+                Schema::Field<OtherCharacterAnimation, uint16_t, &OtherCharacterAnimation::frame> > Layout;
 
             OtherCharacterAnimation(int entityID, bool facingRight, bool playing) {
                 this->entityID = entityID;
-                this->data = MakeData(facingRight, playing, false);
+                this->data = CharacterAnimation::MakeData(facingRight, playing, false);
                 this->frame = 0;
             }
 
             OtherCharacterAnimation(int entityID, bool facingRight, bool playing, int frame) {
                 this->entityID = entityID;
-                this->data = MakeData(facingRight, playing, true);
+                this->data = CharacterAnimation::MakeData(facingRight, playing, true);
                 this->frame = frame;
             }
 
             OtherCharacterAnimation(pf::Character *character);
 
-            OtherCharacterAnimation(sf::SocketTCP *socket);
-            void Send(sf::SocketTCP *socket);
+            OtherCharacterAnimation(sf::SocketTCP *socket) { Receive(socket); }
 
             bool IsFacingRight();
             bool IsPlaying();
@@ -288,90 +320,105 @@ namespace pf {
             ~OtherCharacterAnimation() {}
         };
 
-        struct StartWorld : BasePacket {
-            static const char packetType = 0x0B;
+        struct StartWorld : SchemaPacket<StartWorld, 0x0B> {
+            typedef Schema::Fields<> Layout;
 
             StartWorld() {}
 
-            StartWorld(sf::SocketTCP *socket);
-            void Send(sf::SocketTCP *socket);
+            StartWorld(sf::SocketTCP *socket) { Receive(socket); }
 
             ~StartWorld() {}
         };
 
-        struct SetCharacter : BasePacket {
-            static const char packetType = 0x06;
+        struct SetCharacter : SchemaPacket<SetCharacter, 0x06> {
             uint32_t entityID;
 
+            typedef Schema::Fields<
+                Schema::Field<SetCharacter, uint32_t, &SetCharacter::entityID> > Layout;
+
             SetCharacter(int entityID) {
                 this->entityID = entityID;
             }
 
             SetCharacter(pf::Character *character);
 
-            SetCharacter(sf::SocketTCP *socket);
-            void Send(sf::SocketTCP *socket);
+            SetCharacter(sf::SocketTCP *socket) { Receive(socket); }
 
             ~SetCharacter() {}
         };
 
-        struct TeleportEntity : BasePacket {
-            static const char packetType = 0x0C;
+        struct TeleportEntity : SchemaPacket<TeleportEntity, 0x0C> {
+            uint32_t tick;
             uint32_t entityID;
             uint16_t x, y;
 
-            TeleportEntity(int entityID, int x, int y) {
+            typedef Schema::Fields<
+                Schema::Field<TeleportEntity, uint32_t, &TeleportEntity::tick>,
+                Schema::Field<TeleportEntity, uint32_t, &TeleportEntity::entityID>,
+                Schema::Field<TeleportEntity, uint16_t, &TeleportEntity::x>,
+                Schema::Field<TeleportEntity, uint16_t, &TeleportEntity::y> > Layout;
+
+            TeleportEntity(uint32_t tick, int entityID, int x, int y) {
+                this->tick = tick;
                 this->entityID = entityID;
                 this->x = x;
                 this->y = y;
             }
 
-            TeleportEntity(pf::Entity *entity);
+            TeleportEntity(uint32_t tick, pf::Entity *entity);
 
-            TeleportEntity(sf::SocketTCP *socket);
-            void Send(sf::SocketTCP *socket);
+            TeleportEntity(sf::SocketTCP *socket) { Receive(socket); }
 
             ~TeleportEntity() {}
         };
 
-        struct DespawnEntity : BasePacket {
-            static const char packetType = 0x0D;
+        struct DespawnEntity : SchemaPacket<DespawnEntity, 0x0D> {
             uint32_t entityID;
 
+            typedef Schema::Fields<
+                Schema::Field<DespawnEntity, uint32_t, &DespawnEntity::entityID> > Layout;
+
             DespawnEntity(int entityID) {
                 this->entityID = entityID;
             }
 
             DespawnEntity(pf::Entity *entity);
 
-            DespawnEntity(sf::SocketTCP *socket);
-            void Send(sf::SocketTCP *socket);
+            DespawnEntity(sf::SocketTCP *socket) { Receive(socket); }
 
             ~DespawnEntity() {}
         };
 
-        struct AbsoluteMove : BasePacket {
-            static const char packetType = 0x0F;
+        struct AbsoluteMove : SchemaPacket<AbsoluteMove, 0x0E> {
+            uint32_t tick;
             uint16_t x, y;
 
-            AbsoluteMove(int x, int y) {
+            typedef Schema::Fields<
+                Schema::Field<AbsoluteMove, uint32_t, &AbsoluteMove::tick>,
+                Schema::Field<AbsoluteMove, uint16_t, &AbsoluteMove::x>,
+                Schema::Field<AbsoluteMove, uint16_t, &AbsoluteMove::y> > Layout;
+
+            AbsoluteMove(uint32_t tick, int x, int y) {
+                this->tick = tick;
                 this->x = x;
                 this->y = y;
             }
 
-            AbsoluteMove(pf::Entity *entity);
+            AbsoluteMove(uint32_t tick, pf::Entity *entity);
 
-            AbsoluteMove(sf::SocketTCP *socket);
-            void Send(sf::SocketTCP *socket);
+            AbsoluteMove(sf::SocketTCP *socket) { Receive(socket); }
 
             ~AbsoluteMove() {}
         };
 
-        struct Health : BasePacket {
-            static const char packetType = 0x10;
+        struct Health : SchemaPacket<Health, 0x10> {
             uint32_t entityID;
             char health;
 
+            typedef Schema::Fields<
+                Schema::Field<Health, uint32_t, &Health::entityID>,
+                Schema::Field<Health, char, &Health::health> > Layout;
+
             Health(int entityID, int health) {
                 this->entityID = entityID;
                 this->health = health;
@@ -379,27 +426,251 @@ namespace pf {
 
             Health(pf::Character *character);
 
-            Health(sf::SocketTCP *socket);
-            void Send(sf::SocketTCP *socket);
+            Health(sf::SocketTCP *socket) { Receive(socket); }
 
             ~Health() {}
         };
 
-        struct Chat : BasePacket {
-            static const char packetType = 0x11;
+        struct Chat : SchemaPacket<Chat, 0x11> {
             PacketString *message;
 
+            typedef Schema::Fields<
+                Schema::String<Chat, &Chat::message> > Layout;
+
             Chat(const char *message) {
                 this->message = new PacketString((char*)message);
             }
 
-            Chat(sf::SocketTCP *socket);
-            void Send(sf::SocketTCP *socket);
+            Chat(sf::SocketTCP *socket) { Receive(socket); }
 
             ~Chat() {
                 delete message;
             }
         };
+
+        struct Ping : SchemaPacket<Ping, 0x12> {
+            uint32_t sequence;
+            uint32_t time;
+
+            typedef Schema::Fields<
+                Schema::Field<Ping, uint32_t, &Ping::sequence>,
+                Schema::Field<Ping, uint32_t, &Ping::time> > Layout;
+
+            Ping(uint32_t sequence, uint32_t time) {
+                this->sequence = sequence;
+                this->time = time;
+            }
+
+            Ping(sf::SocketTCP *socket) { Receive(socket); }
+
+            ~Ping() {}
+        };
+
+        struct Pong : SchemaPacket<Pong, 0x13> {
+            uint32_t sequence;
+            uint32_t pingTime;
+            uint32_t time;
+            uint32_t tick;
+
+            typedef Schema::Fields<
+                Schema::Field<Pong, uint32_t, &Pong::sequence>,
+                Schema::Field<Pong, uint32_t, &Pong::pingTime>,
+                Schema::Field<Pong, uint32_t, &Pong::time>,
+                Schema::Field<Pong, uint32_t, &Pong::tick> > Layout;
+
+            Pong(pf::Packet::Ping *ping, uint32_t time, uint32_t tick) {
+                this->sequence = ping->sequence;
+                this->pingTime = ping->time;
+                this->time = time;
+                this->tick = tick;
+            }
+
+            Pong(sf::SocketTCP *socket) { Receive(socket); }
+
+            ~Pong() {}
+        };
+
+        // Turns the client's copy of a resource into the server's current
+        // version. Only applied if the client's copy matches baseChecksum.
+        struct ResourcePatch : SchemaPacket<ResourcePatch, 0x14> {
+            PacketString *filename;
+            uint32_t baseChecksum;
+            uint32_t targetChecksum;
+            uint32_t targetLength;
+            uint32_t length;
+            char *patch;
+
+            typedef Schema::Fields<
+                Schema::String<ResourcePatch, &ResourcePatch::filename>,
+                Schema::Field<ResourcePatch, uint32_t, &ResourcePatch::baseChecksum>,
+                Schema::Field<ResourcePatch, uint32_t, &ResourcePatch::targetChecksum>,
+                Schema::Field<ResourcePatch, uint32_t, &ResourcePatch::targetLength>,
+                Schema::Blob<ResourcePatch, &ResourcePatch::length, &ResourcePatch::patch> > Layout;
+
+            ResourcePatch(pf::Resource *resource, uint32_t baseChecksum, const char *patch, uint32_t length);
+
+            ResourcePatch(sf::SocketTCP *socket) { Receive(socket); }
+
+            // Patches the local copy of the resource. Returns false if it
+            // isn't the version the patch was made against.
+            bool Apply(pf::Resource *resource);
+
+            ~ResourcePatch() {
+                delete filename;
+                delete [] patch;
+            }
+        };
+
+        // An elevator, with everything needed to work out where it is from
+        // then on, so its position is never sent. elapsed is how far into its
+        // path it was (in milliseconds) at serverTime, which is on the
+        // server's clock, and waypoints holds an x and y (each a uint16_t)
+        // per waypoint. When sending, both times are taken as it goes out,
+        // since it may sit queued behind resources for a while first.
+        struct SpawnMover : SchemaPacket<SpawnMover, 0x15> {
+            uint32_t entityID;
+            PacketString *image;
+            char mode;
+            uint16_t speed;
+            uint32_t serverTime;
+            uint32_t elapsed;
+            uint32_t length;
+            char *waypoints;
+            pf::Elevator *mover;
+            pf::World *world;
+
+            typedef Schema::Fields<
+                Schema::Field<SpawnMover, uint32_t, &SpawnMover::entityID>,
+                Schema::String<SpawnMover, &SpawnMover::image>,
+                Schema::Field<SpawnMover, char, &SpawnMover::mode>,
+                Schema::Field<SpawnMover, uint16_t, &SpawnMover::speed>,
+                Schema::Field<SpawnMover, uint32_t, &SpawnMover::serverTime>,
+                Schema::Field<SpawnMover, uint32_t, &SpawnMover::elapsed>,
+                Schema::Blob<SpawnMover, &SpawnMover::length, &SpawnMover::waypoints> > Layout;
+
+            SpawnMover(pf::Elevator *mover, pf::World *world);
+
+            SpawnMover(sf::SocketTCP *socket) {
+                mover = NULL;
+                world = NULL;
+                Receive(socket);
+            }
+
+            void Send(sf::SocketTCP *socket);
+
+            // The world must be kept on the server's clock (see
+            // World::SetClock), which the path start is given on
+            pf::Elevator *GetElevator(pf::World *world);
+
+            ~SpawnMover() {
+                delete image;
+                delete [] waypoints;
+            }
+        };
+
+        // Liquid levels in one of the world's liquid chunks. cells holds a
+        // byte for the tile's index in the chunk and a byte for its level
+        // per tile, and only tiles that changed are sent.
+        struct LiquidChunk : SchemaPacket<LiquidChunk, 0x16> {
+            uint16_t chunkX, chunkY;
+            uint32_t length;
+            char *cells;
+
+            typedef Schema::Fields<
+                Schema::Field<LiquidChunk, uint16_t, &LiquidChunk::chunkX>,
+                Schema::Field<LiquidChunk, uint16_t, &LiquidChunk::chunkY>,
+                Schema::Blob<LiquidChunk, &LiquidChunk::length, &LiquidChunk::cells> > Layout;
+
+            LiquidChunk(const pf::LiquidDelta& delta);
+
+            LiquidChunk(sf::SocketTCP *socket) { Receive(socket); }
+
+            void Apply(pf::World *world);
+
+            ~LiquidChunk() {
+                delete [] cells;
+            }
+        };
+
+        // Every tile edited over a server tick, as runs of tiles set alike.
+        // Each run is the number of tiles skipped since the last run and
+        // the run's length (both as base-128 varints), then a byte for the
+        // tile's index in Tileset::Tiles plus one, or zero for empty space.
+        // Removed tiles only crumble into debris if crumble is set, so a
+        // snapshot for a client that's just joined doesn't.
+        struct TileEdits : SchemaPacket<TileEdits, 0x17> {
+            char crumble;
+            uint32_t length;
+            char *runs;
+
+            typedef Schema::Fields<
+                Schema::Field<TileEdits, char, &TileEdits::crumble>,
+                Schema::Blob<TileEdits, &TileEdits::length, &TileEdits::runs> > Layout;
+
+            TileEdits(const std::vector<pf::TileRun>& edits, bool crumble);
+
+            TileEdits(sf::SocketTCP *socket) { Receive(socket); }
+
+            void Apply(pf::World *world);
+
+            ~TileEdits() {
+                delete [] runs;
+            }
+        };
+
+        // Packet ID registry. Each ID may appear only once, and a packet can't
+        // be sent until its ID is listed here.
+        template<> struct PacketID<LoginRequest::packetType> { typedef LoginRequest Type; };
+        template<> struct PacketID<BeginLoad::packetType> { typedef BeginLoad Type; };
+        template<> struct PacketID<EndLoad::packetType> { typedef EndLoad Type; };
+        template<> struct PacketID<Resource::packetType> { typedef Resource Type; };
+        template<> struct PacketID<Property::packetType> { typedef Property Type; };
+        template<> struct PacketID<SetCharacter::packetType> { typedef SetCharacter Type; };
+        template<> struct PacketID<Kick::packetType> { typedef Kick Type; };
+        template<> struct PacketID<SpawnCharacter::packetType> { typedef SpawnCharacter Type; };
+        template<> struct PacketID<CharacterSkin::packetType> { typedef CharacterSkin Type; };
+        template<> struct PacketID<CharacterAnimation::packetType> { typedef CharacterAnimation Type; };
+        template<> struct PacketID<StartWorld::packetType> { typedef StartWorld Type; };
+        template<> struct PacketID<TeleportEntity::packetType> { typedef TeleportEntity Type; };
+        template<> struct PacketID<DespawnEntity::packetType> { typedef DespawnEntity Type; };
+        template<> struct PacketID<AbsoluteMove::packetType> { typedef AbsoluteMove Type; };
+        template<> struct PacketID<OtherCharacterAnimation::packetType> { typedef OtherCharacterAnimation Type; };
+        template<> struct PacketID<Health::packetType> { typedef Health Type; };
+        template<> struct PacketID<Chat::packetType> { typedef Chat Type; };
+        template<> struct PacketID<Ping::packetType> { typedef Ping Type; };
+        template<> struct PacketID<Pong::packetType> { typedef Pong Type; };
+        template<> struct PacketID<ResourcePatch::packetType> { typedef ResourcePatch Type; };
+        template<> struct PacketID<SpawnMover::packetType> { typedef SpawnMover Type; };
+        template<> struct PacketID<LiquidChunk::packetType> { typedef LiquidChunk Type; };
+        template<> struct PacketID<TileEdits::packetType> { typedef TileEdits Type; };
+
+        // Fixed-size packets must stay fixed-size
+        PF_STATIC_ASSERT(CharacterAnimation::Layout::FIXED && CharacterAnimation::Layout::SIZE == 3, character_animation_size);
+        PF_STATIC_ASSERT(TeleportEntity::Layout::FIXED && TeleportEntity::Layout::SIZE == 12, teleport_entity_size);
+        PF_STATIC_ASSERT(AbsoluteMove::Layout::FIXED && AbsoluteMove::Layout::SIZE == 8, absolute_move_size);
+        PF_STATIC_ASSERT(Pong::Layout::FIXED && Pong::Layout::SIZE == 16, pong_size);
+
+        // Resource::Header must put the same bytes on the wire as Layout does
+        // before the file contents
+        PF_STATIC_ASSERT((int)Resource::Header::SIZE == (int)Resource::Layout::SIZE, resource_header_size);
+
+        template<typename P, pf::Packet::PacketString *P::*member>
+        std::size_t Schema::String<P, member>::Size(const P& packet) {
+            return SIZE + (packet.*member)->length;
+        }
+
+        template<typename P, pf::Packet::PacketString *P::*member>
+        void Schema::String<P, member>::Write(const P& packet, char *&out) {
+            PacketString *string = packet.*member;
+            memcpy(out, &string->length, SIZE);
+            memcpy(out + SIZE, string->string, string->length);
+            out += SIZE + string->length;
+        }
+
+        template<typename P, pf::Packet::PacketString *P::*member>
+        void Schema::String<P, member>::Receive(P& packet, sf::SocketTCP *socket) {
+            packet.*member = new PacketString(socket);
+        }
     }; // namespace Packet
 }; // namespace pf
 
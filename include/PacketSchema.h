@@ -0,0 +1,237 @@
+/*
+ * PacketSchema.h
+ * Compile-time field lists that generate packet encoders and decoders
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PACKETSCHEMA_H
+#define PACKETSCHEMA_H
+
+#include <cstring>
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+// Fails to compile (negative array size) when cond is false
+#define PF_STATIC_ASSERT(cond, name) typedef char pf_static_assert_##name[(cond) ? 1 : -1]
+
+namespace sf {
+    class SocketTCP;
+}
+
+namespace pf {
+    namespace Packet {
+        struct PacketString;
+
+        struct BasePacket {
+            virtual void Send(sf::SocketTCP *socket) {};
+            virtual ~BasePacket() {};
+        };
+
+        // Blocking send/receive of exactly `length` bytes.
+        bool SendAll(sf::SocketTCP *socket, const char *data, std::size_t length);
+        bool ReceiveAll(sf::SocketTCP *socket, char *data, std::size_t length);
+
+        // Receives a blob's length. Anything over Resource::MAX_LENGTH isn't
+        // allocated; its bytes are read and thrown away, and it's received as
+        // an empty blob so the stream stays in step.
+        bool ReceiveLength(sf::SocketTCP *socket, uint32_t& length);
+
+        // Every packet ID maps to exactly one packet type. Specializations live
+        // at the bottom of Packet.h; a duplicate ID is a redefinition error.
+        template<char ID> struct PacketID;
+
+        namespace Schema {
+            // Only fixed-width scalars may be copied straight onto the wire
+            template<typename T> struct IsScalar { enum { VALUE = 0 }; };
+            template<> struct IsScalar<char> { enum { VALUE = 1 }; };
+            template<> struct IsScalar<int8_t> { enum { VALUE = 1 }; };
+            template<> struct IsScalar<uint8_t> { enum { VALUE = 1 }; };
+            template<> struct IsScalar<int16_t> { enum { VALUE = 1 }; };
+            template<> struct IsScalar<uint16_t> { enum { VALUE = 1 }; };
+            template<> struct IsScalar<int32_t> { enum { VALUE = 1 }; };
+            template<> struct IsScalar<uint32_t> { enum { VALUE = 1 }; };
+            template<> struct IsScalar<float> { enum { VALUE = 1 }; };
+
+            template<typename A, typename B> struct IsSame { enum { VALUE = 0 }; };
+            template<typename A> struct IsSame<A, A> { enum { VALUE = 1 }; };
+
+            // A fixed-width scalar member
+            template<typename P, typename T, T P::*member>
+            struct Field {
+                PF_STATIC_ASSERT(IsScalar<T>::VALUE, field_must_be_fixed_width_scalar);
+                enum { FIXED = 1, SIZE = sizeof(T) };
+
+                static std::size_t Size(const P& packet) { return SIZE; }
+
+                static void Write(const P& packet, char *&out) {
+                    memcpy(out, &(packet.*member), sizeof(T));
+                    out += sizeof(T);
+                }
+
+                static void Read(P& packet, const char *&in) {
+                    memcpy(&(packet.*member), in, sizeof(T));
+                    in += sizeof(T);
+                }
+
+                static void Receive(P& packet, sf::SocketTCP *socket) {
+                    ReceiveAll(socket, (char *)&(packet.*member), sizeof(T));
+                }
+            };
+
+            // A length-prefixed string, owned by the packet
+            template<typename P, pf::Packet::PacketString *P::*member>
+            struct String {
+                enum { FIXED = 0, SIZE = sizeof(uint16_t) };
+
+                static std::size_t Size(const P& packet);
+                static void Write(const P& packet, char *&out);
+                static void Receive(P& packet, sf::SocketTCP *socket);
+            };
+
+            // A uint32 length followed by that many raw bytes
+            template<typename P, uint32_t P::*length, char *P::*data>
+            struct Blob {
+                enum { FIXED = 0, SIZE = sizeof(uint32_t) };
+
+                static std::size_t Size(const P& packet) {
+                    return SIZE + packet.*length;
+                }
+
+                static void Write(const P& packet, char *&out) {
+                    memcpy(out, &(packet.*length), SIZE);
+                    memcpy(out + SIZE, packet.*data, packet.*length);
+                    out += SIZE + packet.*length;
+                }
+
+                static void Receive(P& packet, sf::SocketTCP *socket) {
+                    ReceiveLength(socket, packet.*length);
+                    packet.*data = new char[packet.*length];
+                    ReceiveAll(socket, packet.*data, packet.*length);
+                }
+            };
+
+            // Terminates a field list; every operation is a no-op
+            struct End {
+                enum { FIXED = 1, SIZE = 0 };
+
+                template<typename P> static std::size_t Size(const P& packet) { return 0; }
+                template<typename P> static void Write(const P& packet, char *&out) {}
+                template<typename P> static void Read(P& packet, const char *&in) {}
+                template<typename P> static void Receive(P& packet, sf::SocketTCP *socket) {}
+            };
+
+            // An ordered list of up to eight fields. SIZE is the wire size of a
+            // fixed packet, or the size of its fixed parts otherwise.
+            template<typename F1 = End, typename F2 = End, typename F3 = End, typename F4 = End,
+                     typename F5 = End, typename F6 = End, typename F7 = End, typename F8 = End>
+            struct Fields {
+                enum {
+                    FIXED = F1::FIXED && F2::FIXED && F3::FIXED && F4::FIXED &&
+                            F5::FIXED && F6::FIXED && F7::FIXED && F8::FIXED,
+                    SIZE = F1::SIZE + F2::SIZE + F3::SIZE + F4::SIZE +
+                           F5::SIZE + F6::SIZE + F7::SIZE + F8::SIZE
+                };
+
+                template<typename P> static std::size_t Size(const P& packet) {
+                    return F1::Size(packet) + F2::Size(packet) + F3::Size(packet) + F4::Size(packet) +
+                           F5::Size(packet) + F6::Size(packet) + F7::Size(packet) + F8::Size(packet);
+                }
+
+                template<typename P> static void Write(const P& packet, char *&out) {
+                    F1::Write(packet, out); F2::Write(packet, out); F3::Write(packet, out); F4::Write(packet, out);
+                    F5::Write(packet, out); F6::Write(packet, out); F7::Write(packet, out); F8::Write(packet, out);
+                }
+
+                template<typename P> static void Read(P& packet, const char *&in) {
+                    F1::Read(packet, in); F2::Read(packet, in); F3::Read(packet, in); F4::Read(packet, in);
+                    F5::Read(packet, in); F6::Read(packet, in); F7::Read(packet, in); F8::Read(packet, in);
+                }
+
+                template<typename P> static void Receive(P& packet, sf::SocketTCP *socket) {
+                    F1::Receive(packet, socket); F2::Receive(packet, socket); F3::Receive(packet, socket); F4::Receive(packet, socket);
+                    F5::Receive(packet, socket); F6::Receive(packet, socket); F7::Receive(packet, socket); F8::Receive(packet, socket);
+                }
+            };
+
+            // Encodes the packet type followed by the fields in L as one send.
+            // Packets that stream part of their payload separately use this to
+            // send everything that comes before it.
+            template<typename L, typename P>
+            void SendFields(const P& packet, sf::SocketTCP *socket) {
+                std::vector<char> buffer(1 + L::Size(packet));
+                char *out = &buffer[1];
+                buffer[0] = P::packetType;
+                L::Write(packet, out);
+                SendAll(socket, &buffer[0], buffer.size());
+            }
+
+            // Fixed packets go out and come in as one buffer of a size known at
+            // compile time, with no per-field branches or socket calls.
+            template<typename P, bool FIXED = P::Layout::FIXED>
+            struct Codec {
+                static void Send(const P& packet, sf::SocketTCP *socket) {
+                    char buffer[1 + P::Layout::SIZE];
+                    char *out = buffer + 1;
+                    buffer[0] = P::packetType;
+                    P::Layout::Write(packet, out);
+                    SendAll(socket, buffer, sizeof(buffer));
+                }
+
+                static void Receive(P& packet, sf::SocketTCP *socket) {
+                    char buffer[P::Layout::SIZE + 1];
+                    const char *in = buffer;
+                    ReceiveAll(socket, buffer, P::Layout::SIZE);
+                    P::Layout::Read(packet, in);
+                }
+            };
+
+            // Variable packets are still encoded into a single send, but are
+            // decoded field by field since their length isn't known up front.
+            template<typename P>
+            struct Codec<P, false> {
+                static void Send(const P& packet, sf::SocketTCP *socket) {
+                    SendFields<typename P::Layout>(packet, socket);
+                }
+
+                static void Receive(P& packet, sf::SocketTCP *socket) {
+                    P::Layout::Receive(packet, socket);
+                }
+            };
+        } // namespace Schema
+
+        // Base for every packet. P declares its fields once in a nested Layout
+        // typedef; sending and receiving are generated from it.
+        template<typename P, char ID>
+        struct SchemaPacket : BasePacket {
+            static const char packetType = ID;
+
+            void Send(sf::SocketTCP *socket) {
+                // Doesn't compile unless P is registered under ID in Packet.h
+                (void)sizeof(char[Schema::IsSame<typename PacketID<ID>::Type, P>::VALUE ? 1 : -1]);
+                Schema::Codec<P>::Send(static_cast<P&>(*this), socket);
+            }
+
+        protected:
+            void Receive(sf::SocketTCP *socket) {
+                Schema::Codec<P>::Receive(static_cast<P&>(*this), socket);
+            }
+        };
+    }; // namespace Packet
+}; // namespace pf
+
+#endif // PACKETSCHEMA_H
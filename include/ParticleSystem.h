@@ -0,0 +1,102 @@
+/*
+ * ParticleSystem.h
+ * Pooled, vectorized particles that collide with the tile grid
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PARTICLESYSTEM_H
+#define PARTICLESYSTEM_H
+
+#include <SFML/Graphics.hpp>
+#include "World.h"
+#include <vector>
+
+namespace pf {
+    // Spawns particles at a steady rate
+    struct ParticleEmitter {
+        float x, y;
+        float rate;         // Particles per second
+        float life;         // Seconds each particle lives
+        float direction;    // Radians; 0 is right, pi/2 is down
+        float spread;       // Radians either side of direction
+        float speed;
+        float gravity;      // Multiple of PhysicsEntity::GRAVITY
+        float bounce;       // Fraction of speed kept after hitting a tile
+        sf::Color color;
+        float duration;     // Seconds left to emit, or negative for forever
+    };
+
+    // Particles are plain data kept in one array per component, never
+    // entities. They're integrated and tested against the level's tiles
+    // (but nothing else) four at a time where SSE is available, and drawn
+    // as a single image the size of the view.
+    class ParticleSystem {
+        public:
+            // Must be a multiple of 4
+            const static int MAX_PARTICLES = 131072;
+            const static int MAX_EMITTERS = 64;
+
+            // Fraction of sideways speed kept when a particle lands
+            const static float FLOOR_FRICTION = 0.8f;
+
+            ParticleSystem(int capacity = MAX_PARTICLES);
+            ~ParticleSystem();
+
+            // Returns the emitter's ID, or -1 if there's no room for it
+            int AddEmitter(const pf::ParticleEmitter& emitter);
+            pf::ParticleEmitter *GetEmitter(int id);
+            void RemoveEmitter(int id);
+
+            // Returns false if the pool is full
+            bool Emit(float x, float y, float veloX, float veloY, float life, float gravity, float bounce, sf::Color color);
+
+            int GetCount();
+            int GetCapacity();
+
+            // tiles may be NULL for no collision
+            void Tick(float frametime, const pf::TileCell *tiles, int width, int height);
+            void Render(sf::RenderTarget& target);
+
+            // Simulates about the given number of particles in a made-up
+            // level, without a window, and logs how long each tick took
+            static void Benchmark(int particles, int ticks);
+
+        private:
+            void Spawn(float frametime);
+            void Step(float frametime, const pf::TileCell *tiles, int width, int height);
+            void Expire(int width, int height);
+
+            int capacity, count;
+
+            // Components, each capacity long and 16-byte aligned
+            float *storage;
+            float *x, *y, *veloX, *veloY;
+            float *age, *life, *gravity, *bounce;
+            std::vector<sf::Uint32> color;
+
+            std::vector<pf::ParticleEmitter> emitters;
+            std::vector<float> emitterCredit;
+            std::vector<bool> emitterUsed;
+
+            // One frame's worth of particles, drawn in one go
+            std::vector<sf::Uint8> canvasPixels;
+            sf::Image *canvas;
+            sf::Sprite *canvasSprite;
+    };
+}; // namespace pf
+
+#endif // PARTICLESYSTEM_H
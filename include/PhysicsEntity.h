@@ -24,6 +24,7 @@
 #include "Entity.h"
 #include "IRenderable.h"
 #include "World.h"
+#include "Fixed.h"
 #include <vector>
 
 namespace pf {
@@ -33,6 +34,11 @@ namespace pf {
         public:
             const static float GRAVITY = 9.8f * pf::World::TILE_SIZE;  // 9.8 m/s * pixels per tile
 
+            // How far past the first thing in its way a move may go. Moves
+            // are swept, then cut short this deep into whatever they hit so
+            // the collision handling sees it.
+            const static float CONTACT_DEPTH = 4.f;
+
             PhysicsEntity(pf::World *world);
             PhysicsEntity(pf::World *world, pf::Animation *image);
             PhysicsEntity(pf::World *world, float x, float y, int width, int height);
@@ -60,24 +66,29 @@ namespace pf {
             void SetPushable(bool pushable);
             bool CanUseStairs();
             void SetCanUseStairs(bool canUseStairs);
+            bool IsSleeping();
+            bool CanSleep();
+            void SetCanSleep(bool canSleep);
+
+            // Sleeping bodies are skipped by World::Tick until touched, pushed
+            // or moved, or until the tile under them goes
+            void Wake();
 
             bool HitTest(pf::Entity& entity);
             bool HitTest(float x, float y, float width, float height);
             bool HitTest(float x, float y);
 
-            bool AlreadyHit(pf::Entity *entity);
             void Push(float offsetX, float offsetY);
-        
-            virtual bool CanCollideWith(pf::Entity *entity) { return true; }
 
         protected:
             pf::Animation *image;
-            bool solid, gravity, pushable, canUseStairs;
-            float veloX, veloY;
             bool wasHittingVerticalSurface, wasHittingHorizontalSurface;
-            bool onGround, inLiquid;
-            std::vector<pf::Entity*> *hitEntities;
-            void Move(float offsetX, float offsetY);
+            void Move(pf::Scalar offsetX, pf::Scalar offsetY);
+            void SetOnGround(bool onGround);
+            void SetInLiquid(bool inLiquid);
+
+            // Notes how deep into a liquid hit the entity is
+            void Submerge(const pf::Hit& hit);
     };
 }; // namespace pf
 
@@ -0,0 +1,72 @@
+/*
+ * Raycaster.h
+ * Ray casts through a world's tiles and broadphase
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef RAYCASTER_H
+#define RAYCASTER_H
+
+#include "World.h"
+#include <vector>
+
+namespace pf {
+    class Bodies;
+    class IJob;
+    class JobPool;
+    class PhysicsEntity;
+
+    // Walks rays through a world's tiles, then through its broadphase's
+    // cells up to the first tile hit. Each pool thread casts with scratch of
+    // its own, so rays can be cast from a parallel tick or a batch.
+    class Raycaster {
+        public:
+            // Both belong to the world, and must outlive the raycaster
+            Raycaster(pf::World *world, pf::Bodies *bodies);
+            ~Raycaster();
+
+            // Makes room to cast from each of a pool's threads
+            void SetThreadCount(int threads);
+
+            // Returns false if the ray gets all the way. Rays that start
+            // inside something hit it at time zero. With anyHit, it stops at
+            // the first thing it finds rather than the nearest.
+            bool Cast(const pf::Ray& ray, bool anyHit, pf::SweepHit& result);
+
+            // Casts every ray, World::RAYS_PER_JOB to a job on the pool, or
+            // all of them here if pool is NULL. hits[i] is set for every ray,
+            // and results[i] (unless results is NULL) for those that hit.
+            void CastBatch(const pf::Ray *rays, int count, bool anyHit, pf::SweepHit *results, bool *hits, pf::JobPool *pool);
+
+        private:
+            class RayJob;
+
+            // The boxes near a ray are gathered into arrays, one per edge
+            struct Scratch {
+                std::vector<pf::PhysicsEntity*> found, entities;
+                std::vector<float> minX, minY, maxX, maxY;
+            };
+
+            pf::World *world;
+            pf::Bodies *bodies;
+            std::vector<Scratch> scratch;
+            std::vector<RayJob*> jobs;
+            std::vector<pf::IJob*> jobList;
+    };
+}; // namespace pf
+
+#endif // RAYCASTER_H
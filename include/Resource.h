@@ -23,6 +23,7 @@
 
 #include <map>
 #include <string>
+#include <ctime>
 
 namespace pf {
     class Resource;
@@ -34,6 +35,9 @@ namespace pf {
 
     class Resource {
     public:
+        // Nothing bigger is loaded, or taken from the network
+        static const int MAX_LENGTH = 16 * 1024 * 1024;
+
         Resource(char *filename, char *data, int length);
         ~Resource();
 
@@ -41,6 +45,14 @@ namespace pf {
         char *GetData();
         int GetLength();
 
+        // Whether the file this resource was loaded from has been modified
+        // since it was last read
+        bool HasChangedOnDisk();
+
+        // Replaces the contents, releasing the old ones. Takes ownership of
+        // data.
+        void SetData(char *data, int length);
+
 #ifdef PLATFORMER_SERVER
         static void SetServer(pf::Server *server);
 #endif
@@ -51,15 +63,26 @@ namespace pf {
         static Resource *GetResource(char *name);
         static Resource *GetOrLoadResource(char *name);
 
+        // Reads a file into a new buffer without creating a resource for it
+        static bool ReadFile(char *name, char *&data, int &length);
+
     private:
         static ResourceMap *resources;
 #ifdef PLATFORMER_SERVER
         static pf::Server *server;
 #endif
 
+        void UpdateFileStamp();
+
         char *filename;
+
+        // A private copy of the file as it was last read. It's what clients
+        // are sent and what changes are diffed against, so it's never a
+        // mapping, which would change if the file were rewritten in place.
         char *data;
         int length;
+        time_t fileModified;
+        long fileSize;
     };
 }; // namespace pf
 
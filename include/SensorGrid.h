@@ -0,0 +1,87 @@
+/*
+ * SensorGrid.h
+ * Boxes that note which entities overlap them
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SENSORGRID_H
+#define SENSORGRID_H
+
+#include "World.h"
+#include <vector>
+
+namespace pf {
+    class Bodies;
+    class EntitySlots;
+    class PhysicsEntity;
+    class SpatialHash;
+
+    // A world's sensors, kept in a grid of their own so each moving entity
+    // costs one lookup a tick. Overlaps of resting entities are carried over
+    // from the last update unless the sensor changed, and changed sensors
+    // look for resting entities in the world's broadphase. Coordinates are
+    // in pixels.
+    class SensorGrid {
+        public:
+            // Everything passed in belongs to the world, and must outlive
+            // the grid
+            SensorGrid(pf::EntitySlots *entities, pf::Bodies *bodies, pf::SpatialHash *broadphase);
+            ~SensorGrid();
+
+            // Sensors from the level are dropped by RemoveLevelSensors, for
+            // when it's about to be loaded again
+            int Add(float x, float y, int width, int height, int kind, pf::CollisionMask mask, bool fromLevel = false);
+            void Remove(int sensor);
+            void RemoveLevelSensors();
+            void SetBounds(int sensor, float x, float y, int width, int height);
+            int GetKind(int sensor);
+
+            // Finds what overlaps what now, and what changed since the last
+            // call. Run once a tick, once everything has moved.
+            void Update();
+
+            // As of the last update, sorted by sensor
+            const std::vector<pf::World::SensorOverlap>& GetOverlaps();
+            const std::vector<pf::SensorEvent>& GetEvents();
+
+        private:
+            struct Sensor {
+                float x, y;
+                int width, height;
+                int kind;
+                pf::CollisionMask mask;
+                bool used, fromLevel, changed;
+            };
+
+            bool OverlapsBody(int sensor, int body);
+            void MarkChanged(int sensor);
+
+            pf::EntitySlots *entities;
+            pf::Bodies *bodies;
+            pf::SpatialHash *broadphase;
+
+            // Sensors are indexed by their proxy in index
+            std::vector<Sensor> sensors;
+            pf::SpatialHash *index;
+            std::vector<int> changed, proxyScratch;
+            std::vector<pf::PhysicsEntity*> entityScratch;
+            std::vector<pf::World::SensorOverlap> overlaps, lastOverlaps;
+            std::vector<pf::SensorEvent> events;
+    };
+}; // namespace pf
+
+#endif // SENSORGRID_H
@@ -30,12 +30,16 @@ namespace pf {
     class World;
     class ClientInstance;
     class Resource;
+    class Elevator;
 
     typedef std::map<sf::SocketTCP, pf::ClientInstance*> ClientMap;
     typedef std::map<std::string, std::string> PropertyMap;
 
     class Server {
     public:
+        // Seconds between checks for resources modified on disk
+        const static float RESOURCE_CHECK_INTERVAL = 2.f;
+
         Server();
         ~Server();
 
@@ -44,7 +48,11 @@ namespace pf {
         void SendToAll(pf::Packet::BasePacket *packet, pf::ClientInstance *exclude);
         void RequireResource(pf::Resource *resource);
 
+        uint32_t GetTick();
+
     private:
+        void CheckResources();
+
         sf::SelectorTCP socketSelector;
         sf::SocketTCP *listenSocket;
         sf::IPAddress serverIP;
@@ -53,9 +61,11 @@ namespace pf {
         PropertyMap properties;
         ClientMap clientMap;
         std::vector<pf::Resource*> requiredResources;
+        std::vector<pf::Elevator*> movers;
 
         bool shouldQuit;
         pf::World *world;
+        uint32_t tick;
     };
 }; // namespace pf
 
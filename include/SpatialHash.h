@@ -0,0 +1,90 @@
+/*
+ * SpatialHash.h
+ * Uniform grid broadphase for entity collision queries
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SPATIALHASH_H
+#define SPATIALHASH_H
+
+#include <vector>
+
+namespace pf {
+    class PhysicsEntity;
+
+    // Buckets entities by the grid cells their bounds overlap, so collision
+    // queries only look at entities near the area being tested. Cells are
+    // hashed into a fixed number of buckets, so entities can go anywhere
+    // (including outside the level) without resizing anything.
+    class SpatialHash {
+        public:
+            // Pixel size of a grid cell; a couple of tiles so most entities
+            // only touch one to four cells
+            const static int CELL_SIZE = 32;
+
+            // Must be a power of two
+            const static int BUCKET_COUNT = 4096;
+
+            const static int ANY_TAG = -1;
+
+            // Matches no query that asks for a tag
+            const static int HIDDEN_TAG = -2;
+
+            SpatialHash();
+            ~SpatialHash();
+
+            // Returns a proxy ID that identifies the entity in later calls
+            int Insert(pf::PhysicsEntity *entity, float x, float y, float width, float height);
+            void Update(int proxy, float x, float y, float width, float height);
+            void Remove(int proxy);
+
+            // Appends each entity whose cells overlap the area, once. Callers
+            // still need to test the candidates' actual bounds. Queries only
+            // read the grid, so any number may run at once as long as nothing
+            // inserts, updates or removes.
+            void Query(float x, float y, float width, float height, std::vector<pf::PhysicsEntity*>& results);
+
+            // As above, but only entities whose tag matches
+            void Query(float x, float y, float width, float height, int tag, std::vector<pf::PhysicsEntity*>& results);
+
+            // As above, but appending proxy IDs, for grids of things that
+            // aren't entities
+            void QueryProxies(float x, float y, float width, float height, std::vector<int>& results);
+
+            // Proxies start out with ANY_TAG, which matches every query
+            void SetTag(int proxy, int tag);
+
+        private:
+            struct Proxy {
+                pf::PhysicsEntity *entity;
+                int minX, minY, maxX, maxY;
+                int tag;
+            };
+
+            static int CellCoord(float position);
+            static int Bucket(int cellX, int cellY);
+
+            void AddToCells(int proxy);
+            void RemoveFromCells(int proxy);
+
+            std::vector<Proxy> proxies;
+            std::vector<int> freeProxies;
+            std::vector< std::vector<int> > buckets;
+    };
+}; // namespace pf
+
+#endif // SPATIALHASH_H
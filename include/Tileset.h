@@ -22,6 +22,7 @@
 #define TILESET_H
 
 #include <SFML/Graphics.hpp>
+#include "World.h"
 
 namespace pf {
     namespace Tileset {
@@ -32,26 +33,66 @@ namespace pf {
             sf::Color levelColor;
             float alpha;
             bool liquid;
+            int shape;      // One of World's SHAPE_* values
+            pf::CollisionMask category;
 
-            Tile(char *name, bool solid, sf::IntRect coords, sf::Color levelColor, float alpha, bool liquid) {
+            Tile(char *name, bool solid, sf::IntRect coords, sf::Color levelColor, float alpha, bool liquid, int shape) {
                 this->name = name;
                 this->solid = solid;
                 this->coords = coords;
                 this->levelColor = levelColor;
                 this->alpha = alpha;
                 this->liquid = liquid;
+                this->shape = shape;
+                category = liquid ? pf::CATEGORY_LIQUID : solid ? pf::CATEGORY_LEVEL : 0;
             }
         };
 
         const static sf::Color Spawn = sf::Color::Red;
 
+        // Level image colors that lay out the path of an elevator. It starts
+        // at the mover pixel and follows the line of track pixels (one pixel
+        // wide) leading away from it, turning at each corner. A track that
+        // leads back to its mover loops, and any other goes back and forth.
+        const static sf::Color MoverStart = sf::Color(255, 128, 0);
+        const static sf::Color MoverTrack = sf::Color(128, 128, 128);
+
+        // Level image color that places a light of World::LIGHT_MAX
+        const static sf::Color LightSource = sf::Color(255, 255, 128);
+
+        // Level image colors that place a sensor rather than a tile. Runs of
+        // the same marker along a row become one sensor.
+        struct Marker {
+            char *name;
+            sf::Color levelColor;
+            int kind;
+
+            Marker(char *name, sf::Color levelColor, int kind) {
+                this->name = name;
+                this->levelColor = levelColor;
+                this->kind = kind;
+            }
+        };
+
+        const static Marker Markers[] = {
+            Marker("checkpoint", sf::Color(255, 255, 0), pf::World::SENSOR_CHECKPOINT),
+            Marker("kill_zone", sf::Color(128, 0, 0), pf::World::SENSOR_KILL_ZONE),
+            Marker("door", sf::Color(0, 255, 255), pf::World::SENSOR_DOOR)
+        };
+
+        const static int MarkerCount = sizeof(Markers) / sizeof(Marker);
+
         const static Tile Tiles[] = {
-            Tile("engraved", true, sf::IntRect(0, 0, 16, 16), sf::Color(0, 0, 0),  1.f, false),
-            Tile("dirt", true, sf::IntRect(16, 0, 32, 16), sf::Color(128, 64, 0), 1.f, false),
-            Tile("grass", true, sf::IntRect(32, 0, 48, 16), sf::Color(0, 255, 0), 1.f, false),
-            Tile("bg_redflower", false, sf::IntRect(48, 0, 64, 16), sf::Color(255, 0, 128), 1.f, false),
-            Tile("water", true, sf::IntRect(64, 0, 80, 16), sf::Color(0, 0, 255), 0.3f, true),
-            Tile("bg_wall1", false, sf::IntRect(80, 0, 96, 16), sf::Color(40, 50, 40), 1.f, false)
+            Tile("engraved", true, sf::IntRect(0, 0, 16, 16), sf::Color(0, 0, 0),  1.f, false, pf::World::SHAPE_FULL),
+            Tile("dirt", true, sf::IntRect(16, 0, 32, 16), sf::Color(128, 64, 0), 1.f, false, pf::World::SHAPE_FULL),
+            Tile("grass", true, sf::IntRect(32, 0, 48, 16), sf::Color(0, 255, 0), 1.f, false, pf::World::SHAPE_FULL),
+            Tile("bg_redflower", false, sf::IntRect(48, 0, 64, 16), sf::Color(255, 0, 128), 1.f, false, pf::World::SHAPE_FULL),
+            Tile("water", true, sf::IntRect(64, 0, 80, 16), sf::Color(0, 0, 255), 0.3f, true, pf::World::SHAPE_FULL),
+            Tile("bg_wall1", false, sf::IntRect(80, 0, 96, 16), sf::Color(40, 50, 40), 1.f, false, pf::World::SHAPE_FULL),
+            Tile("dirt_half", true, sf::IntRect(16, 0, 32, 16), sf::Color(96, 48, 0), 1.f, false, pf::World::SHAPE_HALF),
+            Tile("dirt_slope_up", true, sf::IntRect(16, 0, 32, 16), sf::Color(128, 64, 64), 1.f, false, pf::World::SHAPE_SLOPE_UP),
+            Tile("dirt_slope_down", true, sf::IntRect(16, 0, 32, 16), sf::Color(128, 64, 128), 1.f, false, pf::World::SHAPE_SLOPE_DOWN),
+            Tile("grass_ledge", true, sf::IntRect(32, 0, 48, 16), sf::Color(0, 128, 0), 1.f, false, pf::World::SHAPE_ONE_WAY)
         };
 
         const static int Count = sizeof(Tiles) / sizeof(Tile);
@@ -22,41 +22,372 @@
 #define WORLD_H
 
 #include "IRenderable.h"
+#include "Entity.h"
+#include "Fixed.h"
+#include <SFML/System.hpp>
+#include <stdint.h>
+#include <utility>
 #include <vector>
 
 namespace pf {
-    class Entity;
-    class Platform;
     class Resource;
     class Character;
+    class PhysicsEntity;
+    class SpatialHash;
+    class Bodies;
+    class IHitVisitor;
+    class IContactListener;
+    class IJob;
+    class EntitySlots;
+    class JobPool;
+    class ParticleSystem;
+    class LiquidGrid;
+    class LightGrid;
+    class SensorGrid;
+    class Raycaster;
 
-    typedef std::map<int, pf::Entity*> EntityMap;
+    // A level tile packed into two bytes. The low byte is the tile's index in
+    // Tileset::Tiles plus one (zero for empty space); the high byte holds the
+    // TILE_* flags copied from its Tileset entry.
+    typedef uint16_t TileCell;
+
+    // One result of a collision query. Level tiles have no entity.
+    struct Hit {
+        pf::PhysicsEntity *entity;
+        pf::TileCell tile;
+        float x, y;
+        int width, height;
+        bool liquid;
+    };
+
+    // A segment from (x, y) along an offset. Only tiles and entities in a
+    // category in mask stop it, and never skip.
+    struct Ray {
+        float x, y;
+        float offsetX, offsetY;
+        pf::CollisionMask mask;
+        pf::Entity *skip;
+    };
+
+    // An entity starting or stopping overlapping a sensor
+    struct SensorEvent {
+        int sensor;
+        pf::EntityHandle entity;
+        bool entered;
+    };
+
+    // An elevator's path from the level image, in pixels; see
+    // Tileset::MoverStart
+    struct LevelPath {
+        std::vector<float> x, y;
+        bool loop;
+    };
+
+    // Fill levels in one liquid chunk, as pairs of bytes: a tile's index in
+    // the chunk (row by row) and its level
+    struct LiquidDelta {
+        int chunkX, chunkY;
+        std::vector<uint8_t> cells;
+    };
+
+    // A run of count tiles, row by row from the tile index start, all set
+    // to the same entry of Tileset::Tiles (or -1 for empty space)
+    struct TileRun {
+        int start, count;
+        int index;
+    };
+
+    // Where a box moving along an offset first runs into something
+    struct SweepHit {
+        float time;             // Fraction of the offset covered before contact
+        float normalX, normalY; // Points out of the face that was hit
+        pf::Hit hit;
+    };
     
     class World : public pf::IRenderable {
         public:
             const static int TILE_SIZE = 16;
             const static int STEP_HEIGHT = 6;
 
+            // Size of the hit buffers the physics tick queries into
+            const static int MAX_QUERY_HITS = 64;
+
+            // Worlds with fewer entities than this tick on one thread
+            const static int PARALLEL_THRESHOLD = 256;
+
+            // Small islands are packed into jobs of about this many entities
+            const static int ENTITIES_PER_JOB = 64;
+
+            // With region simulation on, the level is split into squares
+            // this many tiles across. The regions around each anchor tick
+            // every tick, a margin of regions beyond those ticks every few
+            // ticks, and the rest are frozen.
+            const static int REGION_SIZE = 32;
+
+            // Longest step a region takes in one tick, and the most time a
+            // region remembers to catch up on
+            const static float MAX_REGION_STEP = 0.1f;
+            const static float MAX_CATCH_UP = 1.f;
+
+            // Built with PLATFORMER_FIXED_POINT, the world always steps by
+            // this much, taking at most MAX_FIXED_STEPS steps in one tick
+            const static float FIXED_STEP = 1.f / 60.f;
+            const static int MAX_FIXED_STEPS = 4;
+
+            // Liquid is stepped every LIQUID_STEP seconds (at most
+            // MAX_LIQUID_STEPS times a tick), in chunks LIQUID_CHUNK tiles
+            // across. Enough moving chunks are spread over the pool,
+            // LIQUID_CHUNKS_PER_JOB to a job.
+            const static int LIQUID_FULL = 255;
+            const static float LIQUID_STEP = 1.f / 30.f;
+            const static int MAX_LIQUID_STEPS = 2;
+            const static int LIQUID_CHUNK = 16;
+            const static int LIQUID_CHUNKS_PER_JOB = 8;
+
+            // Brightest light a tile can have. Light dims by one a tile.
+            const static int LIGHT_MAX = 15;
+
+            // Bounds on the contact solver's work per island per tick
+            const static int SOLVER_ITERATIONS = 8;
+            const static int MAX_SOLVER_CONTACTS = 256;
+
+            // Batches of rays shorter than two of these aren't worth spreading
+            // over the pool
+            const static int RAYS_PER_JOB = 256;
+
+            // Entities at most this far apart count as touching
+            const static float CONTACT_MARGIN = 0.5f;
+
+            enum {
+                TILE_INDEX = 0x00FF,
+                TILE_SOLID = 0x0100,
+                TILE_LIQUID = 0x0200,
+                TILE_SHAPE = 0x1C00     // The tile's SHAPE_*, shifted up
+            };
+            const static int TILE_SHAPE_SHIFT = 10;
+
+            // Tile shapes. Each is a profile of which rows of each column of
+            // pixels are solid, so the solid part under any span of columns
+            // can be read straight off a table. Everything but SHAPE_FULL is
+            // left out of horizontal sweeps and handled by Move instead, and
+            // one-way tiles only stop things landing on them from above.
+            enum {
+                SHAPE_FULL,
+                SHAPE_HALF,         // The bottom half
+                SHAPE_SLOPE_UP,     // Rising to the right
+                SHAPE_SLOPE_DOWN,
+                SHAPE_ONE_WAY,      // A ledge along the top
+                SHAPE_COUNT
+            };
+            const static int LEDGE_HEIGHT = 4;
+
+            enum { AXIS_X, AXIS_Y };
+
+            // Kinds of sensor the level image can place; see Tileset::Markers.
+            // Sensors added in code can be any kind.
+            enum {
+                SENSOR_CHECKPOINT = 1,
+                SENSOR_KILL_ZONE,
+                SENSOR_DOOR
+            };
+
+            // A sensor and an entity overlapping it
+            typedef std::pair<int, pf::EntityHandle> SensorOverlap;
+
             World(pf::Resource *levelImageResource, pf::Resource *tilesetResource);
             ~World();
 
             void Tick(float frametime);
             void Render(sf::RenderTarget& target);
             void RenderOverlays(sf::RenderTarget& target);
-            std::vector<pf::Entity*> HitsLevel(pf::Entity& entity);
-            std::vector<pf::Entity*> HitsLevel(float x, float y, float width, float height, pf::Entity *skip);
-            std::vector<pf::Entity*> HitsLevel(float x, float y, pf::Entity *skip);
-            std::vector<pf::Entity*> HitsPlatform(pf::Entity& entity);
-            std::vector<pf::Entity*> HitsPlatform(float x, float y, float width, float height);
-            std::vector<pf::Entity*> HitsPlatform(float x, float y);
+            std::vector<pf::Hit> HitsLevel(pf::Entity& entity);
+            std::vector<pf::Hit> HitsLevel(float x, float y, float width, float height, pf::Entity *skip);
+            std::vector<pf::Hit> HitsLevel(float x, float y, pf::Entity *skip);
+            std::vector<pf::Hit> HitsTiles(pf::Entity& entity);
+            std::vector<pf::Hit> HitsTiles(float x, float y, float width, float height);
+            std::vector<pf::Hit> HitsTiles(float x, float y);
 
+            // Allocation-free queries. The buffer variants return the number
+            // of hits stored (at most capacity); the visitor variants return
+            // true if the visitor stopped the query early. Queries that skip
+            // an entity only see what that entity's collision mask lets it
+            // collide with.
+            int HitsLevel(float x, float y, float width, float height, pf::Entity *skip, pf::Hit *buffer, int capacity);
+            int HitsTiles(float x, float y, float width, float height, pf::Hit *buffer, int capacity);
+            bool HitsLevelAny(float x, float y, float width, float height, pf::Entity *skip, bool ignoreLiquid);
+            bool VisitLevel(float x, float y, float width, float height, pf::Entity *skip, pf::IHitVisitor& visitor);
+            bool VisitTiles(float x, float y, float width, float height, pf::IHitVisitor& visitor, pf::CollisionMask mask = pf::CATEGORY_ALL);
+
+            // Sweeps a box along an offset, returning false if it gets all the
+            // way. Liquids, and anything the box already overlaps, don't stop
+            // it.
+            bool SweepLevel(float x, float y, float width, float height, float offsetX, float offsetY, pf::Entity *skip, pf::SweepHit& result);
+            bool SweepTiles(float x, float y, float width, float height, float offsetX, float offsetY, pf::SweepHit& result);
+
+            // Walks a ray through the tiles, then through the broadphase's
+            // cells up to the first tile it hit, returning false if it gets
+            // all the way. Rays that start inside something hit it at time
+            // zero. Line of sight only asks whether anything's in the way, so
+            // it stops at the first thing it finds.
+            bool Raycast(const pf::Ray& ray, pf::SweepHit& result);
+            bool HasLineOfSight(const pf::Ray& ray);
+
+            // Casts every ray in a batch, spread over the pool when there are
+            // enough. hits[i] (or blocked[i]) is set for every ray, and
+            // results[i] for the rays that hit something.
+            void RaycastBatch(const pf::Ray *rays, int count, pf::SweepHit *results, bool *hits);
+            void LineOfSightBatch(const pf::Ray *rays, int count, bool *blocked);
+
+            // Bodies don't push each other as they move. Each records the
+            // pushable bodies it ran into (pressing along axis, in direction
+            // dir) and how much further it meant to go, and the contact
+            // solver works it out once everyone has moved.
+            void AddContact(pf::PhysicsEntity *pusher, pf::PhysicsEntity *pushed, int axis, int dir);
+            void DeferAdvance(pf::PhysicsEntity *entity, int axis, float distance);
+
+            // While entities are ticking, adding and removing them (and
+            // destroying them) is queued and done once they've all finished.
+            // New entities can't be constructed during the tick at all,
+            // since that grows the body arrays under whoever is holding
+            // references into them; construct them beforehand and add them
+            // whenever.
             void AddEntity(pf::Entity *entity);
             bool RemoveEntity(pf::Entity& entity);
-            pf::Entity *GetEntity(int id);
-            EntityMap *getEntityMap();
+            void UpdateEntity(pf::Entity& entity);
+            void DestroyBody(int body);
+            bool IsTicking();
+
+            // Queues a push that would reach outside the island being ticked
+            // on this thread. Returns false if the push should happen now.
+            bool DeferPush(pf::PhysicsEntity *entity, float offsetX, float offsetY);
+
+            // Wakes a sleeping body, then anything asleep on top of it. During
+            // a parallel tick the bodies on top are woken at the sync point.
+            void WakeBody(int body);
+            void WakeArea(float x, float y, float width, float height);
+
+            // Which entities are touching is kept from tick to tick, and
+            // listeners are told what changed once each tick has finished,
+            // so they're free to add and remove entities. Only pairs where
+            // either entity can collide with the other are tracked.
+            void AddContactListener(pf::IContactListener *listener);
+            void RemoveContactListener(pf::IContactListener *listener);
+            bool IsTouching(pf::Entity *a, pf::Entity *b);
+
+            // Sensors are boxes that note which entities overlap them, but
+            // never stop or push anything (see SensorGrid). Only entities in
+            // a category in the sensor's mask are noticed. Don't add, move or
+            // remove them while a parallel tick is running.
+            int AddSensor(float x, float y, int width, int height, int kind, pf::CollisionMask mask = pf::CATEGORY_ALL);
+            void RemoveSensor(int sensor);
+            void SetSensorBounds(int sensor, float x, float y, int width, int height);
+            int GetSensorKind(int sensor);
+
+            // As of the end of the last tick, sorted by sensor
+            const std::vector<SensorOverlap>& GetSensorOverlaps();
+
+            // Everything that changed over the last tick, sorted by sensor.
+            // The sensor or entity of an exit may be gone by now.
+            const std::vector<pf::SensorEvent>& GetSensorEvents();
+
+            // Off by default, so everything ticks every tick
+            void SetRegionSimulation(bool enabled);
+            void SetRegionMargin(int regions, int interval);
+            void AddRegionAnchor(pf::Entity *entity);
+
+            // Seconds the world has ticked through, which elevators' paths
+            // are worked out from. Once a clock is set, each tick catches the
+            // time up to it instead, so copies of the world set from the
+            // same clock agree on it however their frames went. It's set
+            // again before every tick.
+            double GetTime();
+            void SetClock(double seconds);
+
+            // Paths laid out in the level image, for the server to put
+            // elevators on
+            const std::vector<pf::LevelPath>& GetLevelPaths();
+
+            pf::Bodies *GetBodies();
+            pf::ParticleSystem *GetParticles();     // NULL on the server
+            pf::Entity *GetEntity(pf::EntityHandle id);
+            pf::EntitySlots *GetEntities();
             void SpawnCharacter(pf::Character *character);
-            
-            void RemovePlatform(pf::Platform& platform);
+
+            // Tiles outside the level read as empty
+            pf::TileCell GetTile(int x, int y);
+            static int GetTileShape(pf::TileCell tile);
+
+            // Narrows a tile hit to the solid part of the tile under the
+            // given span of pixels, returning false if there isn't any
+            static bool ShapeSpan(pf::Hit& hit, float left, float right);
+
+            // Hits as queries report them, for a whole tile (x and y in
+            // tiles) or an entity
+            static pf::Hit TileHit(pf::TileCell tile, int x, int y);
+            static pf::Hit EntityHit(pf::PhysicsEntity *entity);
+
+            // Appends the entities in the broadphase around an area. During
+            // a parallel tick, it looks as far out as anything could have
+            // moved since the tick started, but only in the island being
+            // ticked on this thread.
+            void QueryBroadphase(float x, float y, float width, float height, std::vector<pf::PhysicsEntity*>& results);
+
+            // A tile from Tileset::Tiles, with its flags
+            static pf::TileCell MakeTile(int index);
+
+            // Tile edits change collision, liquid and light in place, and
+            // wake whatever was resting against the tiles. Liquid in an
+            // edited tile is lost, and tiles can't be set to liquid (that's
+            // what SetLiquid is for). index is into Tileset::Tiles, or -1 to
+            // clear the tile. Don't edit tiles while a parallel tick is
+            // running.
+            void SetTile(int x, int y, int index);
+            void RemoveTile(int x, int y);
+
+            // Removes every tile but liquid with its centre inside the
+            // circle, waking bodies and liquid once for the lot, and returns
+            // how many it removed
+            int RemoveTiles(float x, float y, float radius);
+
+            // Tiles edited since the last call, as runs. Tiles liquid has
+            // flowed into read as empty, since liquid is sent on its own.
+            void TakeTileEdits(std::vector<pf::TileRun>& runs);
+
+            // Every tile edited since the level was loaded, for bringing a
+            // new client up to date
+            void GetTileSnapshot(std::vector<pf::TileRun>& runs);
+
+            // Every empty tile can hold liquid, up to LIQUID_FULL. Liquid
+            // falls into the tile below, and once it can't, evens out with
+            // the tiles either side. Only chunks where liquid moved last step
+            // (and the chunks around them) are stepped, so liquid at rest
+            // costs nothing. Clients turn the simulation off and are sent
+            // the server's liquid instead. Don't set liquid while a parallel
+            // tick is running.
+            int GetLiquid(int x, int y);
+            void SetLiquid(int x, int y, int level);
+            void SetLiquidSimulation(bool enabled);
+
+            // Tiles whose liquid has changed since the last call, a chunk at
+            // a time
+            void TakeLiquidDeltas(std::vector<pf::LiquidDelta>& deltas);
+
+            // Every tile of every chunk whose liquid has changed since the
+            // level was loaded, for bringing a new client up to date
+            void GetLiquidSnapshot(std::vector<pf::LiquidDelta>& deltas);
+
+            // Light spreads from lights and the open sky through every tile
+            // but full solid ones, dimming as it goes, and lights the faces
+            // of the solid tiles it reaches. Only the area around tiles and
+            // lights that changed is relit, at the end of each tick, and
+            // tiles are drawn tinted by their light.
+            int AddLight(float x, float y, int level);
+            void SetLightPosition(int light, float x, float y);
+            void RemoveLight(int light);
+            int GetLight(int x, int y);
+
+            // Rebuilds whatever was made from a resource that has changed
+            void ReloadResource(pf::Resource *resource);
         
             int GetPixelWidth();
             int GetPixelHeight();
@@ -66,11 +397,159 @@ namespace pf {
             float GetSpawnY();
 
         private:
+            class IslandJob;
+
+            struct Contact {
+                int a, b;       // a presses into b
+                int axis, dir;
+                int island;
+
+                bool operator==(const Contact& other) const {
+                    return a == other.a && b == other.b && axis == other.axis && dir == other.dir;
+                }
+                bool operator<(const Contact& other) const {
+                    if (island != other.island) return island < other.island;
+                    if (a != other.a) return a < other.a;
+                    return b < other.b;
+                }
+            };
+
+            struct Advance {
+                int body, axis;
+                float distance;
+                int island;
+
+                bool operator<(const Advance& other) const {
+                    if (island != other.island) return island < other.island;
+                    return body < other.body;
+                }
+            };
+
+            struct Command {
+                enum { ADD, REMOVE, DESTROY, PUSH, WAKE } type;
+                pf::Entity *entity;
+                pf::EntityHandle id;
+                int body, proxy;
+                float offsetX, offsetY;
+            };
+
+            void LoadLevel();
+            void UnloadLevel();
+            void DrawTile(sf::RenderTarget& target, int x, int y, pf::TileCell tile);
+            bool EditTile(int x, int y, pf::TileCell tile);
+            void CrumbleTile(int x, int y, int pieces);
+            void GetTileRuns(std::vector<int>& edited, std::vector<pf::TileRun>& runs);
+
+            void StartPool();
+            void CastRays(const pf::Ray *rays, int count, bool anyHit, pf::SweepHit *results, bool *hits);
+            void BuildIslands();
+            int FindIsland(int body);
+            void Step(float frametime);
+            void TickEntities(int begin, int end);
+            void AssignSteps(float frametime);
+            void QueueCommand(const Command& command);
+            void SolveContacts();
+            bool RelaxContact(const Contact& contact);
+            void FindContacts(int body, int pusher, int axis, int dir);
+            void UpdateTouching();
+            void DispatchContacts();
+            void AddLevelSensors(const sf::Image& levelImage);
+            void AddLevelPaths(const sf::Image& levelImage);
+            void UpdateMovers(float frametime);
+            void CarryRiders(int body, pf::Scalar offsetX, pf::Scalar offsetY);
+            void ApplyCommands();
+            void StepLiquid(float frametime);
+            void AddLevelLights(const sf::Image& levelImage);
+
             float spawnX, spawnY;
             int width, height;
-            sf::Image *levelImage;
-            pf::Platform **platforms;
-            EntityMap *entityMap;
+            pf::Resource *levelImageResource;
+            pf::Resource *tilesetResource;
+            pf::TileCell *tiles;
+
+            // Render data: one sprite per Tileset entry, positioned as each
+            // tile is drawn
+            sf::Image *tileset;
+            sf::Sprite *tileSprites;
+
+            pf::EntitySlots *entities;
+            pf::Bodies *bodies;
+            pf::SpatialHash *broadphase;
+            pf::ParticleSystem *particles;
+
+            // Scratch stacks for queries, one per pool thread
+            std::vector< std::vector<pf::PhysicsEntity*> > queryScratch;
+
+            // Tick state. Entities are grouped into islands that can't touch
+            // each other this tick; tickOrder lists their bodies island by
+            // island, and each job ticks a run of it.
+            bool ticking, parallel;
+            float tickMargin;
+            int processorCount;
+            pf::JobPool *pool;
+            std::vector<int> bodyIsland;
+            std::vector<int> threadIsland;
+            std::vector<int> tickOrder;
+            std::vector<IslandJob*> islandJobs;
+            std::vector<pf::IJob*> jobList;
+            std::vector<Command> commands;
+            sf::Mutex commandLock;
+
+            pf::Raycaster *raycaster;
+
+            // Contact solver. Contacts and advances are collected per pool
+            // thread, then solved island by island at the end of the tick.
+            std::vector< std::vector<Contact> > threadContacts;
+            std::vector< std::vector<Advance> > threadAdvances;
+            std::vector<Contact> contacts, islandContacts;
+            std::vector<Advance> advances;
+            std::vector<uint8_t> solverFlags;
+            std::vector<int> solverTouched;
+
+            // Contact cache, sorted. Pairs of bodies that are both asleep or
+            // frozen are carried over without being queried again.
+            typedef std::pair<pf::EntityHandle, pf::EntityHandle> TouchingPair;
+            std::vector<TouchingPair> touching, lastTouching;
+            std::vector<pf::IContactListener*> contactListeners;
+
+            pf::SensorGrid *sensors;
+
+            // Elevators, and what's standing on what (as support, rider)
+            // for carrying riders along with them
+            double time, clock;
+            bool clocked;
+            float stepCredit;       // Seconds not yet stepped in fixed-step mode
+            std::vector<pf::EntityHandle> movers;
+            std::vector< std::pair<int, int> > riders;
+            std::vector<int> carryStack;
+            std::vector<pf::LevelPath> levelPaths;
+
+            // Liquid, and the chunks where it filled or emptied tiles this
+            // tick, so whatever's asleep there notices
+            pf::LiquidGrid *liquid;
+            std::vector<int> flippedChunks;
+
+            // Lighting, in tiles
+            pf::LightGrid *lighting;
+
+            // Tile edits, flagged per tile so each is listed once
+            enum {
+                EDIT_UNSENT = 0x01,     // In unsentTiles
+                EDIT_TOUCHED = 0x02     // In touchedTiles
+            };
+            std::vector<uint8_t> tileEdits;
+            std::vector<int> unsentTiles, touchedTiles;
+
+            // Region simulation. regionTime is the time each region has
+            // banked, regionStep what it's advancing by this tick.
+            enum { REGION_FROZEN, REGION_MARGIN, REGION_ACTIVE };
+            bool regionSimulation;
+            int regionMargin, marginInterval;
+            int regionsX, regionsY;
+            unsigned int tickCount;
+            std::vector<uint8_t> regionLevel;
+            std::vector<float> regionTime, regionStep;
+            std::vector<pf::EntityHandle> anchors;
     };
 }; // namespace pf
 
@@ -19,7 +19,11 @@
 
 #include <SFML/Graphics.hpp>
 #include "Game.h"
+#include "Latency.h"
+#include "ParticleSystem.h"
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 using namespace std;
 
@@ -39,7 +43,13 @@ bool loop();
 void cleanup();
 void handleEvent(sf::Event *event);
 
-int main() {
+int main(int argc, char *argv[]) {
+    // Headless: --particle-benchmark [particles]
+    if (argc > 1 && !strcmp(argv[1], "--particle-benchmark")) {
+        pf::ParticleSystem::Benchmark(argc > 2 ? atoi(argv[2]) : 100000, 600);
+        return EXIT_SUCCESS;
+    }
+
     if (init())
         while(loop());
     cleanup();
@@ -70,15 +80,21 @@ bool init() {
 
 bool loop() {
     float frameTime = window.GetFrameTime();
-    if (frameTime > 0.15f) frameTime = 0.f;
+    // Collision is swept, so long frames are safe; just don't let a stall
+    // fast-forward the game
+    if (frameTime > 0.25f) frameTime = 0.25f;
     if (game->Tick(*input, frameTime))
         return false;
     
     game->Render(window, window.GetWidth(), window.GetHeight());
 
-    // Update FPS
-    char fpsText[16];
-    sprintf(fpsText, "FPS: %d", (int)(1.f / frameTime));
+    // Update FPS and latency
+    char fpsText[64];
+    pf::Latency *latency = game->GetLatency();
+    if (latency && latency->HasSamples())
+        sprintf(fpsText, "FPS: %d\nPing: %d ms (+/- %d)", (int)(1.f / frameTime), (int)latency->GetRTT(), (int)latency->GetJitter());
+    else
+        sprintf(fpsText, "FPS: %d", (int)(1.f / frameTime));
     FPStext.SetText(fpsText);
     window.SetView(HUDview);
     if (showingFPS) window.Draw(FPStext);
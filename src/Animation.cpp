@@ -49,6 +49,15 @@ void pf::Animation::Tick(float frametime) {
     }
 }
 
+void pf::Animation::UpdateFrameSize() {
+    const sf::Image *image = GetImage();
+    if (!image) return;
+
+    frameWidth = image->GetWidth() / frames;
+    frameHeight = image->GetHeight();
+    UpdateRect();
+}
+
 void pf::Animation::UpdateRect() {
     this->SetSubRect(sf::IntRect(frameWidth * (int)currentFrame,
                                  0,
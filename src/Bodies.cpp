@@ -0,0 +1,189 @@
+/*
+ * Bodies.cpp
+ * Struct-of-arrays storage for entity position, size, velocity and flags
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "Bodies.h"
+#include <cstddef>
+
+pf::Bodies::Bodies() {
+
+}
+
+pf::Bodies::~Bodies() {
+
+}
+
+int pf::Bodies::Create(pf::Entity *owner) {
+    int body;
+    if (freeBodies.empty()) {
+        body = x.size();
+        x.push_back(0.f);
+        y.push_back(0.f);
+        veloX.push_back(0.f);
+        veloY.push_back(0.f);
+        width.push_back(0);
+        height.push_back(0);
+        flags.push_back(0);
+        category.push_back(pf::CATEGORY_OBJECT);
+        mask.push_back(pf::CATEGORY_ALL);
+        restTime.push_back(0.f);
+        step.push_back(0.f);
+        submerged.push_back(0.f);
+        support.push_back(-1);
+        this->owner.push_back(owner);
+    } else {
+        body = freeBodies.back();
+        freeBodies.pop_back();
+        x[body] = y[body] = 0.f;
+        veloX[body] = veloY[body] = 0.f;
+        width[body] = height[body] = 0;
+        flags[body] = 0;
+        category[body] = pf::CATEGORY_OBJECT;
+        mask[body] = pf::CATEGORY_ALL;
+        restTime[body] = 0.f;
+        step[body] = 0.f;
+        submerged[body] = 0.f;
+        support[body] = -1;
+        this->owner[body] = owner;
+    }
+
+    return body;
+}
+
+void pf::Bodies::Destroy(int body) {
+    if (body < 0 || body >= GetCount() || !owner[body]) return;
+
+    flags[body] = 0;
+    owner[body] = NULL;
+    freeBodies.push_back(body);
+}
+
+int pf::Bodies::GetCount() {
+    return x.size();
+}
+
+bool pf::Bodies::HasFlag(int body, uint16_t flag) {
+    return (flags[body] & flag) != 0;
+}
+
+bool pf::Bodies::IsResting(int body) {
+    return (flags[body] & SLEEPING) || step[body] == 0.f;
+}
+
+void pf::Bodies::SetFlag(int body, uint16_t flag, bool set) {
+    if (set)
+        flags[body] |= flag;
+    else
+        flags[body] &= ~flag;
+}
+
+void pf::Bodies::ApplyForces(pf::Scalar gravity) {
+    const pf::Scalar terminalLiquidX = 5.0f;
+    const pf::Scalar terminalLiquidY = 5.0f;
+    const pf::Scalar zero = 0.f, one = 1.f, friction = 0.95f, drag = 0.8f;
+
+    int count = GetCount();
+    if (!count) return;
+    const uint16_t *f = &flags[0];
+    const pf::Scalar *dt = &step[0], *sub = &submerged[0];
+    pf::Scalar *vx = &veloX[0], *vy = &veloY[0];
+
+    for (int i = 0; i < count; i++) {
+        uint16_t bits = f[i];
+        if ((bits & (ACTIVE | SLEEPING)) != ACTIVE || dt[i] == zero) continue;
+
+        // Gravity
+        if ((bits & (GRAVITY | ON_GROUND)) == GRAVITY)
+            vy[i] += gravity * dt[i];
+
+        // Bottom surface friction
+        if ((bits & (SOLID | ON_GROUND)) == (SOLID | ON_GROUND))
+            vx[i] *= friction;
+
+        // Liquid resistance, the more of the body's in it the stronger
+        if (bits & IN_LIQUID) {
+            pf::Scalar keep = one - (one - drag) * sub[i];
+            if (vx[i] > terminalLiquidX || vx[i] < -terminalLiquidX) vx[i] *= keep;
+            if (vy[i] > terminalLiquidY || vy[i] < -terminalLiquidY) vy[i] *= keep;
+        }
+    }
+}
+
+void pf::Bodies::IntegrateNonSolid() {
+    int count = GetCount();
+    if (!count) return;
+    uint16_t *f = &flags[0];
+    pf::Scalar *px = &x[0], *py = &y[0];
+    const pf::Scalar *vx = &veloX[0], *vy = &veloY[0], *dt = &step[0];
+    const pf::Scalar zero = 0.f;
+
+    // Solid bodies collide as they move, so World::Tick moves them one at a
+    // time; everything else just drifts
+    for (int i = 0; i < count; i++) {
+        if ((f[i] & (ACTIVE | SOLID)) != ACTIVE) continue;
+
+        if (dt[i] == zero) continue;
+
+        px[i] += vx[i] * dt[i];
+        py[i] += vy[i] * dt[i];
+        f[i] &= ~IN_LIQUID;
+    }
+}
+
+void pf::Bodies::ClipVelocities() {
+    int count = GetCount();
+    if (!count) return;
+    pf::Scalar *vx = &veloX[0], *vy = &veloY[0];
+    const pf::Scalar zero = 0.f, near = 0.001f;
+
+    // Clip velocity to zero if it's very near
+    for (int i = 0; i < count; i++) {
+        if (vx[i] > -near && vx[i] < near) vx[i] = zero;
+        if (vy[i] > -near && vy[i] < near) vy[i] = zero;
+    }
+}
+
+void pf::Bodies::UpdateSleep() {
+    const uint16_t resting = ACTIVE | SOLID | CAN_SLEEP | ON_GROUND;
+    const pf::Scalar sleepLimit = SLEEP_SPEED, sleepSpeed = SLEEP_SPEED * SLEEP_SPEED, sleepDelay = SLEEP_DELAY, zero = 0.f;
+
+    int count = GetCount();
+    if (!count) return;
+    uint16_t *f = &flags[0];
+    pf::Scalar *vx = &veloX[0], *vy = &veloY[0], *rest = &restTime[0];
+    const pf::Scalar *dt = &step[0];
+
+    // Put bodies to sleep once they've sat on the ground for long enough
+    for (int i = 0; i < count; i++) {
+        // Checking each axis first keeps fast bodies from overflowing a
+        // fixed-point square
+        if ((f[i] & (resting | IN_LIQUID | SLEEPING)) != resting ||
+            pf::Abs(vx[i]) > sleepLimit || pf::Abs(vy[i]) > sleepLimit ||
+            vx[i] * vx[i] + vy[i] * vy[i] > sleepSpeed) {
+            rest[i] = zero;
+            continue;
+        }
+
+        rest[i] += dt[i];
+        if (rest[i] >= sleepDelay) {
+            f[i] |= SLEEPING;
+            vx[i] = vy[i] = zero;
+        }
+    }
+}
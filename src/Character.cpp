@@ -52,8 +52,7 @@ pf::Character::Character(pf::World *world, pf::CharacterSkin *skin, const char *
     image = new pf::Animation(*spriteSheet, skin->GetFrames(), framerate);
     image->Pause();
 
-    width = image->GetWidth();
-    height = image->GetHeight();
+    SetSize(image->GetWidth(), image->GetHeight());
 
 #ifdef PLATFORMER_CLIENT
     if (nameFont == NULL) {
@@ -109,11 +108,19 @@ pf::Character::Character(pf::World *world, pf::CharacterSkin *skin, const char *
     //ShowHealth();
     HideHealth();
 
+    // Characters walk through each other
+    type |= TYPE_CHARACTER;
+    SetCollisionCategory(pf::CATEGORY_CHARACTER);
+    SetCollisionMask(pf::CATEGORY_ALL & ~pf::CATEGORY_CHARACTER);
+
     SetPushable(true);
     SetGravityEnabled(false);
     SetSolid(true);
     SetIsolateAnimation(true);
     SetCanUseStairs(true);
+
+    // Characters are driven from outside the physics tick
+    SetCanSleep(false);
     health = 100;
 
 #ifdef PLATFORMER_SERVER
@@ -128,7 +135,7 @@ pf::Character::~Character()  {
 void pf::Character::Tick(float frametime) {
     // Set horizontal speed
     //speed = inLiquid ? SWIM_SPEED : WALK_SPEED; // Why doesn't this work?
-    if (inLiquid)
+    if (IsInLiquid())
         speed = SWIM_SPEED;
     else
         speed = WALK_SPEED;
@@ -148,7 +155,7 @@ void pf::Character::Render(sf::RenderTarget& target) {
 
 void pf::Character::RenderOverlays(sf::RenderTarget& target) {
     if (showName) {
-        name->SetPosition(x + (width / 2) - (name->GetRect().GetWidth() / 2), y - name->GetRect().GetHeight() - 2);
+        name->SetPosition(GetX() + (GetWidth() / 2) - (name->GetRect().GetWidth() / 2), GetY() - name->GetRect().GetHeight() - 2);
 
         nameBackground->SetPosition(name->GetPosition());
         nameBackground->Move(0.f, 1.5f);
@@ -252,13 +259,15 @@ pf::Animation *pf::Character::GetImage() {
     return image;
 }
 
-bool pf::Character::CanCollideWith(pf::Entity *entity) {
-    pf::Character *character = dynamic_cast<pf::Character*>(entity);
-
-    if (character)
-        return false;
+void pf::Character::ReloadSkin() {
+    // The animation keeps pointing at spriteSheet, so reload it in place
+    pf::Resource *spriteResource = skin->GetResource();
+    spriteSheet->LoadFromMemory(spriteResource->GetData(), spriteResource->GetLength());
+    spriteSheet->SetSmooth(false);
+    spriteSheet->CreateMaskFromColor(sf::Color::Magenta);
 
-    return true;
+    image->UpdateFrameSize();
+    SetSize(image->GetWidth(), image->GetHeight());
 }
 
 void pf::Character::SetIsolateAnimation(bool isolateAnimation) {
@@ -30,11 +30,7 @@ pf::CharacterSkin::CharacterSkin(char *name, pf::Resource *skin, int framerate,
     this->framerate = framerate;
     this->frames = frames;
     
-    sf::Image *tempImage = new sf::Image();
-    tempImage->LoadFromMemory(skin->GetData(), skin->GetLength());
-    width = tempImage->GetWidth() / frames;
-    height = tempImage->GetHeight();
-    delete tempImage;
+    Reload();
     
     characterSkins->insert(std::pair<std::string, pf::CharacterSkin*>(std::string(name), this));
 }
@@ -44,6 +40,14 @@ pf::CharacterSkin::~CharacterSkin() {
     characterSkins->erase(name);
 }
 
+void pf::CharacterSkin::Reload() {
+    sf::Image *tempImage = new sf::Image();
+    tempImage->LoadFromMemory(skin->GetData(), skin->GetLength());
+    width = tempImage->GetWidth() / frames;
+    height = tempImage->GetHeight();
+    delete tempImage;
+}
+
 char *pf::CharacterSkin::GetName() {
     return name;
 }
@@ -24,6 +24,7 @@
 #include "Server.h"
 #include "Resource.h"
 #include "Character.h"
+#include "Latency.h"
 
 pf::ClientInstance::ClientInstance(pf::Server *server, sf::SocketTCP *socket, sf::IPAddress *clientIP) {
     this->server = server;
@@ -35,6 +36,7 @@ pf::ClientInstance::ClientInstance(pf::Server *server, sf::SocketTCP *socket, sf
     wasKicked = false;
     character = NULL;
     resourceCount = 0;
+    latency = new pf::Latency();
 }
 
 pf::ClientInstance::~ClientInstance() {
@@ -44,6 +46,7 @@ pf::ClientInstance::~ClientInstance() {
     }
     delete [] username;
     delete character;
+    delete latency;
 }
 
 sf::SocketTCP *pf::ClientInstance::GetSocket() {
@@ -119,6 +122,10 @@ pf::Character *pf::ClientInstance::GetCharacter() {
     return character;
 }
 
+pf::Latency *pf::ClientInstance::GetLatency() {
+    return latency;
+}
+
 bool pf::ClientInstance::IsLoading() {
     return loading;
 }
@@ -0,0 +1,196 @@
+/*
+ * Delta.cpp
+ * Block-level binary deltas between two versions of a resource
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "Delta.h"
+#include "Resource.h"
+#include <algorithm>
+#include <cstring>
+
+typedef std::pair<uint32_t, uint32_t> BlockEntry; // (weak hash, offset in base)
+
+// Candidates with the same weak hash that are compared before giving up, so
+// that files full of identical blocks (e.g. empty map areas) stay linear
+static const int MAX_CANDIDATES = 8;
+
+static void WriteUint32(std::vector<char>& out, uint32_t value) {
+    char bytes[sizeof(value)];
+    memcpy(bytes, &value, sizeof(value));
+    out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+static bool ReadUint32(const char *&in, const char *end, uint32_t& value) {
+    if (end - in < (int)sizeof(value)) return false;
+    memcpy(&value, in, sizeof(value));
+    in += sizeof(value);
+    return true;
+}
+
+static void WriteInsert(std::vector<char>& patch, const char *data, uint32_t length) {
+    if (!length) return;
+    patch.push_back(pf::Delta::OP_INSERT);
+    WriteUint32(patch, length);
+    patch.insert(patch.end(), data, data + length);
+}
+
+static void WriteCopy(std::vector<char>& patch, uint32_t offset, uint32_t length) {
+    patch.push_back(pf::Delta::OP_COPY);
+    WriteUint32(patch, offset);
+    WriteUint32(patch, length);
+}
+
+uint32_t pf::Delta::Checksum(const char *data, uint32_t length) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    uint32_t a = 1, b = 0;
+
+    while (length) {
+        // Largest run that can't overflow b before it's reduced
+        uint32_t run = length < 5552 ? length : 5552;
+        length -= run;
+        while (run--) {
+            a += *bytes++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+
+    return (b << 16) | a;
+}
+
+void pf::Delta::Compute(const char *base, uint32_t baseLength,
+                        const char *target, uint32_t targetLength,
+                        std::vector<char>& patch) {
+    const unsigned char *in = (const unsigned char *)target;
+    uint32_t literalStart = 0, pos = 0;
+
+    if (baseLength >= (uint32_t)BLOCK_SIZE && targetLength >= (uint32_t)BLOCK_SIZE) {
+        // Index every aligned block of the old version by its weak hash
+        std::vector<BlockEntry> blocks;
+        blocks.reserve(baseLength / BLOCK_SIZE);
+        for (uint32_t offset = 0; offset + BLOCK_SIZE <= baseLength; offset += BLOCK_SIZE) {
+            const unsigned char *block = (const unsigned char *)base + offset;
+            uint32_t a = 0, b = 0;
+            for (int i = 0; i < BLOCK_SIZE; i++) {
+                a += block[i];
+                b += (BLOCK_SIZE - i) * block[i];
+            }
+            blocks.push_back(BlockEntry((a & 0xffff) | (b << 16), offset));
+        }
+        std::sort(blocks.begin(), blocks.end());
+
+        // Slide a window over the new version, rolling the hash one byte at a
+        // time until it lines up with a block of the old one
+        uint32_t a = 0, b = 0;
+        bool hashValid = false;
+        while (pos + BLOCK_SIZE <= targetLength) {
+            if (!hashValid) {
+                a = b = 0;
+                for (int i = 0; i < BLOCK_SIZE; i++) {
+                    a += in[pos + i];
+                    b += (BLOCK_SIZE - i) * in[pos + i];
+                }
+                hashValid = true;
+            }
+
+            uint32_t hash = (a & 0xffff) | (b << 16);
+            uint32_t matchOffset = 0, matchLength = 0;
+            std::vector<BlockEntry>::iterator it = std::lower_bound(blocks.begin(), blocks.end(), BlockEntry(hash, 0));
+            for (int tries = 0; it != blocks.end() && it->first == hash && tries < MAX_CANDIDATES; it++, tries++) {
+                uint32_t offset = it->second;
+                if (memcmp(base + offset, target + pos, BLOCK_SIZE)) continue;
+
+                // Extend the match as far forward as both versions agree
+                uint32_t length = BLOCK_SIZE;
+                while (offset + length < baseLength && pos + length < targetLength &&
+                       base[offset + length] == target[pos + length])
+                    length++;
+
+                if (length > matchLength) {
+                    matchOffset = offset;
+                    matchLength = length;
+                }
+            }
+
+            if (matchLength) {
+                // Pull bytes back out of the pending literal run if they match too
+                while (pos > literalStart && matchOffset > 0 && base[matchOffset - 1] == target[pos - 1]) {
+                    pos--;
+                    matchOffset--;
+                    matchLength++;
+                }
+
+                WriteInsert(patch, target + literalStart, pos - literalStart);
+                WriteCopy(patch, matchOffset, matchLength);
+                pos += matchLength;
+                literalStart = pos;
+                hashValid = false;
+                continue;
+            }
+
+            if (pos + BLOCK_SIZE < targetLength) {
+                a = a - in[pos] + in[pos + BLOCK_SIZE];
+                b = b - BLOCK_SIZE * in[pos] + a;
+            }
+            pos++;
+        }
+    }
+
+    WriteInsert(patch, target + literalStart, targetLength - literalStart);
+}
+
+char *pf::Delta::Apply(const char *base, uint32_t baseLength,
+                       const char *patch, uint32_t patchLength,
+                       uint32_t targetLength) {
+    if (targetLength > (uint32_t)pf::Resource::MAX_LENGTH)
+        return NULL;
+
+    char *target = new char[targetLength];
+    uint32_t written = 0;
+    const char *in = patch, *end = patch + patchLength;
+
+    while (in < end) {
+        char operation = *in++;
+        uint32_t offset, length;
+
+        if (operation == OP_COPY) {
+            if (!ReadUint32(in, end, offset) || !ReadUint32(in, end, length)) break;
+            if (offset > baseLength || length > baseLength - offset) break;
+            if (length > targetLength - written) break;
+            memcpy(target + written, base + offset, length);
+        } else if (operation == OP_INSERT) {
+            if (!ReadUint32(in, end, length)) break;
+            if (length > (uint32_t)(end - in)) break;
+            if (length > targetLength - written) break;
+            memcpy(target + written, in, length);
+            in += length;
+        } else {
+            break;
+        }
+
+        written += length;
+    }
+
+    if (in != end || written != targetLength) {
+        delete [] target;
+        return NULL;
+    }
+
+    return target;
+}
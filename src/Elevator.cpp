@@ -1,6 +1,6 @@
 /*
  * Elevator.cpp
- * A PhysicsEntity that moves up and down until it hits something
+ * A kinematic platform that follows a path of waypoints
  * Copyright (c) 2010-2011 Drew Gottlieb
  *
  * This program is free software: you can redistribute it and/or modify
@@ -19,28 +19,158 @@
  */
 
 #include "Elevator.h"
+#include "Animation.h"
+#include "Resource.h"
+#include "Bodies.h"
+#include <algorithm>
+#include <cmath>
 
 pf::Elevator::Elevator(pf::World *world, pf::Animation *image, float x, float y)
 : pf::PhysicsEntity(world, image, x, y) {
-    speed = 50;
-    direction = 1;
-    
-    SetGravityEnabled(false);
-    SetPushable(false);
+    imageResource = NULL;
+    Init();
+}
+
+pf::Elevator::Elevator(pf::World *world, pf::Resource *image, float x, float y)
+: pf::PhysicsEntity(world, LoadAnimation(image), x, y) {
+    imageResource = image;
+    Init();
 }
 
 pf::Elevator::~Elevator() {
     
 }
 
+pf::Animation *pf::Elevator::LoadAnimation(pf::Resource *image) {
+    sf::Image *sheet = new sf::Image();
+    sheet->LoadFromMemory(image->GetData(), image->GetLength());
+    sheet->SetSmooth(false);
+    return new pf::Animation(*sheet, 1, 10);
+}
+
+void pf::Elevator::Init() {
+    speed = DEFAULT_SPEED;
+    start = 0.0;
+    mode = PATH_PING_PONG;
+    
+    type |= TYPE_PLATFORM;
+    SetCollisionCategory(pf::CATEGORY_PLATFORM);
+    SetGravityEnabled(false);
+    SetPushable(false);
+    bodies->SetFlag(body, pf::Bodies::CAN_SLEEP, false);
+    bodies->SetFlag(body, pf::Bodies::KINEMATIC, true);
+
+    AddWaypoint(GetX(), GetY());
+}
+
 void pf::Elevator::Tick(float frametime) {
-    //if (world->HitsLevel(*this).size() > 0) {
-    if (GetVelocityY() == 0) {
-        direction *= -1;
-        SetVelocityY(direction * speed);
-        //pf::PhysicsEntity::Move(GetVelocityX(), GetVelocityY());
+    // World::Tick has already moved it
+    if (image) image->Tick(frametime);
+}
+
+void pf::Elevator::AddWaypoint(float x, float y) {
+    waypointX.push_back(x);
+    waypointY.push_back(y);
+    BuildPath();
+}
+
+void pf::Elevator::ClearWaypoints() {
+    waypointX.clear();
+    waypointY.clear();
+    BuildPath();
+}
+
+int pf::Elevator::GetWaypointCount() {
+    return waypointX.size();
+}
+
+float pf::Elevator::GetWaypointX(int waypoint) {
+    return waypointX[waypoint];
+}
+
+float pf::Elevator::GetWaypointY(int waypoint) {
+    return waypointY[waypoint];
+}
+
+void pf::Elevator::SetSpeed(float speed) {
+    this->speed = speed;
+}
+
+float pf::Elevator::GetSpeed() {
+    return speed;
+}
+
+void pf::Elevator::SetPathMode(int mode) {
+    this->mode = mode;
+    BuildPath();
+}
+
+int pf::Elevator::GetPathMode() {
+    return mode;
+}
+
+void pf::Elevator::SetPathStart(double time) {
+    start = time;
+}
+
+double pf::Elevator::GetPathStart() {
+    return start;
+}
+
+pf::Resource *pf::Elevator::GetImageResource() {
+    return imageResource;
+}
+
+void pf::Elevator::BuildPath() {
+    pathX = waypointX;
+    pathY = waypointY;
+    if (mode == PATH_LOOP && !pathX.empty()) {
+        pathX.push_back(pathX[0]);
+        pathY.push_back(pathY[0]);
     }
-    
-    SetVelocityY(direction * speed);
-    pf::PhysicsEntity::Tick(frametime);
+
+    pathDistance.resize(pathX.size());
+    float distance = 0.f;
+    for (int i = 0; i < pathX.size(); i++) {
+        if (i > 0) {
+            float dx = pathX[i] - pathX[i - 1], dy = pathY[i] - pathY[i - 1];
+            distance += std::sqrt(dx * dx + dy * dy);
+        }
+        pathDistance[i] = distance;
+    }
+}
+
+void pf::Elevator::GetPathPosition(double time, float& x, float& y) {
+    if (pathX.empty()) {
+        x = GetX();
+        y = GetY();
+        return;
+    }
+
+    float length = pathDistance.back();
+    if (length <= 0.f || speed <= 0.f) {
+        x = pathX[0];
+        y = pathY[0];
+        return;
+    }
+
+    // How far along the path it is, folded back for the return trip. The
+    // world's time is a clock that runs for as long as the server does, so
+    // this is folded in double precision.
+    double period = mode == PATH_LOOP ? length : length * 2.0;
+    double folded = std::fmod((time - start) * speed, period);
+    if (folded < 0.0) folded += period;
+    float travel = (float)folded;
+    if (mode != PATH_LOOP && travel > length) travel = length * 2.f - travel;
+
+    // The segment it's on, then how far along that
+    int next = std::upper_bound(pathDistance.begin(), pathDistance.end(), travel) - pathDistance.begin();
+    if (next >= pathX.size()) {
+        x = pathX.back();
+        y = pathY.back();
+        return;
+    }
+    float along = (travel - pathDistance[next - 1]) / (pathDistance[next] - pathDistance[next - 1]);
+    x = pathX[next - 1] + (pathX[next] - pathX[next - 1]) * along;
+    y = pathY[next - 1] + (pathY[next] - pathY[next - 1]) * along;
 }
@@ -21,79 +21,138 @@
 
 #include "Entity.h"
 #include "World.h"
-
-unsigned int pf::Entity::NEXT_ENT_ID = 0;
+#include "Bodies.h"
+#include <cassert>
 
 pf::Entity::Entity(pf::World *world) {
-    id = NEXT_ENT_ID++;
+    id = 0;
     Init(world, 0, 0, 0, 0);
 }
 
 pf::Entity::Entity(pf::World *world, float x, float y, int width, int height) {
-    id = NEXT_ENT_ID++;
+    id = 0;
     Init(world, x, y, width, height);
 }
 
 pf::Entity::~Entity() {
-    if (world) world->RemoveEntity(*this);
+    if (world) {
+        world->RemoveEntity(*this);
+        world->DestroyBody(body);
+    }
 }
 
 void pf::Entity::Init(pf::World *world, float x, float y, int width, int height) {
-    //id = NEXT_ENT_ID++;
-
+    assert(!world->IsTicking());
     this->world = world;
+    bodies = world->GetBodies();
+    body = bodies->Create(this);
+    type = 0;
+    broadphaseProxy = -1;
     SetPosition(x, y);
     SetSize(width, height);
 }
 
 void pf::Entity::SetPosition(float x, float y) {
-    this->x = x;
-    this->y = y;
+    bodies->x[body] = x;
+    bodies->y[body] = y;
+    if (world) {
+        world->WakeBody(body);
+        world->UpdateEntity(*this);
+    }
 }
 
 void pf::Entity::SetSize(int width, int height) {
-    this->width = width;
-    this->height = height;
+    bodies->width[body] = width;
+    bodies->height[body] = height;
+    if (world) world->UpdateEntity(*this);
 }
 
 void pf::Entity::SetX(float x) {
-    this->x = x;
+    bodies->x[body] = x;
+    if (world) {
+        world->WakeBody(body);
+        world->UpdateEntity(*this);
+    }
 }
 
 void pf::Entity::SetY(float y) {
-    this->y = y;
+    bodies->y[body] = y;
+    if (world) {
+        world->WakeBody(body);
+        world->UpdateEntity(*this);
+    }
 }
 
 void pf::Entity::SetWidth(int width) {
-    this->width = width;
+    bodies->width[body] = width;
+    if (world) world->UpdateEntity(*this);
 }
 
 void pf::Entity::SetHeight(int height) {
-    this->height = height;
+    bodies->height[body] = height;
+    if (world) world->UpdateEntity(*this);
 }
 
-void pf::Entity::SetID(int id) {
+void pf::Entity::SetID(pf::EntityHandle id) {
     this->id = id;
-    if (id > NEXT_ENT_ID)
-        NEXT_ENT_ID = id + 1;
 }
 
 float pf::Entity::GetX() {
-    return x;
+    return pf::ToFloat(bodies->x[body]);
 }
 
 float pf::Entity::GetY() {
-    return y;
+    return pf::ToFloat(bodies->y[body]);
 }
 
 int pf::Entity::GetWidth() {
-    return width;
+    return bodies->width[body];
 }
 
 int pf::Entity::GetHeight() {
-    return height;
+    return bodies->height[body];
+}
+
+int pf::Entity::GetBody() {
+    return body;
+}
+
+int pf::Entity::GetType() {
+    return type;
+}
+
+bool pf::Entity::IsType(int type) {
+    return (this->type & type) == type;
+}
+
+pf::CollisionMask pf::Entity::GetCollisionCategory() {
+    return bodies->category[body];
+}
+
+void pf::Entity::SetCollisionCategory(pf::CollisionMask category) {
+    bodies->category[body] = category;
+}
+
+pf::CollisionMask pf::Entity::GetCollisionMask() {
+    return bodies->mask[body];
 }
 
-int pf::Entity::GetID() {
+void pf::Entity::SetCollisionMask(pf::CollisionMask mask) {
+    bodies->mask[body] = mask;
+}
+
+bool pf::Entity::CanCollideWith(pf::Entity *entity) {
+    return (bodies->category[entity->GetBody()] & bodies->mask[body]) != 0;
+}
+
+pf::EntityHandle pf::Entity::GetID() {
     return this->id;
+}
+
+int pf::Entity::GetBroadphaseProxy() {
+    return broadphaseProxy;
+}
+
+void pf::Entity::SetBroadphaseProxy(int proxy) {
+    broadphaseProxy = proxy;
 }
\ No newline at end of file
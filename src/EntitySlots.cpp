@@ -0,0 +1,149 @@
+/*
+ * EntitySlots.cpp
+ * Slot map from generation-checked entity handles to entities
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "EntitySlots.h"
+#include <cstddef>
+
+pf::EntitySlots::EntitySlots() {
+
+}
+
+pf::EntitySlots::~EntitySlots() {
+
+}
+
+int pf::EntitySlots::SlotOf(pf::EntityHandle handle) {
+    return handle & (MAX_SLOTS - 1);
+}
+
+int pf::EntitySlots::GenerationOf(pf::EntityHandle handle) {
+    return handle >> SLOT_BITS;
+}
+
+pf::EntityHandle pf::EntitySlots::MakeHandle(int slot, int generation) {
+    return ((pf::EntityHandle)generation << SLOT_BITS) | (pf::EntityHandle)slot;
+}
+
+pf::EntityHandle pf::EntitySlots::Insert(pf::Entity *entity) {
+    int slot = -1;
+
+    // InsertAt can fill a slot that's still on the free list, so skip those
+    while (!freeSlots.empty() && slot < 0) {
+        if (!slots[freeSlots.back()].entity)
+            slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+
+    if (slot < 0) {
+        if (slots.size() >= MAX_SLOTS) return 0;
+
+        Slot newSlot;
+        newSlot.entity = NULL;
+        newSlot.generation = 1;
+        newSlot.dense = -1;
+        slot = slots.size();
+        slots.push_back(newSlot);
+    }
+
+    slots[slot].entity = entity;
+    AddDense(slot);
+
+    return MakeHandle(slot, slots[slot].generation);
+}
+
+bool pf::EntitySlots::InsertAt(pf::EntityHandle handle, pf::Entity *entity, pf::Entity *&displaced) {
+    int slot = SlotOf(handle);
+    int generation = GenerationOf(handle);
+    displaced = NULL;
+
+    if (!generation) return false;
+
+    // Grow up to the slot, leaving the ones in between free
+    while (slots.size() <= slot) {
+        Slot newSlot;
+        newSlot.entity = NULL;
+        newSlot.generation = 1;
+        newSlot.dense = -1;
+        freeSlots.push_back(slots.size());
+        slots.push_back(newSlot);
+    }
+
+    Slot& s = slots[slot];
+    if (s.entity) {
+        displaced = s.entity;
+        RemoveDense(slot);
+    }
+
+    s.entity = entity;
+    s.generation = generation;
+    AddDense(slot);
+
+    return true;
+}
+
+bool pf::EntitySlots::Remove(pf::EntityHandle handle) {
+    if (!Get(handle)) return false;
+
+    int slot = SlotOf(handle);
+    Slot& s = slots[slot];
+    RemoveDense(slot);
+    s.entity = NULL;
+    s.generation = s.generation % MAX_GENERATION + 1;
+    freeSlots.push_back(slot);
+
+    return true;
+}
+
+pf::Entity *pf::EntitySlots::Get(pf::EntityHandle handle) {
+    int slot = SlotOf(handle);
+    if (slot >= slots.size()) return NULL;
+
+    const Slot& s = slots[slot];
+    if (s.generation != GenerationOf(handle)) return NULL;
+
+    return s.entity;
+}
+
+int pf::EntitySlots::GetCount() {
+    return dense.size();
+}
+
+pf::Entity *pf::EntitySlots::GetAt(int index) {
+    return dense[index];
+}
+
+void pf::EntitySlots::AddDense(int slot) {
+    slots[slot].dense = dense.size();
+    dense.push_back(slots[slot].entity);
+    denseSlots.push_back(slot);
+}
+
+void pf::EntitySlots::RemoveDense(int slot) {
+    int index = slots[slot].dense;
+    int last = dense.size() - 1;
+
+    // Move the last entity into the hole
+    dense[index] = dense[last];
+    denseSlots[index] = denseSlots[last];
+    slots[denseSlots[index]].dense = index;
+    dense.pop_back();
+    denseSlots.pop_back();
+    slots[slot].dense = -1;
+}
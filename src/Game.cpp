@@ -25,12 +25,12 @@
 #include "Elevator.h"
 #include "Animation.h"
 #include "BouncyParticle.h"
-#include "Platform.h"
 #include "Resource.h"
 #include "cpGUI.h"
 #include "Logger.h"
 #include "Packet.h"
 #include "CharacterSkin.h"
+#include "Latency.h"
 #include <sstream>
 #include <SFML/Window.hpp>
 #include <SFML/Graphics.hpp>
@@ -41,6 +41,8 @@ pf::Game::Game(sf::RenderWindow& renderWindow) {
     localCharacter = NULL;
     world = NULL;
     socket = NULL;
+    latency = NULL;
+    tick = 0;
 
     // Initial game state
     screen = Screen_Main;
@@ -339,6 +341,8 @@ void pf::Game::JoinGame() {
     }
     socketSelector = new sf::SelectorTCP();
     socketSelector->Add(*socket);
+    latency = new pf::Latency();
+    tick = 0;
     pf::Logger::LogInfo("Connected to %s:%d", serverIP.ToString().c_str(), serverPort);
 
     // Log in
@@ -384,13 +388,30 @@ bool pf::Game::Tick(sf::Input& input, float frametime) {
                 case pf::Packet::Resource::packetType: {
                     pf::Packet::Resource packet(socket);
                     pf::Resource *resource = packet.GetResource();
-                    pf::Logger::LogInfo("Received resource \"%s\" ( %d bytes )", packet.filename->string, resource->GetLength());
+                    pf::Logger::LogInfo("Received resource \"%s\" ( %d bytes )", resource->GetFilename(), resource->GetLength());
                     std::stringstream resourceStatus;
                     resourceStatus << "Downloaded resource " << resourcesLoaded << " of " << resourcesToLoad;
                     SetJoiningLabelText(screen == Screen_Joining ? NULL : (char *)"Loading...", (char *)resourceStatus.str().c_str());
                     resourcesLoaded++;
                     break;
                 }
+                case pf::Packet::ResourcePatch::packetType: {
+                    pf::Packet::ResourcePatch packet(socket);
+
+                    // Resources that haven't arrived yet will come in their new form
+                    pf::Resource *resource = pf::Resource::GetResource(packet.filename->string);
+                    if (!resource) break;
+
+                    if (!packet.Apply(resource)) {
+                        pf::Logger::LogError("Failed to patch resource \"%s\"", packet.filename->string);
+                        break;
+                    }
+
+                    pf::Logger::LogInfo("Patched resource \"%s\" ( %d byte patch, %d bytes )",
+                                        resource->GetFilename(), packet.length, resource->GetLength());
+                    if (world) world->ReloadResource(resource);
+                    break;
+                }
                 case pf::Packet::Property::packetType: {
                     pf::Packet::Property packet(socket);
                     properties[packet.name->string] = packet.value->string;
@@ -415,6 +436,22 @@ bool pf::Game::Tick(sf::Input& input, float frametime) {
                     world->AddEntity(character);
                     break;
                 }
+                case pf::Packet::SpawnMover::packetType: {
+                    pf::Packet::SpawnMover packet(socket);
+                    latency->SeedClockOffset(packet.serverTime);
+                    world->AddEntity(packet.GetElevator(world));
+                    break;
+                }
+                case pf::Packet::TileEdits::packetType: {
+                    pf::Packet::TileEdits packet(socket);
+                    if (world) packet.Apply(world);
+                    break;
+                }
+                case pf::Packet::LiquidChunk::packetType: {
+                    pf::Packet::LiquidChunk packet(socket);
+                    if (world) packet.Apply(world);
+                    break;
+                }
                 case pf::Packet::StartWorld::packetType: {
                     pf::Packet::StartWorld packet(socket);
                     InitWorld();
@@ -467,6 +504,7 @@ bool pf::Game::Tick(sf::Input& input, float frametime) {
                 }
                 case pf::Packet::TeleportEntity::packetType: {
                     pf::Packet::TeleportEntity packet(socket);
+                    latency->SetRemoteTick(packet.tick);
                     pf::Entity *entity = world->GetEntity(packet.entityID);
                     if (!entity) break;
 
@@ -495,6 +533,17 @@ bool pf::Game::Tick(sf::Input& input, float frametime) {
 
                     break;
                 }
+                case pf::Packet::Ping::packetType: {
+                    pf::Packet::Ping packet(socket);
+                    pf::Packet::Pong(&packet, pf::Latency::GetTime(), tick).Send(socket);
+                    break;
+                }
+                case pf::Packet::Pong::packetType: {
+                    pf::Packet::Pong packet(socket);
+                    latency->AddSample(packet.pingTime, packet.time, pf::Latency::GetTime());
+                    latency->SetRemoteTick(packet.tick);
+                    break;
+                }
             }
 
         }
@@ -561,17 +610,24 @@ bool pf::Game::Tick(sf::Input& input, float frametime) {
             viewX += (targetViewX - viewX) / viewSpeed;
             viewY += (targetViewY - viewY) / viewSpeed;
 
-            // Tick world
+            // Tick world, on the server's clock once there's an idea of it
+            if (latency->HasClockOffset())
+                world->SetClock(latency->GetRemoteTime() / 1000.0);
             world->Tick(frametime);
+            tick++;
 
             if (localCharacter) {
                 // Send movement packet
                 if ((int)localCharacter->GetX() != oldX ||
                     (int)localCharacter->GetY() != oldY) {
-                    pf::Packet::AbsoluteMove(localCharacter).Send(socket);
+                    pf::Packet::AbsoluteMove(tick, localCharacter).Send(socket);
                 }
             }
 
+            // Periodically ping the server to measure latency
+            if (latency->ShouldPing())
+                pf::Packet::Ping(latency->NextSequence(), pf::Latency::GetTime()).Send(socket);
+
             break;
 
         }
@@ -608,15 +664,7 @@ void pf::Game::HandleClick(sf::Input& input) {
     switch (screen) {
         case Screen_Game: {
             /*if (input.IsMouseButtonDown(sf::Mouse::Right)) {
-                std::vector<pf::Entity*> ents = world->HitsPlatform((float)cursorPosition.x, (float)cursorPosition.y);
-                for (int i = 0; i < ents.size(); i++) {
-                    pf::Entity *ent = ents.at(i);
-                    if (((pf::Platform*)ent)->HitTest((float)cursorPosition.x, (float)cursorPosition.y, 0.f, 0.f)) {
-                        world->RemoveEntity(*ent);
-                        world->RemovePlatform((pf::Platform&)*ent);
-                        delete ent;
-                    }
-                }
+                world->RemoveTile((int)cursorPosition.x / pf::World::TILE_SIZE, (int)cursorPosition.y / pf::World::TILE_SIZE);
             } else if (input.IsMouseButtonDown(sf::Mouse::Left)) {
                 addBox(cursorPosition.x, cursorPosition.y);
             } else if (input.IsMouseButtonDown(sf::Mouse::Middle)) {
@@ -714,6 +762,10 @@ void pf::Game::StopGame() {
         delete world;
         world = NULL;
     }
+    if (latency) {
+        delete latency;
+        latency = NULL;
+    }
 }
 
 void pf::Game::Disconnect(char *message) {
@@ -767,6 +819,10 @@ pf::Screen pf::Game::GetScreen() {
     return screen;
 }
 
+pf::Latency *pf::Game::GetLatency() {
+    return latency;
+}
+
 void pf::Game::InitWorld() {
     pf::Logger::LogInfo("Starting World!");
     pf::Logger::LogInfo("LEVEL: %s", (char *)properties["level"].c_str());
@@ -774,6 +830,9 @@ void pf::Game::InitWorld() {
     if (world) delete world;
     world = new pf::World(pf::Resource::GetResource((char *)properties["level"].c_str()),
                           pf::Resource::GetResource((char *)properties["tileset"].c_str()));
+
+    // Liquid is the server's, and arrives as it changes
+    world->SetLiquidSimulation(false);
 }
 
 void pf::Game::SendChat(const char *message) {
@@ -0,0 +1,248 @@
+/*
+ * JobPool.cpp
+ * Work-stealing thread pool for running batches of jobs in parallel
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "JobPool.h"
+#include "IJob.h"
+#ifdef _WIN32
+#include <windows.h>
+#include <climits>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// MinGW's GCC takes __thread, and would ignore __declspec(thread)
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+// Set once by each worker as it starts
+static THREAD_LOCAL int threadIndex = 0;
+
+// Counters shared between threads are only changed through these, which
+// are full barriers. Returns the new value.
+static int AtomicAdd(volatile int& value, int amount) {
+#ifdef _WIN32
+    return InterlockedExchangeAdd((volatile LONG *)&value, amount) + amount;
+#else
+    return __sync_add_and_fetch(&value, amount);
+#endif
+}
+
+static void AtomicStore(volatile int& value, int newValue) {
+#ifdef _WIN32
+    InterlockedExchange((volatile LONG *)&value, newValue);
+#else
+    // Only an acquire barrier by itself
+    __sync_lock_test_and_set(&value, newValue);
+    __sync_synchronize();
+#endif
+}
+
+class pf::JobPool::Signal {
+    public:
+        Signal() {
+#ifdef _WIN32
+            semaphore = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+#else
+            count = 0;
+            pthread_mutex_init(&mutex, NULL);
+            pthread_cond_init(&posted, NULL);
+#endif
+        }
+
+        ~Signal() {
+#ifdef _WIN32
+            CloseHandle(semaphore);
+#else
+            pthread_cond_destroy(&posted);
+            pthread_mutex_destroy(&mutex);
+#endif
+        }
+
+        void Post(int times) {
+#ifdef _WIN32
+            ReleaseSemaphore(semaphore, times, NULL);
+#else
+            pthread_mutex_lock(&mutex);
+            count += times;
+            pthread_cond_broadcast(&posted);
+            pthread_mutex_unlock(&mutex);
+#endif
+        }
+
+        void Wait() {
+#ifdef _WIN32
+            WaitForSingleObject(semaphore, INFINITE);
+#else
+            pthread_mutex_lock(&mutex);
+            while (!count)
+                pthread_cond_wait(&posted, &mutex);
+            count--;
+            pthread_mutex_unlock(&mutex);
+#endif
+        }
+
+    private:
+#ifdef _WIN32
+        HANDLE semaphore;
+#else
+        int count;
+        pthread_mutex_t mutex;
+        pthread_cond_t posted;
+#endif
+};
+
+pf::JobPool::Worker::Worker(pf::JobPool *pool, int index) {
+    this->pool = pool;
+    this->index = index;
+}
+
+void pf::JobPool::Worker::Run() {
+    threadIndex = index;
+
+    // Jobs don't submit more, so once there's nothing left to take, there
+    // won't be until the next batch is posted
+    while (Load(pool->running)) {
+        if (!pool->RunOne(index))
+            pool->wakeup->Wait();
+    }
+}
+
+pf::JobPool::JobPool(int threads) {
+    if (threads < 1) threads = 1;
+
+    wakeup = new Signal();
+    pending = 0;
+    running = 1;
+
+    for (int i = 0; i < threads; i++)
+        queues.push_back(new Queue());
+
+    for (int i = 1; i < threads; i++) {
+        Worker *worker = new Worker(this, i);
+        workers.push_back(worker);
+        worker->Launch();
+    }
+}
+
+pf::JobPool::~JobPool() {
+    AtomicStore(running, 0);
+    wakeup->Post(workers.size());
+
+    for (int i = 0; i < workers.size(); i++) {
+        workers[i]->Wait();
+        delete workers[i];
+    }
+    for (int i = 0; i < queues.size(); i++)
+        delete queues[i];
+    delete wakeup;
+}
+
+int pf::JobPool::GetProcessorCount() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = info.dwNumberOfProcessors;
+#else
+    int count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return count > 0 ? count : 1;
+}
+
+int pf::JobPool::Load(volatile int& value) {
+    return AtomicAdd(value, 0);
+}
+
+int pf::JobPool::GetThreadIndex() {
+    return threadIndex;
+}
+
+int pf::JobPool::GetThreadCount() {
+    return queues.size();
+}
+
+void pf::JobPool::Run(pf::IJob **jobs, int count) {
+    if (count <= 0) return;
+
+    // Nothing to share the work with
+    if (queues.size() == 1) {
+        for (int i = 0; i < count; i++)
+            jobs[i]->Run();
+        return;
+    }
+
+    // Count the whole batch first so no thread sees it finish early
+    AtomicAdd(pending, count);
+
+    // Deal the jobs out evenly; stealing evens out whatever's left over
+    for (int i = 0; i < count; i++) {
+        Queue *queue = queues[i % queues.size()];
+        queue->lock.Lock();
+        queue->jobs.push_back(jobs[i]);
+        queue->lock.Unlock();
+    }
+    wakeup->Post(count < workers.size() ? count : workers.size());
+
+    // Reading the count with a barrier also makes the jobs' writes visible
+    // here once it hits zero
+    while (Load(pending) > 0) {
+        if (!RunOne(0))
+            sf::Sleep(0.f);
+    }
+}
+
+pf::IJob *pf::JobPool::Take(int index) {
+    pf::IJob *job = NULL;
+
+    // Newest job from our own queue
+    Queue *own = queues[index];
+    own->lock.Lock();
+    if (!own->jobs.empty()) {
+        job = own->jobs.back();
+        own->jobs.pop_back();
+    }
+    own->lock.Unlock();
+    if (job) return job;
+
+    // Oldest job from someone else's
+    for (int i = 1; i < queues.size() && !job; i++) {
+        Queue *victim = queues[(index + i) % queues.size()];
+        victim->lock.Lock();
+        if (!victim->jobs.empty()) {
+            job = victim->jobs.front();
+            victim->jobs.pop_front();
+        }
+        victim->lock.Unlock();
+    }
+
+    return job;
+}
+
+bool pf::JobPool::RunOne(int index) {
+    pf::IJob *job = Take(index);
+    if (!job) return false;
+
+    job->Run();
+    AtomicAdd(pending, -1);
+    return true;
+}
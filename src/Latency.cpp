@@ -0,0 +1,132 @@
+/*
+ * Latency.cpp
+ * Estimates round-trip time, jitter, and clock offset from ping/pong samples
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "Latency.h"
+#include <SFML/System.hpp>
+
+pf::Latency::Latency() {
+    lastPingTime = 0;
+    sequence = 0;
+    samples = 0;
+    seeded = false;
+    rtt = minRTT = jitter = 0.f;
+    clockOffset = 0;
+    remoteTick = 0;
+}
+
+pf::Latency::~Latency() {
+
+}
+
+uint32_t pf::Latency::GetTime() {
+    static sf::Clock clock;
+    return (uint32_t)(clock.GetElapsedTime() * 1000.f);
+}
+
+bool pf::Latency::ShouldPing() {
+    uint32_t now = GetTime();
+
+    if (sequence && now - lastPingTime < (uint32_t)(PING_INTERVAL * 1000.f))
+        return false;
+
+    lastPingTime = now;
+    return true;
+}
+
+uint32_t pf::Latency::NextSequence() {
+    return ++sequence;
+}
+
+void pf::Latency::AddSample(uint32_t sentTime, uint32_t remoteTime, uint32_t receivedTime) {
+    // Ignore samples that came back before they were sent (stale or bogus pongs)
+    if (receivedTime < sentTime) return;
+
+    uint32_t sampleRTT = receivedTime - sentTime;
+
+    // Smoothed RTT and mean deviation, weighted the same way TCP does it
+    if (!samples) {
+        rtt = minRTT = sampleRTT;
+        jitter = sampleRTT / 2.f;
+    } else {
+        float deviation = rtt - sampleRTT;
+        if (deviation < 0.f) deviation = -deviation;
+        jitter = 0.75f * jitter + 0.25f * deviation;
+        rtt = 0.875f * rtt + 0.125f * sampleRTT;
+        if (sampleRTT < minRTT) minRTT = sampleRTT;
+    }
+
+    // Assume the remote side stamped the pong halfway through the round trip
+    OffsetSample& sample = offsetSamples[samples % OFFSET_SAMPLES];
+    sample.rtt = sampleRTT;
+    sample.offset = (int32_t)(remoteTime - (sentTime + sampleRTT / 2));
+    samples++;
+
+    // The sample with the shortest round trip had the least queueing delay,
+    // so its offset is the most trustworthy
+    int count = samples < OFFSET_SAMPLES ? samples : OFFSET_SAMPLES;
+    int best = 0;
+    for (int i = 1; i < count; i++)
+        if (offsetSamples[i].rtt < offsetSamples[best].rtt)
+            best = i;
+    clockOffset = offsetSamples[best].offset;
+}
+
+void pf::Latency::SetRemoteTick(uint32_t tick) {
+    if (tick > remoteTick)
+        remoteTick = tick;
+}
+
+void pf::Latency::SeedClockOffset(uint32_t remoteTime) {
+    if (samples) return;
+    clockOffset = (int32_t)(remoteTime - GetTime());
+    seeded = true;
+}
+
+bool pf::Latency::HasSamples() {
+    return samples > 0;
+}
+
+bool pf::Latency::HasClockOffset() {
+    return samples > 0 || seeded;
+}
+
+float pf::Latency::GetRTT() {
+    return rtt;
+}
+
+float pf::Latency::GetMinRTT() {
+    return minRTT;
+}
+
+float pf::Latency::GetJitter() {
+    return jitter;
+}
+
+int32_t pf::Latency::GetClockOffset() {
+    return clockOffset;
+}
+
+uint32_t pf::Latency::GetRemoteTime() {
+    return GetTime() + clockOffset;
+}
+
+uint32_t pf::Latency::GetRemoteTick() {
+    return remoteTick;
+}
@@ -0,0 +1,244 @@
+/*
+ * LightGrid.cpp
+ * Flood-fill tile lighting from lights and the open sky
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define xy(x,y) (y)*(this->width)+(x)
+
+#include "LightGrid.h"
+#include <algorithm>
+
+// Offsets to a tile's four neighbours
+static const int NeighbourX[4] = { 1, -1, 0, 0 };
+static const int NeighbourY[4] = { 0, 0, 1, -1 };
+
+pf::LightGrid::LightGrid() {
+    tiles = NULL;
+    width = height = 0;
+}
+
+pf::LightGrid::~LightGrid() {
+
+}
+
+void pf::LightGrid::Load(const pf::TileCell *tiles, int width, int height) {
+    this->tiles = tiles;
+    this->width = tiles ? width : 0;
+    this->height = tiles ? height : 0;
+    levels.assign(this->width * this->height, 0);
+    emit.assign(this->width * this->height, 0);
+    skyDepth.assign(this->width, 0);
+    changes.clear();
+    if (!tiles) return;
+
+    for (int x = 0; x < this->width; x++) {
+        int depth = 0;
+        while (depth < this->height && !IsOpaque(xy(x, depth)))
+            depth++;
+        skyDepth[x] = depth;
+        for (int y = 0; y < depth; y++)
+            emit[xy(x, y)] = pf::World::LIGHT_MAX;
+    }
+    for (int i = 0; i < lights.size(); i++) {
+        const Light& l = lights[i];
+        if (!l.used || l.x < 0 || l.y < 0 || l.x >= this->width || l.y >= this->height || IsOpaque(xy(l.x, l.y)))
+            continue;
+        emit[xy(l.x, l.y)] = std::max((int)emit[xy(l.x, l.y)], l.level);
+    }
+
+    for (int tile = 0; tile < this->width * this->height; tile++) {
+        if (!emit[tile]) continue;
+        levels[tile] = emit[tile];
+        queue.push_back(tile);
+    }
+    Spread();
+}
+
+int pf::LightGrid::GetLevel(int x, int y) {
+    return levels[xy(x, y)];
+}
+
+int pf::LightGrid::AddLight(int x, int y, int level, bool fromLevel) {
+    int light = 0;
+    while (light < lights.size() && lights[light].used)
+        light++;
+    if (light == lights.size())
+        lights.resize(light + 1);
+
+    Light& l = lights[light];
+    l.x = x;
+    l.y = y;
+    l.level = level < 0 ? 0 : level > pf::World::LIGHT_MAX ? pf::World::LIGHT_MAX : level;
+    l.used = true;
+    l.fromLevel = fromLevel;
+    Change(l.x, l.y);
+
+    return light;
+}
+
+void pf::LightGrid::SetLightPosition(int light, int x, int y) {
+    if (light < 0 || light >= lights.size() || !lights[light].used) return;
+
+    // Moving within a tile changes nothing
+    Light& l = lights[light];
+    if (l.x == x && l.y == y) return;
+
+    int oldX = l.x, oldY = l.y;
+    l.x = x;
+    l.y = y;
+    Change(oldX, oldY);
+    Change(l.x, l.y);
+}
+
+void pf::LightGrid::RemoveLight(int light) {
+    if (light < 0 || light >= lights.size() || !lights[light].used) return;
+
+    lights[light].used = false;
+    Change(lights[light].x, lights[light].y);
+}
+
+void pf::LightGrid::RemoveLevelLights() {
+    for (int i = 0; i < lights.size(); i++)
+        if (lights[i].fromLevel)
+            lights[i].used = false;
+}
+
+void pf::LightGrid::TileChanged(int x, int y) {
+    // Only a tile at or above the first opaque one can change how far
+    // down the sky reaches
+    if (!skyDepth.empty() && y <= skyDepth[x]) UpdateSky(x);
+    Change(x, y);
+}
+
+void pf::LightGrid::Update() {
+    if (changes.empty()) return;
+
+    // Clear everything that could have been lit through a changed tile.
+    // Whatever's at least as bright was lit some other way, and spreads
+    // back into the cleared area afterwards.
+    for (int i = 0; i < changes.size(); i++) {
+        int tile = changes[i];
+        removal.push_back(std::make_pair(tile, (int)levels[tile]));
+        seeds.push_back(tile);
+        levels[tile] = 0;
+    }
+    for (int head = 0; head < removal.size(); head++) {
+        int tile = removal[head].first, level = removal[head].second;
+        int x = tile % width, y = tile / width;
+        for (int i = 0; i < 4; i++) {
+            int nextX = x + NeighbourX[i], nextY = y + NeighbourY[i];
+            if (nextX < 0 || nextY < 0 || nextX >= width || nextY >= height) continue;
+
+            int next = xy(nextX, nextY), lit = levels[next];
+            if (!lit) continue;
+            if (lit < level) {
+                levels[next] = 0;
+                if (IsOpaque(next)) {
+                    opaque.push_back(next);
+                } else {
+                    removal.push_back(std::make_pair(next, lit));
+                    if (emit[next]) seeds.push_back(next);
+                }
+            } else if (!IsOpaque(next))
+                queue.push_back(next);
+        }
+    }
+
+    // Lights in the cleared area shine again, and the faces of solid tiles
+    // take the brightest light beside them
+    for (int i = 0; i < seeds.size(); i++) {
+        int tile = seeds[i];
+        if (IsOpaque(tile)) {
+            opaque.push_back(tile);
+        } else if (emit[tile] > levels[tile]) {
+            levels[tile] = emit[tile];
+            queue.push_back(tile);
+        }
+    }
+    for (int i = 0; i < opaque.size(); i++) {
+        int tile = opaque[i], x = tile % width, y = tile / width;
+        for (int j = 0; j < 4; j++) {
+            int nextX = x + NeighbourX[j], nextY = y + NeighbourY[j];
+            if (nextX < 0 || nextY < 0 || nextX >= width || nextY >= height || IsOpaque(xy(nextX, nextY))) continue;
+            levels[tile] = std::max((int)levels[tile], levels[xy(nextX, nextY)] - 1);
+        }
+    }
+    Spread();
+
+    changes.clear();
+    removal.clear();
+    seeds.clear();
+    opaque.clear();
+}
+
+void pf::LightGrid::Spread() {
+    // Breadth first, so most tiles are only set once
+    for (int head = 0; head < queue.size(); head++) {
+        int tile = queue[head], level = levels[tile] - 1;
+        if (level <= 0) continue;
+
+        int x = tile % width, y = tile / width;
+        for (int i = 0; i < 4; i++) {
+            int nextX = x + NeighbourX[i], nextY = y + NeighbourY[i];
+            if (nextX < 0 || nextY < 0 || nextX >= width || nextY >= height) continue;
+
+            int next = xy(nextX, nextY);
+            if (level <= levels[next]) continue;
+
+            // Solid tiles are lit, but don't pass it on
+            levels[next] = level;
+            if (!IsOpaque(next)) queue.push_back(next);
+        }
+    }
+    queue.clear();
+}
+
+void pf::LightGrid::UpdateSky(int x) {
+    if (skyDepth.empty() || x < 0 || x >= width) return;
+
+    int depth = 0;
+    while (depth < height && !IsOpaque(xy(x, depth)))
+        depth++;
+
+    // Tiles the sky now reaches, or no longer does
+    int oldDepth = skyDepth[x];
+    skyDepth[x] = depth;
+    for (int y = std::min(depth, oldDepth); y < std::max(depth, oldDepth); y++)
+        Change(x, y);
+}
+
+void pf::LightGrid::Change(int x, int y) {
+    if (emit.empty() || x < 0 || y < 0 || x >= width || y >= height) return;
+
+    // The sky's light, or the brightest light in the tile
+    int tile = xy(x, y), level = 0;
+    if (!IsOpaque(tile)) {
+        if (y < skyDepth[x]) level = pf::World::LIGHT_MAX;
+        for (int i = 0; i < lights.size(); i++)
+            if (lights[i].used && lights[i].x == x && lights[i].y == y)
+                level = std::max(level, lights[i].level);
+    }
+
+    emit[tile] = level;
+    changes.push_back(tile);
+}
+
+bool pf::LightGrid::IsOpaque(int tile) {
+    pf::TileCell cell = tiles[tile];
+    return (cell & pf::World::TILE_SOLID) && !(cell & (pf::World::TILE_LIQUID | pf::World::TILE_SHAPE));
+}
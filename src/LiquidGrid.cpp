@@ -0,0 +1,330 @@
+/*
+ * LiquidGrid.cpp
+ * Cellular automaton for liquid flowing through the tile grid
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define xy(x,y) (y)*(this->width)+(x)
+
+#include "LiquidGrid.h"
+#include "JobPool.h"
+#include "IJob.h"
+#include <algorithm>
+
+// Steps a run of the active chunks through one pass
+class pf::LiquidGrid::FlowJob : public pf::IJob {
+    public:
+        FlowJob(pf::LiquidGrid *grid) {
+            this->grid = grid;
+        }
+
+        void Run() {
+            for (int i = begin; i < end; i++)
+                grid->Flow(grid->activeChunks[i], pass);
+        }
+
+        int pass, begin, end;
+
+    private:
+        pf::LiquidGrid *grid;
+};
+
+pf::LiquidGrid::LiquidGrid() {
+    tiles = NULL;
+    width = height = 0;
+    liquidTile = 0;
+    simulation = true;
+    credit = 0.f;
+    chunksX = chunksY = 0;
+}
+
+pf::LiquidGrid::~LiquidGrid() {
+    for (int i = 0; i < jobs.size(); i++)
+        delete jobs[i];
+}
+
+void pf::LiquidGrid::Load(pf::TileCell *tiles, int width, int height, pf::TileCell liquidTile) {
+    this->tiles = tiles;
+    this->width = tiles ? width : 0;
+    this->height = tiles ? height : 0;
+    this->liquidTile = liquidTile;
+    activeChunks.clear();
+    unsentChunks.clear();
+
+    // Liquid in the level starts full, and is stepped until it settles
+    chunksX = (this->width + pf::World::LIQUID_CHUNK - 1) / pf::World::LIQUID_CHUNK;
+    chunksY = (this->height + pf::World::LIQUID_CHUNK - 1) / pf::World::LIQUID_CHUNK;
+    chunkFlags.assign(chunksX * chunksY, 0);
+    levels.assign(this->width * this->height, 0);
+    for (int y = 0; y < this->height; y++) {
+        for (int x = 0; x < this->width; x++) {
+            if (!(tiles[xy(x, y)] & pf::World::TILE_LIQUID)) continue;
+            levels[xy(x, y)] = pf::World::LIQUID_FULL;
+            if (!(chunkFlags[y / pf::World::LIQUID_CHUNK * chunksX + x / pf::World::LIQUID_CHUNK] & CHUNK_ACTIVE))
+                ActivateChunk(x / pf::World::LIQUID_CHUNK, y / pf::World::LIQUID_CHUNK);
+        }
+    }
+    next = sent = levels;
+}
+
+int pf::LiquidGrid::GetLevel(int x, int y) {
+    return levels[xy(x, y)];
+}
+
+bool pf::LiquidGrid::SetLevel(int x, int y, int level) {
+    if (!Holds(x, y)) return false;
+
+    level = level < 0 ? 0 : level > pf::World::LIQUID_FULL ? pf::World::LIQUID_FULL : level;
+    int tile = xy(x, y);
+    if (levels[tile] == level) return false;
+
+    bool flipped = !level || !levels[tile];
+    if (flipped) tiles[tile] = level ? liquidTile : 0;
+    levels[tile] = level;
+    MarkUnsent(y / pf::World::LIQUID_CHUNK * chunksX + x / pf::World::LIQUID_CHUNK);
+    Activate(x, y, x, y);
+    return flipped;
+}
+
+void pf::LiquidGrid::Drain(int x, int y) {
+    int tile = xy(x, y);
+    if (levels[tile]) {
+        levels[tile] = 0;
+        MarkUnsent(y / pf::World::LIQUID_CHUNK * chunksX + x / pf::World::LIQUID_CHUNK);
+    }
+    sent[tile] = 0;
+}
+
+void pf::LiquidGrid::Activate(int minX, int minY, int maxX, int maxY) {
+    for (int chunkY = minY / pf::World::LIQUID_CHUNK; chunkY <= maxY / pf::World::LIQUID_CHUNK; chunkY++)
+        for (int chunkX = minX / pf::World::LIQUID_CHUNK; chunkX <= maxX / pf::World::LIQUID_CHUNK; chunkX++)
+            ActivateChunk(chunkX, chunkY);
+}
+
+void pf::LiquidGrid::SetSimulation(bool enabled) {
+    if (enabled == simulation) return;
+    simulation = enabled;
+
+    // Nothing is woken while it's off, so whatever holds liquid by the time
+    // it's back on has to be looked at again
+    if (!enabled) {
+        for (int i = 0; i < activeChunks.size(); i++)
+            chunkFlags[activeChunks[i]] &= ~CHUNK_ACTIVE;
+        activeChunks.clear();
+        return;
+    }
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            if (levels[xy(x, y)] && !(chunkFlags[y / pf::World::LIQUID_CHUNK * chunksX + x / pf::World::LIQUID_CHUNK] & CHUNK_ACTIVE))
+                ActivateChunk(x / pf::World::LIQUID_CHUNK, y / pf::World::LIQUID_CHUNK);
+}
+
+int pf::LiquidGrid::GetActiveCount() {
+    return activeChunks.size();
+}
+
+void pf::LiquidGrid::TakeDeltas(std::vector<pf::LiquidDelta>& deltas) {
+    deltas.clear();
+    for (int i = 0; i < unsentChunks.size(); i++) {
+        int chunk = unsentChunks[i];
+        chunkFlags[chunk] &= ~CHUNK_UNSENT;
+
+        pf::LiquidDelta delta;
+        delta.chunkX = chunk % chunksX;
+        delta.chunkY = chunk / chunksX;
+        int minX = delta.chunkX * pf::World::LIQUID_CHUNK, maxX = std::min(minX + pf::World::LIQUID_CHUNK, width);
+        int minY = delta.chunkY * pf::World::LIQUID_CHUNK, maxY = std::min(minY + pf::World::LIQUID_CHUNK, height);
+        for (int y = minY; y < maxY; y++) {
+            for (int x = minX; x < maxX; x++) {
+                int tile = xy(x, y);
+                if (levels[tile] == sent[tile]) continue;
+
+                delta.cells.push_back((y - minY) * pf::World::LIQUID_CHUNK + x - minX);
+                delta.cells.push_back(levels[tile]);
+                sent[tile] = levels[tile];
+            }
+        }
+
+        if (!delta.cells.empty()) deltas.push_back(delta);
+    }
+    unsentChunks.clear();
+}
+
+void pf::LiquidGrid::GetSnapshot(std::vector<pf::LiquidDelta>& deltas) {
+    deltas.clear();
+    for (int chunk = 0; chunk < chunkFlags.size(); chunk++) {
+        if (!(chunkFlags[chunk] & CHUNK_TOUCHED)) continue;
+
+        pf::LiquidDelta delta;
+        delta.chunkX = chunk % chunksX;
+        delta.chunkY = chunk / chunksX;
+        int minX = delta.chunkX * pf::World::LIQUID_CHUNK, maxX = std::min(minX + pf::World::LIQUID_CHUNK, width);
+        int minY = delta.chunkY * pf::World::LIQUID_CHUNK, maxY = std::min(minY + pf::World::LIQUID_CHUNK, height);
+        for (int y = minY; y < maxY; y++) {
+            for (int x = minX; x < maxX; x++) {
+                delta.cells.push_back((y - minY) * pf::World::LIQUID_CHUNK + x - minX);
+                delta.cells.push_back(levels[xy(x, y)]);
+            }
+        }
+        deltas.push_back(delta);
+    }
+}
+
+void pf::LiquidGrid::Step(float frametime, pf::JobPool *pool, std::vector<int>& flipped) {
+    // Nothing's flowing, so there's nothing to do
+    if (!simulation || activeChunks.empty()) {
+        credit = 0.f;
+        return;
+    }
+
+    credit = std::min(credit + frametime, pf::World::LIQUID_STEP * pf::World::MAX_LIQUID_STEPS);
+    while (credit >= pf::World::LIQUID_STEP && !activeChunks.empty()) {
+        credit -= pf::World::LIQUID_STEP;
+
+        // Every pass reads the levels as they were before it and each chunk
+        // only writes its own tiles, so chunks can go in any order
+        RunPass(PASS_FALL, pool);
+        RunPass(PASS_COMMIT, pool);
+        RunPass(PASS_SPREAD, pool);
+        RunPass(PASS_COMMIT, pool);
+
+        // Liquid can only have reached the chunks around wherever it moved,
+        // so those are all the next step looks at
+        chunkScratch.swap(activeChunks);
+        activeChunks.clear();
+        for (int i = 0; i < chunkScratch.size(); i++)
+            chunkFlags[chunkScratch[i]] &= ~CHUNK_ACTIVE;
+        for (int i = 0; i < chunkScratch.size(); i++) {
+            int chunk = chunkScratch[i];
+            uint8_t flags = chunkFlags[chunk];
+            chunkFlags[chunk] &= ~(CHUNK_MOVED | CHUNK_FLIPPED);
+            if (!(flags & CHUNK_MOVED)) continue;
+
+            ActivateChunk(chunk % chunksX, chunk / chunksX);
+            MarkUnsent(chunk);
+            if (flags & CHUNK_FLIPPED) flipped.push_back(chunk);
+        }
+        std::sort(activeChunks.begin(), activeChunks.end());
+    }
+}
+
+void pf::LiquidGrid::RunPass(int pass, pf::JobPool *pool) {
+    int count = activeChunks.size();
+    if (!pool || pool->GetThreadCount() < 2 || count < pf::World::LIQUID_CHUNKS_PER_JOB * 2) {
+        for (int i = 0; i < count; i++)
+            Flow(activeChunks[i], pass);
+        return;
+    }
+
+    jobList.clear();
+    for (int begin = 0; begin < count; begin += pf::World::LIQUID_CHUNKS_PER_JOB) {
+        if (jobList.size() == jobs.size())
+            jobs.push_back(new FlowJob(this));
+        FlowJob *job = jobs[jobList.size()];
+        job->pass = pass;
+        job->begin = begin;
+        job->end = std::min(begin + pf::World::LIQUID_CHUNKS_PER_JOB, count);
+        jobList.push_back(job);
+    }
+    pool->Run(&jobList[0], jobList.size());
+}
+
+void pf::LiquidGrid::Flow(int chunk, int pass) {
+    int minX = chunk % chunksX * pf::World::LIQUID_CHUNK, maxX = std::min(minX + pf::World::LIQUID_CHUNK, width);
+    int minY = chunk / chunksX * pf::World::LIQUID_CHUNK, maxY = std::min(minY + pf::World::LIQUID_CHUNK, height);
+    bool moved = false, flipped = false;
+
+    for (int y = minY; y < maxY; y++) {
+        for (int x = minX; x < maxX; x++) {
+            int tile = xy(x, y);
+            if (pass == PASS_COMMIT) {
+                if (next[tile] == levels[tile]) continue;
+                if (!next[tile] || !levels[tile]) {
+                    tiles[tile] = next[tile] ? liquidTile : 0;
+                    flipped = true;
+                }
+                levels[tile] = next[tile];
+                continue;
+            }
+
+            // Each flow is worked out the same way from both of its tiles,
+            // so what leaves one always arrives in the other
+            int level = levels[tile];
+            if (pass == PASS_FALL) {
+                int in = Fall(x, y - 1), out = Fall(x, y);
+                level += in - out;
+                moved = moved || in || out;
+            } else {
+                int left = Spread(x - 1, x, y), right = Spread(x + 1, x, y);
+                level += left + right;
+                moved = moved || left || right;
+            }
+            next[tile] = level;
+        }
+    }
+
+    if (moved) chunkFlags[chunk] |= CHUNK_MOVED;
+    if (flipped) chunkFlags[chunk] |= CHUNK_FLIPPED;
+}
+
+bool pf::LiquidGrid::Holds(int x, int y) {
+    if (x < 0 || y < 0 || x >= width || y >= height || !liquidTile)
+        return false;
+
+    pf::TileCell tile = tiles[xy(x, y)];
+    return !tile || (tile & pf::World::TILE_LIQUID);
+}
+
+bool pf::LiquidGrid::Settled(int x, int y) {
+    return !Holds(x, y + 1) || levels[xy(x, y + 1)] == pf::World::LIQUID_FULL;
+}
+
+int pf::LiquidGrid::Fall(int x, int y) {
+    if (!Holds(x, y) || !Holds(x, y + 1)) return 0;
+    return std::min((int)levels[xy(x, y)], pf::World::LIQUID_FULL - levels[xy(x, y + 1)]);
+}
+
+int pf::LiquidGrid::Spread(int fromX, int toX, int y) {
+    // Only liquid that can't fall any further spreads, a third of the
+    // difference at a time
+    if (!Holds(fromX, y) || !Holds(toX, y)) return 0;
+
+    int from = levels[xy(fromX, y)], to = levels[xy(toX, y)];
+    if (from > to && Settled(fromX, y)) return (from - to) / 3;
+    if (to > from && Settled(toX, y)) return -((to - from) / 3);
+    return 0;
+}
+
+void pf::LiquidGrid::ActivateChunk(int chunkX, int chunkY) {
+    if (!simulation) return;
+
+    for (int y = std::max(chunkY - 1, 0); y <= std::min(chunkY + 1, chunksY - 1); y++) {
+        for (int x = std::max(chunkX - 1, 0); x <= std::min(chunkX + 1, chunksX - 1); x++) {
+            int chunk = y * chunksX + x;
+            if (chunkFlags[chunk] & CHUNK_ACTIVE) continue;
+
+            chunkFlags[chunk] |= CHUNK_ACTIVE;
+            activeChunks.push_back(chunk);
+        }
+    }
+}
+
+void pf::LiquidGrid::MarkUnsent(int chunk) {
+    if (!(chunkFlags[chunk] & CHUNK_UNSENT))
+        unsentChunks.push_back(chunk);
+    chunkFlags[chunk] |= CHUNK_UNSENT | CHUNK_TOUCHED;
+}
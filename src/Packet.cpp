@@ -23,113 +23,107 @@
 #include "CharacterSkin.h"
 #include "Animation.h"
 #include "Character.h"
+#include "Elevator.h"
 #include "Logger.h"
+#include "Latency.h"
+#include "Delta.h"
 #include <SFML/Network.hpp>
 
-pf::Packet::PacketString::PacketString(sf::SocketTCP *socket) {
-    std::size_t read;
-    socket->Receive((char *)&length, sizeof(length), read);
-    string = new char[length + 1];
-    string[length] = 0;
-    socket->Receive(string, length, read);
-}
-
-void pf::Packet::PacketString::Send(sf::SocketTCP *socket) {
-    socket->Send((const char *)&length, sizeof(length));
-    socket->Send(string, length);
-}
-
-pf::Packet::LoginRequest::LoginRequest(sf::SocketTCP *socket) {
-    std::size_t read;
-    socket->Receive((char *)&clientProtocolVersion, sizeof(clientProtocolVersion), read);
-    username = new PacketString(socket);
-}
-
-void pf::Packet::LoginRequest::Send(sf::SocketTCP *socket) {
-    char type = packetType;
-    socket->Send((const char *)&type, sizeof(type));
-    socket->Send((const char *)&clientProtocolVersion, sizeof(clientProtocolVersion));
-    username->Send(socket);
-}
-
-pf::Packet::Kick::Kick(sf::SocketTCP *socket) {
-    reason = new PacketString(socket);
+bool pf::Packet::SendAll(sf::SocketTCP *socket, const char *data, std::size_t length) {
+    return socket->Send(data, length) == sf::Socket::Done;
 }
 
-void pf::Packet::Kick::Send(sf::SocketTCP *socket) {
-    char type = packetType;
-    socket->Send((const char *)&type, sizeof(type));
-    reason->Send(socket);
-}
+bool pf::Packet::ReceiveAll(sf::SocketTCP *socket, char *data, std::size_t length) {
+    std::size_t received = 0, read;
 
-pf::Packet::BeginLoad::BeginLoad(sf::SocketTCP *socket) {
-    std::size_t read;
-    socket->Receive((char *)&numResources, sizeof(numResources), read);
-}
+    while (received < length) {
+        if (socket->Receive(data + received, length - received, read) != sf::Socket::Done) {
+            memset(data + received, 0, length - received);
+            return false;
+        }
+        received += read;
+    }
 
-void pf::Packet::BeginLoad::Send(sf::SocketTCP *socket) {
-    char type = packetType;
-    socket->Send((const char *)&type, sizeof(type));
-    socket->Send((const char *)&numResources, sizeof(numResources));
-    pf::Logger::LogInfo("Send BEGINLOAD with numResources: %d", numResources);
+    return true;
 }
 
-pf::Packet::EndLoad::EndLoad(sf::SocketTCP *socket) {}
+bool pf::Packet::ReceiveLength(sf::SocketTCP *socket, uint32_t& length) {
+    length = 0;
+    if (!ReceiveAll(socket, (char *)&length, sizeof(length)))
+        return false;
+    if (length <= (uint32_t)pf::Resource::MAX_LENGTH)
+        return true;
 
-void pf::Packet::EndLoad::Send(sf::SocketTCP *socket) {
-    char type = packetType;
-    socket->Send((const char *)&type, sizeof(type));
+    pf::Logger::LogError("Discarding a %u byte blob, which is over the limit", length);
+    char discard[4096];
+    while (length) {
+        uint32_t chunk = length < sizeof(discard) ? length : sizeof(discard);
+        if (!ReceiveAll(socket, discard, chunk)) break;
+        length -= chunk;
+    }
+    length = 0;
+    return false;
 }
 
-pf::Packet::Resource::Resource(sf::SocketTCP *socket) {
-    filename = new PacketString(socket);
-    std::size_t read;
-    socket->Receive((char *)&length, sizeof(length), read);
-    data = new char[length];
-    socket->Receive(data, length, read);
+pf::Packet::PacketString::PacketString(sf::SocketTCP *socket) {
+    length = 0;
+    ReceiveAll(socket, (char *)&length, sizeof(length));
+    string = new char[length + 1];
+    string[length] = 0;
+    ReceiveAll(socket, string, length);
 }
 
 pf::Packet::Resource::Resource(pf::Resource *resource) {
+    this->resource = resource;
     this->filename = new PacketString(resource->GetFilename());
     this->length = resource->GetLength();
     this->data = resource->GetData();
 }
 
 void pf::Packet::Resource::Send(sf::SocketTCP *socket) {
-    char type = packetType;
-    socket->Send((const char *)&type, sizeof(type));
-    filename->Send(socket);
-    socket->Send((const char *)&length, sizeof(length));
-    socket->Send(data, length);
+    length = resource->GetLength();
+    data = resource->GetData();
+    Schema::SendFields<Header>(*this, socket);
+    SendAll(socket, data, length);
 }
 
 pf::Resource *pf::Packet::Resource::GetResource() {
-    char *newFilename = new char[filename->length + 1];
-    strcpy(newFilename, filename->string);
-    char *newData = new char[length];
-    memcpy(newData, data, length);
+    // Hand the received buffers over to the resource rather than copying them
+    char *newFilename = filename->string;
+    char *newData = data;
+    filename->string = NULL;
+    data = NULL;
     return new pf::Resource(newFilename, newData, length);
 }
 
-pf::Packet::Property::Property(sf::SocketTCP *socket) {
-    name = new PacketString(socket);
-    value = new PacketString(socket);
+pf::Packet::ResourcePatch::ResourcePatch(pf::Resource *resource, uint32_t baseChecksum, const char *patch, uint32_t length) {
+    this->filename = new PacketString(resource->GetFilename());
+    this->baseChecksum = baseChecksum;
+    this->targetChecksum = pf::Delta::Checksum(resource->GetData(), resource->GetLength());
+    this->targetLength = resource->GetLength();
+    this->length = length;
+    this->patch = new char[length];
+    if (length) memcpy(this->patch, patch, length);
 }
 
-void pf::Packet::Property::Send(sf::SocketTCP *socket) {
-    char type = packetType;
-    socket->Send((const char *)&type, sizeof(type));
-    name->Send(socket);
-    value->Send(socket);
-}
+bool pf::Packet::ResourcePatch::Apply(pf::Resource *resource) {
+    uint32_t checksum = pf::Delta::Checksum(resource->GetData(), resource->GetLength());
+
+    // Already up to date (it was downloaded after the change)
+    if (checksum == targetChecksum && (uint32_t)resource->GetLength() == targetLength)
+        return true;
+
+    if (checksum != baseChecksum)
+        return false;
 
-pf::Packet::SpawnCharacter::SpawnCharacter(sf::SocketTCP *socket) {
-    std::size_t read;
-    socket->Receive((char *)&entityID, sizeof(entityID), read);
-    username = new PacketString(socket);
-    skin = new PacketString(socket);
-    socket->Receive((char *)&x, sizeof(x), read);
-    socket->Receive((char *)&y, sizeof(y), read);
+    char *newData = pf::Delta::Apply(resource->GetData(), resource->GetLength(), patch, length, targetLength);
+    if (!newData || pf::Delta::Checksum(newData, targetLength) != targetChecksum) {
+        delete [] newData;
+        return false;
+    }
+
+    resource->SetData(newData, targetLength);
+    return true;
 }
 
 pf::Packet::SpawnCharacter::SpawnCharacter(pf::Character *character) {
@@ -140,24 +134,116 @@ pf::Packet::SpawnCharacter::SpawnCharacter(pf::Character *character) {
     y = character->GetY();
 }
 
-void pf::Packet::SpawnCharacter::Send(sf::SocketTCP *socket) {
-    char type = packetType;
-    socket->Send((const char *)&type, sizeof(type));
-    socket->Send((const char *)&entityID, sizeof(entityID));
-    username->Send(socket);
-    skin->Send(socket);
-    socket->Send((const char *)&x, sizeof(x));
-    socket->Send((const char *)&y, sizeof(y));
-}
-
-pf::Packet::CharacterSkin::CharacterSkin(sf::SocketTCP *socket) {
-    std::size_t read;
-    name = new PacketString(socket);
-    resource = new PacketString(socket);
-    socket->Receive((char *)&width, sizeof(width), read);
-    socket->Receive((char *)&height, sizeof(height), read);
-    socket->Receive((char *)&framerate, sizeof(framerate), read);
-    socket->Receive((char *)&frames, sizeof(frames), read);
+pf::Packet::SpawnMover::SpawnMover(pf::Elevator *mover, pf::World *world) {
+    this->mover = mover;
+    this->world = world;
+    entityID = mover->GetID();
+    image = new PacketString(mover->GetImageResource()->GetFilename());
+    mode = mover->GetPathMode();
+    speed = mover->GetSpeed();
+    serverTime = 0;
+    elapsed = 0;
+
+    int count = mover->GetWaypointCount();
+    length = count * 2 * sizeof(uint16_t);
+    waypoints = new char[length];
+    uint16_t *out = (uint16_t *)waypoints;
+    for (int i = 0; i < count; i++) {
+        out[i * 2] = mover->GetWaypointX(i);
+        out[i * 2 + 1] = mover->GetWaypointY(i);
+    }
+}
+
+void pf::Packet::SpawnMover::Send(sf::SocketTCP *socket) {
+    // The server's world runs on its clock, in seconds
+    serverTime = pf::Latency::GetTime();
+    elapsed = (uint32_t)(serverTime - mover->GetPathStart() * 1000.0);
+    SchemaPacket<SpawnMover, 0x15>::Send(socket);
+}
+
+pf::Elevator *pf::Packet::SpawnMover::GetElevator(pf::World *world) {
+    const uint16_t *in = (const uint16_t *)waypoints;
+    int count = length / (2 * sizeof(uint16_t));
+
+    pf::Elevator *mover = new pf::Elevator(world, pf::Resource::GetOrLoadResource(image->string),
+                                           count ? in[0] : 0, count ? in[1] : 0);
+    mover->SetID(entityID);
+    mover->ClearWaypoints();
+    for (int i = 0; i < count; i++)
+        mover->AddWaypoint(in[i * 2], in[i * 2 + 1]);
+    mover->SetPathMode(mode);
+    mover->SetSpeed(speed);
+    mover->SetPathStart(((double)serverTime - elapsed) / 1000.0);
+
+    return mover;
+}
+
+pf::Packet::LiquidChunk::LiquidChunk(const pf::LiquidDelta& delta) {
+    chunkX = delta.chunkX;
+    chunkY = delta.chunkY;
+    length = delta.cells.size();
+    cells = new char[length];
+    if (length) memcpy(cells, &delta.cells[0], length);
+}
+
+void pf::Packet::LiquidChunk::Apply(pf::World *world) {
+    const uint8_t *in = (const uint8_t *)cells;
+    for (int i = 0; i + 1 < length; i += 2) {
+        world->SetLiquid(chunkX * pf::World::LIQUID_CHUNK + in[i] % pf::World::LIQUID_CHUNK,
+                         chunkY * pf::World::LIQUID_CHUNK + in[i] / pf::World::LIQUID_CHUNK,
+                         in[i + 1]);
+    }
+}
+
+pf::Packet::TileEdits::TileEdits(const std::vector<pf::TileRun>& edits, bool crumble) {
+    this->crumble = crumble;
+
+    std::vector<uint8_t> out;
+    int end = 0;
+    for (int i = 0; i < edits.size(); i++) {
+        uint32_t values[2];
+        values[0] = (uint32_t)(edits[i].start - end);
+        values[1] = (uint32_t)edits[i].count;
+        for (int j = 0; j < 2; j++) {
+            uint32_t value = values[j];
+            while (value >= 0x80) {
+                out.push_back((value & 0x7F) | 0x80);
+                value >>= 7;
+            }
+            out.push_back(value);
+        }
+        out.push_back(edits[i].index + 1);
+        end = edits[i].start + edits[i].count;
+    }
+
+    length = out.size();
+    runs = new char[length];
+    if (length) memcpy(runs, &out[0], length);
+}
+
+void pf::Packet::TileEdits::Apply(pf::World *world) {
+    const uint8_t *in = (const uint8_t *)runs, *inEnd = in + length;
+    int width = world->GetWidth(), count = width * world->GetHeight(), end = 0;
+    while (in < inEnd) {
+        uint32_t values[2] = { 0, 0 };
+        for (int j = 0; j < 2; j++) {
+            for (int shift = 0; in < inEnd && shift < 32; shift += 7) {
+                values[j] |= (uint32_t)(*in & 0x7F) << shift;
+                if (!(*in++ & 0x80)) break;
+            }
+        }
+        if (in >= inEnd || values[0] > count - end || values[1] > count - end - values[0]) return;
+        int index = *in++ - 1;
+
+        int start = end + values[0];
+        end = start + values[1];
+        for (int tile = start; tile < end; tile++) {
+            if (index < 0 && crumble)
+                world->RemoveTile(tile % width, tile / width);
+            else
+                world->SetTile(tile % width, tile / width, index);
+        }
+    }
 }
 
 pf::Packet::CharacterSkin::CharacterSkin(pf::CharacterSkin *skin) {
@@ -173,75 +259,20 @@ pf::CharacterSkin *pf::Packet::CharacterSkin::GetCharacterSkin() {
     return new pf::CharacterSkin(name->string, pf::Resource::GetOrLoadResource(resource->string), framerate, frames);
 }
 
-void pf::Packet::CharacterSkin::Send(sf::SocketTCP *socket) {
-    char type = packetType;
-    socket->Send((const char *)&type, sizeof(type));
-    name->Send(socket);
-    resource->Send(socket);
-    socket->Send((const char *)&width, sizeof(width));
-    socket->Send((const char *)&height, sizeof(height));
-    socket->Send((const char *)&framerate, sizeof(framerate));
-    socket->Send((const char *)&frames, sizeof(frames));
-}
-
-pf::Packet::StartWorld::StartWorld(sf::SocketTCP *socket) {}
-
-void pf::Packet::StartWorld::Send(sf::SocketTCP *socket) {
-    char type = packetType;
-    socket->Send((const char *)&type, sizeof(type));
-}
-
-pf::Packet::SetCharacter::SetCharacter(sf::SocketTCP *socket) {
-    std::size_t read;
-    socket->Receive((char *)&entityID, sizeof(entityID), read);
-}
-
 pf::Packet::SetCharacter::SetCharacter(pf::Character *character) {
     entityID = character->GetID();
 }
 
-void pf::Packet::SetCharacter::Send(sf::SocketTCP *socket) {
-    char type = packetType;
-    socket->Send((const char *)&type, sizeof(type));
-    socket->Send((const char *)&entityID, sizeof(entityID));
-}
-
-pf::Packet::DespawnEntity::DespawnEntity(sf::SocketTCP *socket) {
-    std::size_t read;
-    socket->Receive((char *)&entityID, sizeof(entityID), read);
-}
-
 pf::Packet::DespawnEntity::DespawnEntity(pf::Entity *entity) {
     entityID = entity->GetID();
 }
 
-void pf::Packet::DespawnEntity::Send(sf::SocketTCP *socket) {
-    char type = packetType;
-    socket->Send((const char *)&type, sizeof(type));
-    socket->Send((const char *)&entityID, sizeof(entityID));
-}
-
-pf::Packet::CharacterAnimation::CharacterAnimation(sf::SocketTCP *socket) {
-    std::size_t read;
-    socket->Receive((char *)&data, sizeof(data), read);
-    if (ShouldGotoFrame())
-        socket->Receive((char *)&frame, sizeof(frame), read);
-}
-
 pf::Packet::CharacterAnimation::CharacterAnimation(pf::Character *character) {
     pf::Animation *animation = character->GetImage();
     data = MakeData(character->GetDirection() == pf::Character::RIGHT, animation->IsPlaying(), !animation->IsPlaying());
     frame = animation->GetCurrentFrame();
 }
 
-void pf::Packet::CharacterAnimation::Send(sf::SocketTCP *socket) {
-    char type = packetType;
-    socket->Send((const char *)&type, sizeof(type));
-    socket->Send((const char *)&data, sizeof(data));
-    if (ShouldGotoFrame())
-        socket->Send((const char *)&frame, sizeof(frame));
-}
-
 bool pf::Packet::CharacterAnimation::IsFacingRight() {
     return data & 0x01;
 }
@@ -254,30 +285,13 @@ bool pf::Packet::CharacterAnimation::ShouldGotoFrame() {
     return data & 0x04;
 }
 
-pf::Packet::OtherCharacterAnimation::OtherCharacterAnimation(sf::SocketTCP *socket) {
-    std::size_t read;
-    socket->Receive((char *)&entityID, sizeof(entityID), read);
-    socket->Receive((char *)&data, sizeof(data), read);
-    if (ShouldGotoFrame())
-        socket->Receive((char *)&frame, sizeof(frame), read);
-}
-
 pf::Packet::OtherCharacterAnimation::OtherCharacterAnimation(pf::Character *character) {
     pf::Animation *animation = character->GetImage();
     entityID = character->GetID();
-    data = MakeData(character->GetDirection() == pf::Character::RIGHT, animation->IsPlaying(), !animation->IsPlaying());
+    data = CharacterAnimation::MakeData(character->GetDirection() == pf::Character::RIGHT, animation->IsPlaying(), !animation->IsPlaying());
     frame = animation->GetCurrentFrame();
 }
 
-void pf::Packet::OtherCharacterAnimation::Send(sf::SocketTCP *socket) {
-    char type = packetType;
-    socket->Send((const char *)&type, sizeof(type));
-    socket->Send((const char *)&entityID, sizeof(entityID));
-    socket->Send((const char *)&data, sizeof(data));
-    if (ShouldGotoFrame())
-        socket->Send((const char *)&frame, sizeof(frame));
-}
-
 bool pf::Packet::OtherCharacterAnimation::IsFacingRight() {
     return data & 0x01;
 }
@@ -290,69 +304,20 @@ bool pf::Packet::OtherCharacterAnimation::ShouldGotoFrame() {
     return data & 0x04;
 }
 
-pf::Packet::TeleportEntity::TeleportEntity(sf::SocketTCP *socket) {
-    std::size_t read;
-    socket->Receive((char *)&entityID, sizeof(entityID), read);
-    socket->Receive((char *)&x, sizeof(x), read);
-    socket->Receive((char *)&y, sizeof(y), read);
-}
-
-pf::Packet::TeleportEntity::TeleportEntity(pf::Entity *entity) {
+pf::Packet::TeleportEntity::TeleportEntity(uint32_t tick, pf::Entity *entity) {
+    this->tick = tick;
     entityID = entity->GetID();
     x = entity->GetX();
     y = entity->GetY();
 }
 
-void pf::Packet::TeleportEntity::Send(sf::SocketTCP *socket) {
-    char type = packetType;
-    socket->Send((const char *)&type, sizeof(type));
-    socket->Send((const char *)&entityID, sizeof(entityID));
-    socket->Send((const char *)&x, sizeof(x));
-    socket->Send((const char *)&y, sizeof(y));
-}
-
-pf::Packet::AbsoluteMove::AbsoluteMove(sf::SocketTCP *socket) {
-    std::size_t read;
-    socket->Receive((char *)&x, sizeof(x), read);
-    socket->Receive((char *)&y, sizeof(y), read);
-}
-
-pf::Packet::AbsoluteMove::AbsoluteMove(pf::Entity *entity) {
+pf::Packet::AbsoluteMove::AbsoluteMove(uint32_t tick, pf::Entity *entity) {
+    this->tick = tick;
     x = entity->GetX();
     y = entity->GetY();
 }
 
-void pf::Packet::AbsoluteMove::Send(sf::SocketTCP *socket) {
-    char type = packetType;
-    socket->Send((const char *)&type, sizeof(type));
-    socket->Send((const char *)&x, sizeof(x));
-    socket->Send((const char *)&y, sizeof(y));
-}
-
-pf::Packet::Health::Health(sf::SocketTCP *socket) {
-    std::size_t read;
-    socket->Receive((char *)&entityID, sizeof(entityID), read);
-    socket->Receive((char *)&health, sizeof(health), read);
-}
-
 pf::Packet::Health::Health(pf::Character *character) {
     entityID = character->GetID();
     health = (int)character->GetHealth();
 }
-
-void pf::Packet::Health::Send(sf::SocketTCP *socket) {
-    char type = packetType;
-    socket->Send((const char *)&type, sizeof(type));
-    socket->Send((const char *)&entityID, sizeof(entityID));
-    socket->Send((const char *)&health, sizeof(health));
-}
-
-pf::Packet::Chat::Chat(sf::SocketTCP *socket) {
-    message = new PacketString(socket);
-}
-
-void pf::Packet::Chat::Send(sf::SocketTCP *socket) {
-    char type = packetType;
-    socket->Send((const char *)&type, sizeof(type));
-    message->Send(socket);
-}
@@ -63,6 +63,6 @@ void pf::Particle::Tick(float frametime) {
 }
 
 void pf::Particle::Render(sf::RenderTarget &target) {
-    image->SetPosition(x, y);
+    image->SetPosition(GetX(), GetY());
     image->Render(target);
 }
\ No newline at end of file
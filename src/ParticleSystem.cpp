@@ -0,0 +1,365 @@
+/*
+ * ParticleSystem.cpp
+ * Pooled, vectorized particles that collide with the tile grid
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "ParticleSystem.h"
+#include "PhysicsEntity.h"
+#include "Logger.h"
+#include <SFML/System.hpp>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Number of component arrays sharing the aligned storage block
+#define COMPONENT_COUNT 8
+
+static inline bool SolidAt(const pf::TileCell *tiles, int width, int height, float x, float y) {
+    if (x < 0.f || y < 0.f) return false;
+
+    int tileX = (int)(x / pf::World::TILE_SIZE), tileY = (int)(y / pf::World::TILE_SIZE);
+    if (tileX >= width || tileY >= height) return false;
+
+    return (tiles[tileY * width + tileX] & pf::World::TILE_SOLID) != 0;
+}
+
+#ifdef __SSE2__
+// All bits set in each lane whose point is in a solid tile. The arithmetic is
+// vectorized; the tile lookups can't be without a gather instruction.
+static inline __m128 SolidMask(const pf::TileCell *tiles, int width, int height, __m128 x, __m128 y) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 inverseTile = _mm_set1_ps(1.f / pf::World::TILE_SIZE);
+
+    // Truncation only floors non-negative values, so the rest are ruled out
+    __m128 inside = _mm_and_ps(_mm_cmpge_ps(x, zero), _mm_cmpge_ps(y, zero));
+    __m128i tileX = _mm_cvttps_epi32(_mm_mul_ps(x, inverseTile));
+    __m128i tileY = _mm_cvttps_epi32(_mm_mul_ps(y, inverseTile));
+    inside = _mm_and_ps(inside, _mm_castsi128_ps(_mm_cmplt_epi32(tileX, _mm_set1_epi32(width))));
+    inside = _mm_and_ps(inside, _mm_castsi128_ps(_mm_cmplt_epi32(tileY, _mm_set1_epi32(height))));
+
+    int32_t columns[4], rows[4], insideBits = _mm_movemask_ps(inside);
+    _mm_storeu_si128((__m128i*)columns, tileX);
+    _mm_storeu_si128((__m128i*)rows, tileY);
+
+    int32_t solid[4];
+    for (int lane = 0; lane < 4; lane++)
+        solid[lane] = ((insideBits >> lane) & 1) && (tiles[rows[lane] * width + columns[lane]] & pf::World::TILE_SOLID) ? -1 : 0;
+
+    return _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)solid));
+}
+
+static inline __m128 Select(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+#endif
+
+pf::ParticleSystem::ParticleSystem(int capacity) {
+    // Round up so the vector loop never needs a scalar tail
+    this->capacity = (capacity + 3) & ~3;
+    count = 0;
+
+    storage = new float[this->capacity * COMPONENT_COUNT + 3];
+    float *base = (float*)(((uintptr_t)storage + 15) & ~(uintptr_t)15);
+    memset(base, 0, sizeof(float) * this->capacity * COMPONENT_COUNT);
+    x = base;
+    y = x + this->capacity;
+    veloX = y + this->capacity;
+    veloY = veloX + this->capacity;
+    age = veloY + this->capacity;
+    life = age + this->capacity;
+    gravity = life + this->capacity;
+    bounce = gravity + this->capacity;
+    color.resize(this->capacity);
+
+    emitters.resize(MAX_EMITTERS);
+    emitterCredit.resize(MAX_EMITTERS, 0.f);
+    emitterUsed.resize(MAX_EMITTERS, false);
+
+    canvas = new sf::Image();
+    canvas->SetSmooth(false);
+    canvasSprite = new sf::Sprite();
+}
+
+pf::ParticleSystem::~ParticleSystem() {
+    delete [] storage;
+    delete canvasSprite;
+    delete canvas;
+}
+
+int pf::ParticleSystem::AddEmitter(const pf::ParticleEmitter& emitter) {
+    for (int i = 0; i < MAX_EMITTERS; i++) {
+        if (emitterUsed[i]) continue;
+
+        emitters[i] = emitter;
+        emitterCredit[i] = 0.f;
+        emitterUsed[i] = true;
+        return i;
+    }
+
+    return -1;
+}
+
+pf::ParticleEmitter *pf::ParticleSystem::GetEmitter(int id) {
+    if (id < 0 || id >= MAX_EMITTERS || !emitterUsed[id])
+        return NULL;
+
+    return &emitters[id];
+}
+
+void pf::ParticleSystem::RemoveEmitter(int id) {
+    if (id >= 0 && id < MAX_EMITTERS)
+        emitterUsed[id] = false;
+}
+
+bool pf::ParticleSystem::Emit(float x, float y, float veloX, float veloY, float life, float gravity, float bounce, sf::Color color) {
+    if (count >= capacity) return false;
+
+    int i = count++;
+    this->x[i] = x;
+    this->y[i] = y;
+    this->veloX[i] = veloX;
+    this->veloY[i] = veloY;
+    this->age[i] = 0.f;
+    this->life[i] = life;
+    this->gravity[i] = gravity;
+    this->bounce[i] = bounce;
+
+    sf::Uint8 rgba[4] = { color.r, color.g, color.b, color.a };
+    memcpy(&this->color[i], rgba, sizeof(rgba));
+
+    return true;
+}
+
+int pf::ParticleSystem::GetCount() {
+    return count;
+}
+
+int pf::ParticleSystem::GetCapacity() {
+    return capacity;
+}
+
+void pf::ParticleSystem::Tick(float frametime, const pf::TileCell *tiles, int width, int height) {
+    Spawn(frametime);
+    Step(frametime, tiles, width, height);
+    Expire(width, height);
+}
+
+void pf::ParticleSystem::Spawn(float frametime) {
+    for (int i = 0; i < MAX_EMITTERS; i++) {
+        if (!emitterUsed[i]) continue;
+        pf::ParticleEmitter& emitter = emitters[i];
+
+        // Carry fractions of a particle over to the next tick
+        emitterCredit[i] += emitter.rate * frametime;
+        int spawning = (int)emitterCredit[i];
+        emitterCredit[i] -= spawning;
+
+        for (int j = 0; j < spawning; j++) {
+            float angle = emitter.direction + sf::Randomizer::Random(-emitter.spread, emitter.spread);
+            float speed = emitter.speed * sf::Randomizer::Random(0.5f, 1.f);
+            if (!Emit(emitter.x, emitter.y,
+                      std::cos(angle) * speed, std::sin(angle) * speed,
+                      emitter.life, emitter.gravity, emitter.bounce, emitter.color))
+                break;
+        }
+
+        if (emitter.duration >= 0.f) {
+            emitter.duration -= frametime;
+            if (emitter.duration < 0.f)
+                emitterUsed[i] = false;
+        }
+    }
+}
+
+void pf::ParticleSystem::Step(float frametime, const pf::TileCell *tiles, int width, int height) {
+    const float fall = pf::PhysicsEntity::GRAVITY * frametime;
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128 dt = _mm_set1_ps(frametime);
+    const __m128 fallV = _mm_set1_ps(fall);
+    const __m128 friction = _mm_set1_ps(FLOOR_FRICTION);
+    const __m128 signBit = _mm_set1_ps(-0.f);
+
+    // Lanes past the end are integrated too; they're never read
+    for (; i < count; i += 4) {
+        __m128 px = _mm_load_ps(x + i), py = _mm_load_ps(y + i);
+        __m128 vx = _mm_load_ps(veloX + i), vy = _mm_load_ps(veloY + i);
+
+        vy = _mm_add_ps(vy, _mm_mul_ps(_mm_load_ps(gravity + i), fallV));
+        __m128 nx = _mm_add_ps(px, _mm_mul_ps(vx, dt));
+        __m128 ny = _mm_add_ps(py, _mm_mul_ps(vy, dt));
+        _mm_store_ps(age + i, _mm_add_ps(_mm_load_ps(age + i), dt));
+
+        if (tiles) {
+            // Resolve one axis at a time so a particle never ends up in a
+            // tile: sideways first, then down with whatever x survived
+            __m128 hit = SolidMask(tiles, width, height, nx, ny);
+            if (_mm_movemask_ps(hit)) {
+                __m128 b = _mm_load_ps(bounce + i);
+
+                __m128 hitX = _mm_and_ps(hit, SolidMask(tiles, width, height, nx, py));
+                vx = Select(hitX, _mm_xor_ps(_mm_mul_ps(vx, b), signBit), vx);
+                nx = Select(hitX, px, nx);
+
+                __m128 hitY = _mm_and_ps(hit, SolidMask(tiles, width, height, nx, ny));
+                vy = Select(hitY, _mm_xor_ps(_mm_mul_ps(vy, b), signBit), vy);
+                vx = Select(hitY, _mm_mul_ps(vx, friction), vx);
+                ny = Select(hitY, py, ny);
+            }
+        }
+
+        _mm_store_ps(x + i, nx);
+        _mm_store_ps(y + i, ny);
+        _mm_store_ps(veloX + i, vx);
+        _mm_store_ps(veloY + i, vy);
+    }
+#endif
+
+    for (; i < count; i++) {
+        veloY[i] += gravity[i] * fall;
+        float nx = x[i] + veloX[i] * frametime;
+        float ny = y[i] + veloY[i] * frametime;
+        age[i] += frametime;
+
+        if (tiles && SolidAt(tiles, width, height, nx, ny)) {
+            if (SolidAt(tiles, width, height, nx, y[i])) {
+                veloX[i] = -veloX[i] * bounce[i];
+                nx = x[i];
+            }
+            if (SolidAt(tiles, width, height, nx, ny)) {
+                veloY[i] = -veloY[i] * bounce[i];
+                veloX[i] *= FLOOR_FRICTION;
+                ny = y[i];
+            }
+        }
+
+        x[i] = nx;
+        y[i] = ny;
+    }
+}
+
+void pf::ParticleSystem::Expire(int width, int height) {
+    // Particles that fall out the bottom of the level are gone for good
+    float bottom = (height + 1) * pf::World::TILE_SIZE;
+
+    // Swap the last live particle into each dead one's place
+    for (int i = 0; i < count;) {
+        if (age[i] < life[i] && y[i] < bottom) {
+            i++;
+            continue;
+        }
+
+        int last = --count;
+        x[i] = x[last];
+        y[i] = y[last];
+        veloX[i] = veloX[last];
+        veloY[i] = veloY[last];
+        age[i] = age[last];
+        life[i] = life[last];
+        gravity[i] = gravity[last];
+        bounce[i] = bounce[last];
+        color[i] = color[last];
+    }
+}
+
+void pf::ParticleSystem::Render(sf::RenderTarget& target) {
+    if (!count) return;
+
+    // Draw onto an image covering the view, one pixel per world pixel
+    sf::FloatRect viewRect = target.GetView().GetRect();
+    int left = (int)std::floor(viewRect.Left), top = (int)std::floor(viewRect.Top);
+    int canvasWidth = (int)std::ceil(viewRect.Right) - left;
+    int canvasHeight = (int)std::ceil(viewRect.Bottom) - top;
+    if (canvasWidth <= 0 || canvasHeight <= 0) return;
+
+    canvasPixels.assign(canvasWidth * canvasHeight * 4, 0);
+    for (int i = 0; i < count; i++) {
+        int pixelX = (int)std::floor(x[i]) - left, pixelY = (int)std::floor(y[i]) - top;
+        if (pixelX < 0 || pixelY < 0 || pixelX >= canvasWidth || pixelY >= canvasHeight)
+            continue;
+
+        // Fade out over the particle's life
+        sf::Uint8 *pixel = &canvasPixels[(pixelY * canvasWidth + pixelX) * 4];
+        memcpy(pixel, &color[i], 4);
+        pixel[3] = (sf::Uint8)(pixel[3] * (1.f - age[i] / life[i]));
+    }
+
+    canvas->LoadFromPixels(canvasWidth, canvasHeight, &canvasPixels[0]);
+    canvasSprite->SetImage(*canvas);
+    canvasSprite->SetSubRect(sf::IntRect(0, 0, canvasWidth, canvasHeight));
+    canvasSprite->SetPosition(left, top);
+    target.Draw(*canvasSprite);
+}
+
+void pf::ParticleSystem::Benchmark(int particles, int ticks) {
+    const int width = 256, height = 64;
+    const float frametime = 1.f / 60.f;
+    const float life = 4.f;
+    const int emitterCount = 32;
+
+    // A floor, and scattered blocks to bounce off
+    std::vector<pf::TileCell> tiles(width * height, 0);
+    for (int tileX = 0; tileX < width; tileX++) {
+        tiles[(height - 1) * width + tileX] = 1 | pf::World::TILE_SOLID;
+        if (tileX % 8 == 4)
+            tiles[(height - 8 - tileX % 5) * width + tileX] = 1 | pf::World::TILE_SOLID;
+    }
+
+    pf::ParticleSystem system(particles + particles / 4);
+    pf::ParticleEmitter emitter;
+    emitter.y = 4 * pf::World::TILE_SIZE;
+    emitter.rate = (float)particles / life / emitterCount;
+    emitter.life = life;
+    emitter.direction = -3.14159265f / 2.f;
+    emitter.spread = 1.f;
+    emitter.speed = 200.f;
+    emitter.gravity = 1.f;
+    emitter.bounce = 0.5f;
+    emitter.color = sf::Color::White;
+    emitter.duration = -1.f;
+    for (int i = 0; i < emitterCount; i++) {
+        emitter.x = (i + 0.5f) * width * pf::World::TILE_SIZE / emitterCount;
+        system.AddEmitter(emitter);
+    }
+
+    // Run until spawning and expiring even out
+    for (float elapsed = 0.f; elapsed < life; elapsed += frametime)
+        system.Tick(frametime, &tiles[0], width, height);
+
+    sf::Clock clock;
+    double alive = 0.0;
+    for (int i = 0; i < ticks; i++) {
+        system.Tick(frametime, &tiles[0], width, height);
+        alive += system.GetCount();
+    }
+    float seconds = clock.GetElapsedTime();
+
+#ifdef __SSE2__
+    const char *kernel = "SSE2";
+#else
+    const char *kernel = "scalar";
+#endif
+    pf::Logger::LogInfo("Particle benchmark (%s): %d ticks, %d particles on average, %.3f ms per tick, %.1f million particle updates per second",
+                        kernel, ticks, (int)(alive / ticks),
+                        seconds * 1000.f / ticks,
+                        seconds > 0.f ? alive / seconds / 1000000.0 : 0.0);
+}
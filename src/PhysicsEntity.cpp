@@ -19,9 +19,21 @@
  */
 
 #include "PhysicsEntity.h"
-#include "Platform.h"
 #include "Animation.h"
+#include "Bodies.h"
 #include <vector>
+#include <algorithm>
+#include <cmath>
+
+// Cuts an offset short just inside a swept contact. Sweeps work in floats,
+// so the time is rounded to a Scalar here.
+static pf::Scalar ClipToContact(pf::Scalar offset, float time) {
+    const pf::Scalar depth = pf::PhysicsEntity::CONTACT_DEPTH;
+    pf::Scalar travel = offset * time, rest = offset - travel;
+    if (rest > depth) rest = depth;
+    if (rest < -depth) rest = -depth;
+    return travel + rest;
+}
 
 pf::PhysicsEntity::PhysicsEntity(pf::World *world)
     : pf::Entity(world) {
@@ -59,160 +71,206 @@ pf::PhysicsEntity::~PhysicsEntity() {
 }
 
 void pf::PhysicsEntity::Init() {
-    veloX = veloY = 0.f;
+    type |= TYPE_PHYSICS;
+    bodies->flags[body] = pf::Bodies::SOLID | pf::Bodies::GRAVITY | pf::Bodies::PUSHABLE | pf::Bodies::CAN_SLEEP;
     wasHittingHorizontalSurface = false;
     wasHittingVerticalSurface = false;
-    onGround = false;
-    hitEntities = new std::vector<pf::Entity*>();
-    canUseStairs = false;
     if (image) image->Play();
 }
 
 void pf::PhysicsEntity::Tick(float frametime) {
-    static float terminalLiquidX = 5.0f;
-    static float terminalLiquidY = 5.0f;
-
-    hitEntities->clear();
-
-    // Gravity
-    if (gravity && !onGround)
-        veloY += GRAVITY * frametime;
-
-    // Bottom surface friction
-    if (solid && onGround && veloX != 0)
-        veloX *= 0.95;
-
-    // Liquid resistance
-    if (inLiquid) {
-        if (veloX > terminalLiquidX || veloX < -terminalLiquidX) veloX *= 0.8f;
-        if (veloY > terminalLiquidY || veloY < -terminalLiquidY) veloY *= 0.8f;
-    }
-
-    Move(veloX * frametime, veloY * frametime);
-
-    // Clip velocity to zero if it's very near
-    if (veloX > -0.001f && veloX < 0.001f) veloX = 0.f;
-    if (veloY > -0.001f && veloY < 0.001f) veloY = 0.f;
+    // World::Tick has already applied gravity, friction and liquid
+    // resistance to every body, and moved the ones that can't collide
+    if (IsSolid())
+        Move(bodies->veloX[body] * bodies->step[body], bodies->veloY[body] * bodies->step[body]);
 
     if (image) image->Tick(frametime);
 }
 
-bool pf::PhysicsEntity::AlreadyHit(pf::Entity *entity) {
-    for (int i = 0; i < hitEntities->size(); i++)
-        if (hitEntities->at(i) == entity)
-            return true;
-
-    return false;
-}
-
 void pf::PhysicsEntity::Push(float offsetX, float offsetY) {
-    if (!pushable) return;
+    if (!IsPushable()) return;
+    if (world->DeferPush(this, offsetX, offsetY)) return;
+    Wake();
 
-    veloX += offsetX;
-    veloY += offsetY;
+    bodies->veloX[body] += offsetX;
+    bodies->veloY[body] += offsetY;
 
     Move(offsetX, offsetY);
 }
 
-void pf::PhysicsEntity::Move(float offsetX, float offsetY) {
-    inLiquid = false;
+void pf::PhysicsEntity::Move(pf::Scalar offsetX, pf::Scalar offsetY) {
+    // Nothing below creates bodies, so these stay valid throughout. Queries
+    // take floats, and what they find is brought back into Scalar.
+    pf::Scalar &x = bodies->x[body], &y = bodies->y[body];
+    pf::Scalar &veloX = bodies->veloX[body], &veloY = bodies->veloY[body];
+    const pf::Scalar zero = 0.f;
+    int width = bodies->width[body], height = bodies->height[body];
+    bool solid = IsSolid(), canUseStairs = CanUseStairs(), wasOnGround = IsOnGround();
+
+    SetInLiquid(false);
 
-    if (offsetX != 0.f || offsetY != 0.f) {
+    if (offsetX != zero || offsetY != zero) {
         if (solid) {
-            if (offsetY < 0.f) onGround = false;
+            if (offsetY < zero) SetOnGround(false);
 
-            std::vector<pf::Entity*> ents;
-            std::vector<pf::PhysicsEntity*> willAdd;
+            // Fixed buffers, so moving never touches the heap
+            pf::Hit hits[pf::World::MAX_QUERY_HITS], above;
+            int hitCount;
+            pf::SweepHit sweep;
+
+            // Pushable entities don't get pushed here. This body stops
+            // against them, and the contact solver pushes them out of the way
+            // (and lets this body the rest of the way through) once every
+            // entity has moved. Tiles and everything else just stop it.
+            bool pressing;
+            pf::Scalar stop, limit;
 
             // Move up/down and check for collision
             if (offsetY != 0) {
+                // However far the move, it can't pass through anything
+                if (world->SweepLevel(pf::ToFloat(x), pf::ToFloat(y), width, height, 0.f, pf::ToFloat(offsetY), this, sweep))
+                    offsetY = ClipToContact(offsetY, sweep.time);
+
+                pf::Scalar fromY = y;
                 y += offsetY;
-                ents = world->HitsLevel(x, y, width, height, (pf::Entity*)this);
-                if (ents.size() > 0) {
-                    for (int i = 0; i < ents.size(); i++) {
-                        pf::Entity *ent = ents.at(i);
-                        pf::PhysicsEntity *pEnt = dynamic_cast<pf::PhysicsEntity*>(ent);
-                        pf::Platform *platform = dynamic_cast<pf::Platform*>(ent);
-                        if (platform && platform->IsLiquid()) {
-                            inLiquid = true;
+                world->UpdateEntity(*this);
+                pressing = false;
+                stop = limit = y;
+                hitCount = world->HitsLevel(pf::ToFloat(x), pf::ToFloat(y), width, height, (pf::Entity*)this, hits, pf::World::MAX_QUERY_HITS);
+                if (hitCount > 0) {
+                    for (int i = 0; i < hitCount; i++) {
+                        pf::Hit& hit = hits[i];
+                        pf::PhysicsEntity *pEnt = hit.entity;
+
+                        // One-way tiles only catch what comes down from above them
+                        if (!pEnt && pf::World::GetTileShape(hit.tile) == pf::World::SHAPE_ONE_WAY &&
+                            (offsetY < 0.f || fromY + height > hit.y))
+                            continue;
+
+                        if (hit.liquid) {
+                            Submerge(hit);
                         } else {
                             if (pEnt) {
-                                if (!pEnt->AlreadyHit(this) && !AlreadyHit(pEnt)) {
-                                    if (offsetY > 0.f) {
-                                        //if (pEnt->IsPushable()) {
-                                            pEnt->Push(0.f, (y + height) - pEnt->GetY());
-                                            pEnt->veloY = 0;
-                                        //}
-                                        y = pEnt->GetY() - height;
-                                        onGround = true;
-                                    } else if (offsetY < 0.f) {
-                                        //if (pEnt->IsPushable()) {
-                                            pEnt->Push(0.f, y - (pEnt->GetY() + pEnt->GetHeight()));
-                                            pEnt->veloY = 0;
-                                        //}
-                                        y = pEnt->GetY() + pEnt->GetHeight();
-                                    }
-                                    willAdd.push_back(pEnt);
+                                pEnt->Wake();
+                                if (offsetY > 0.f) {
+                                    y = pEnt->GetY() - height;
+                                    SetOnGround(true);
+                                    bodies->support[body] = pEnt->GetBody();
+                                } else if (offsetY < 0.f) {
+                                    y = pEnt->GetY() + pEnt->GetHeight();
                                 }
+                                if (pEnt->IsPushable()) {
+                                    world->AddContact(this, pEnt, pf::World::AXIS_Y, offsetY > 0.f ? 1 : -1);
+                                    pressing = true;
+                                } else
+                                    limit = offsetY > 0.f ? std::min(limit, y) : std::max(limit, y);
                             } else if (offsetY > 0.f) {
-                                y = ent->GetY() - height - 0.0f;
-                                onGround = true;
-                            } else
-                                y = ent->GetY() + ent->GetHeight() + 0.0f;
+                                y = hit.y - height - 0.0f;
+                                limit = std::min(limit, y);
+                                SetOnGround(true);
+                                bodies->support[body] = -1;
+                            } else {
+                                y = hit.y + hit.height + 0.0f;
+                                limit = std::max(limit, y);
+                            }
+                            stop = offsetY > 0.f ? std::min(stop, y) : std::max(stop, y);
                             veloY = 0.f;
                         }
                     }
                 } else if (offsetY > 0.f)
-                        onGround = false;
+                        SetOnGround(false);
+
+                // Stop at whatever's closest, and leave the solver the rest of
+                // the way up to anything that can't be pushed
+                if (pressing) {
+                    y = stop;
+                    if (limit != stop) world->DeferAdvance(this, pf::World::AXIS_Y, pf::ToFloat(limit - stop));
+                }
             }
 
             // Move left/right and check for collision
             if (offsetX != 0) {
+                if (world->SweepLevel(pf::ToFloat(x), pf::ToFloat(y), width, height, pf::ToFloat(offsetX), 0.f, this, sweep))
+                    offsetX = ClipToContact(offsetX, sweep.time);
+
                 x += offsetX;
-                ents = world->HitsLevel(x, y, width, height, (pf::Entity*)this);
-                if (ents.size() > 0) {
-                    for (int i = 0; i < ents.size(); i++) {
-                        pf::Entity *ent = ents.at(i);
-                        pf::PhysicsEntity *pEnt = dynamic_cast<pf::PhysicsEntity*>(ent);
-                        pf::Platform *platform = dynamic_cast<pf::Platform*>(ent);
-                        if (platform && platform->IsLiquid()) {
-                            inLiquid = true;
+                world->UpdateEntity(*this);
+                pressing = false;
+                stop = limit = x;
+                hitCount = world->HitsLevel(pf::ToFloat(x), pf::ToFloat(y), width, height, (pf::Entity*)this, hits, pf::World::MAX_QUERY_HITS);
+                if (hitCount > 0) {
+                    for (int i = 0; i < hitCount; i++) {
+                        pf::Hit& hit = hits[i];
+                        pf::PhysicsEntity *pEnt = hit.entity;
+                        if (hit.liquid) {
+                            Submerge(hit);
+                        } else if (!pEnt && pf::World::GetTileShape(hit.tile) == pf::World::SHAPE_ONE_WAY) {
+                            continue;
+                        } else if (!pEnt && (hit.tile & pf::World::TILE_SHAPE) &&
+                            (y + height) - hit.y <= pf::Abs(offsetX) + 1.f &&
+                            !world->HitsTiles(pf::ToFloat(x), hit.y - height, width, pf::ToFloat(y - (hit.y - height)), &above, 1)) {
+                            // No steeper than the move is long, so walk up it.
+                            // The height comes straight off the tile's profile.
+                            y = hit.y - height;
+                            continue;
                         } else if (canUseStairs && IsOnGround() && !pEnt && veloX != 0.f &&
-                            (y + height) - ent->GetY() <= pf::World::STEP_HEIGHT && (y + height) > ent->GetY() &&
-                            world->HitsLevel(x, ent->GetY() - height, width, height, this).size() == 0) {
-                            y = ent->GetY() - height;
+                            (y + height) - hit.y <= pf::World::STEP_HEIGHT && (y + height) > hit.y &&
+                            !world->HitsLevelAny(pf::ToFloat(x), hit.y - height, width, height, this, false)) {
+                            y = hit.y - height;
                         } else if (pEnt) {
-                            if (!pEnt->AlreadyHit(this) && !AlreadyHit(pEnt)) {
-                                float origX = pEnt->GetX();
-                                float preMoveX = x;
-                                if (offsetX > 0.f) {
-                                    pEnt->Push((x + width) - pEnt->GetX(), 0.f);
-                                    x = pEnt->GetX() - width;
-                                } else if (offsetX < 0.f) {
-                                    pEnt->Push(x - (pEnt->GetX() + pEnt->GetWidth()), 0.f);
-                                    x = pEnt->GetX() + pEnt->GetWidth();
-                                }
-                                /*if (pEnt->GetX() == origX && canUseStairs && IsOnGround() && veloX != 0.f &&
-                                    (y + height) - ent->GetY() <= pf::World::STEP_HEIGHT && (y + height) > ent->GetY() &&
-                                    world->HitsLevel(x + offsetX, ent->GetY() - height, width, height, this).size() == 0) {
-                                    y = ent->GetY() - height;
-                                    x += offsetX;
-                                }*/
-                                if (x != preMoveX && canUseStairs && IsOnGround() && veloX != 0.f &&
-                                    (y + height) - ent->GetY() <= pf::World::STEP_HEIGHT && (y + height) > ent->GetY() &&
-                                    world->HitsLevel(x, ent->GetY() - height, width, height, this).size() == 0) {
-                                    y = ent->GetY() - height;
-                                    x += offsetX;
-                                }
-                                hitEntities->push_back(pEnt);
+                            pEnt->Wake();
+                            float origX = pEnt->GetX();
+                            pf::Scalar preMoveX = x;
+                            if (offsetX > 0.f) {
+                                x = pEnt->GetX() - width;
+                            } else if (offsetX < 0.f) {
+                                x = pEnt->GetX() + pEnt->GetWidth();
                             }
-                        } else if (offsetX > 0.f)
-                            x = ent->GetX() - width - 0.0f;
-                        else
-                            x = ent->GetX() + ent->GetWidth() + 0.0f;
+                            /*if (pEnt->GetX() == origX && canUseStairs && IsOnGround() && veloX != 0.f &&
+                                (y + height) - hit.y <= pf::World::STEP_HEIGHT && (y + height) > hit.y &&
+                                world->HitsLevel(x + offsetX, hit.y - height, width, height, this).size() == 0) {
+                                y = hit.y - height;
+                                x += offsetX;
+                            }*/
+                            if (pEnt->IsPushable()) {
+                                world->AddContact(this, pEnt, pf::World::AXIS_X, offsetX > 0.f ? 1 : -1);
+                                pressing = true;
+                            } else if (x != preMoveX && canUseStairs && IsOnGround() && veloX != 0.f &&
+                                (y + height) - pEnt->GetY() <= pf::World::STEP_HEIGHT && (y + height) > pEnt->GetY() &&
+                                !world->HitsLevelAny(pf::ToFloat(x), pEnt->GetY() - height, width, height, this, false)) {
+                                // Step up onto it
+                                y = pEnt->GetY() - height;
+                                x += offsetX;
+                                bodies->support[body] = pEnt->GetBody();
+                            } else
+                                limit = offsetX > 0.f ? std::min(limit, x) : std::max(limit, x);
+                        } else if (offsetX > 0.f) {
+                            x = hit.x - width - 0.0f;
+                            limit = std::min(limit, x);
+                        } else {
+                            x = hit.x + hit.width + 0.0f;
+                            limit = std::max(limit, x);
+                        }
 
-                        if (!platform || !platform->IsLiquid())
+                        if (!hit.liquid) {
+                            stop = offsetX > 0.f ? std::min(stop, x) : std::max(stop, x);
                             veloX = 0.f;
+                        }
+                    }
+                }
+
+                if (pressing) {
+                    x = stop;
+                    if (limit != stop) world->DeferAdvance(this, pf::World::AXIS_X, pf::ToFloat(limit - stop));
+                }
+
+                // Follow the ground down slopes, rather than leaving it and
+                // falling a little after every step
+                if (wasOnGround && offsetY == zero) {
+                    pf::Scalar drop = pf::Abs(offsetX) + 1.f;
+                    if (world->SweepTiles(pf::ToFloat(x), pf::ToFloat(y), width, height, 0.f, pf::ToFloat(drop), sweep) && sweep.time > 0.f) {
+                        y += drop * sweep.time;
+                        world->UpdateEntity(*this);
                     }
                 }
             }
@@ -220,9 +278,9 @@ void pf::PhysicsEntity::Move(float offsetX, float offsetY) {
             if (ent = world->HitsLevel(x, y, width, height, (pf::Entity*)this)) {
                 pf::PhysicsEntity *pEnt = dynamic_cast<pf::PhysicsEntity*>(ent);
                 if (canUseStairs && IsOnGround() && veloX != 0.f &&
-                    (y + height) - ent->GetY() <= pf::World::STEP_HEIGHT && (y + height) > ent->GetY() &&
-                    !world->HitsLevel(x, ent->GetY() - height, width, height, this)) {
-                    y = ent->GetY() - height;
+                    (y + height) - hit.y <= pf::World::STEP_HEIGHT && (y + height) > hit.y &&
+                    !world->HitsLevel(x, hit.y - height, width, height, this)) {
+                    y = hit.y - height;
                 } else if (pEnt) {
                     if (!pEnt->AlreadyHit(this) && !AlreadyHit(pEnt)) {
                         if (offsetX > 0.f) {
@@ -235,34 +293,25 @@ void pf::PhysicsEntity::Move(float offsetX, float offsetY) {
                         hitEntities->push_back((pf::Entity*)pEnt);
                     }
                 } else if (offsetX > 0.f)
-                    x = ent->GetX()  - width - 0.0f;
+                    x = hit.x  - width - 0.0f;
                 else
-                    x = ent->GetX() + ent->GetWidth() + 0.0f;
+                    x = hit.x + hit.width + 0.0f;
                 veloX = 0.f;
             }
             */
 
-            // Re-add original collision entities
-            for (int i = 0; i < willAdd.size(); i++)
-                hitEntities->push_back(willAdd.at(i));
-
         } else {
             x += offsetX;
             y += offsetY;
         }
+
+        // Keep the broadphase in step with wherever collisions left us
+        world->UpdateEntity(*this);
     }
 
     // Re-check onGround if moved horizontally but not vertically
-    if (solid && offsetY == 0.f && veloY == 0.f) {
-        std::vector<pf::Entity*> hits = world->HitsLevel(x, y + 1, width, height, (pf::Entity*)this);
-        onGround = false;
-        for (int i = 0; i < hits.size(); i++) {
-            pf::Platform *platform = dynamic_cast<pf::Platform*>(hits.at(i));
-            if (platform && platform->IsLiquid())
-                continue;
-            onGround = true;
-        }
-    }
+    if (solid && offsetY == zero && veloY == zero)
+        SetOnGround(world->HitsLevelAny(pf::ToFloat(x), pf::ToFloat(y + 1), width, height, (pf::Entity*)this, true));
 }
 
 bool pf::PhysicsEntity::HitTest(pf::Entity& entity) {
@@ -273,93 +322,132 @@ bool pf::PhysicsEntity::HitTest(pf::Entity& entity) {
 }
 
 bool pf::PhysicsEntity::HitTest(float x, float y, float width, float height) {
-    if (!solid) return false;
+    if (!IsSolid()) return false;
 
-    if (x >= this->x + this->width
-        || y >= this->y + this->height)
+    float bodyX = pf::ToFloat(bodies->x[body]), bodyY = pf::ToFloat(bodies->y[body]);
+    if (x >= bodyX + bodies->width[body]
+        || y >= bodyY + bodies->height[body])
         return false;
 
-    if (x + width <= this->x || y + height <= this->y)
+    if (x + width <= bodyX || y + height <= bodyY)
         return false;
 
     return true;
 }
 
 bool pf::PhysicsEntity::HitTest(float x, float y) {
-    if (!solid) return false;
+    if (!IsSolid()) return false;
 
-    return (!(x >= this->x + this->width
-        || y >= this->y + this->height));
+    return (!(x >= bodies->x[body] + bodies->width[body]
+        || y >= bodies->y[body] + bodies->height[body]));
 }
 
 void pf::PhysicsEntity::Render(sf::RenderTarget& target) {
     if (!image) return;
 
-    image->SetPosition((int)x, (int)y);
+    image->SetPosition((int)GetX(), (int)GetY());
     image->Render(target);
 }
 
 bool pf::PhysicsEntity::IsMoving() {
-    return (veloX == 0.f && veloY == 0.f);
+    return (bodies->veloX[body] == 0.f && bodies->veloY[body] == 0.f);
 }
 
 float pf::PhysicsEntity::GetVelocityX() {
-    return veloX;
+    return pf::ToFloat(bodies->veloX[body]);
 }
 
 float pf::PhysicsEntity::GetVelocityY() {
-    return veloY;
+    return pf::ToFloat(bodies->veloY[body]);
 }
 
 void pf::PhysicsEntity::SetVelocity(float veloX, float veloY) {
-    this->veloX = veloX;
-    this->veloY = veloY;
+    bodies->veloX[body] = veloX;
+    bodies->veloY[body] = veloY;
+    if (veloX != 0.f || veloY != 0.f) Wake();
 }
 
 void pf::PhysicsEntity::SetVelocityX(float veloX) {
-    this->veloX = veloX;
+    bodies->veloX[body] = veloX;
+    if (veloX != 0.f) Wake();
 }
 
 void pf::PhysicsEntity::SetVelocityY(float veloY) {
-    this->veloY = veloY;
+    bodies->veloY[body] = veloY;
+    if (veloY != 0.f) Wake();
 }
 
 bool pf::PhysicsEntity::IsSolid() {
-    return solid;
+    return bodies->HasFlag(body, pf::Bodies::SOLID);
 }
 
 void pf::PhysicsEntity::SetSolid(bool solid) {
-    this->solid = solid;
+    bodies->SetFlag(body, pf::Bodies::SOLID, solid);
 }
 
 bool pf::PhysicsEntity::GravityIsEnabled() {
-    return gravity;
+    return bodies->HasFlag(body, pf::Bodies::GRAVITY);
 }
 
 void pf::PhysicsEntity::SetGravityEnabled(bool gravity) {
-    this->gravity = gravity;
+    bodies->SetFlag(body, pf::Bodies::GRAVITY, gravity);
 }
 
 bool pf::PhysicsEntity::IsOnGround() {
-    return onGround || inLiquid;
+    return bodies->HasFlag(body, pf::Bodies::ON_GROUND | pf::Bodies::IN_LIQUID);
 }
 
 bool pf::PhysicsEntity::IsInLiquid() {
-    return inLiquid;
+    return bodies->HasFlag(body, pf::Bodies::IN_LIQUID);
 }
 
 bool pf::PhysicsEntity::IsPushable() {
-    return pushable;
+    return bodies->HasFlag(body, pf::Bodies::PUSHABLE);
 }
 
 void pf::PhysicsEntity::SetPushable(bool pushable) {
-    this->pushable = pushable;
+    bodies->SetFlag(body, pf::Bodies::PUSHABLE, pushable);
 }
 
 bool pf::PhysicsEntity::CanUseStairs() {
-    return canUseStairs;
+    return bodies->HasFlag(body, pf::Bodies::STAIRS);
 }
 
 void pf::PhysicsEntity::SetCanUseStairs(bool canUseStairs) {
-    this->canUseStairs = canUseStairs;
+    bodies->SetFlag(body, pf::Bodies::STAIRS, canUseStairs);
+}
+
+void pf::PhysicsEntity::SetOnGround(bool onGround) {
+    bodies->SetFlag(body, pf::Bodies::ON_GROUND, onGround);
+    if (!onGround) bodies->support[body] = -1;
+}
+
+void pf::PhysicsEntity::SetInLiquid(bool inLiquid) {
+    bodies->SetFlag(body, pf::Bodies::IN_LIQUID, inLiquid);
+    if (!inLiquid) bodies->submerged[body] = 0.f;
+}
+
+void pf::PhysicsEntity::Submerge(const pf::Hit& hit) {
+    // Liquid hits only cover the filled part of the tile
+    float top = std::max(GetY(), hit.y), bottom = std::min(GetY() + GetHeight(), hit.y + hit.height);
+    pf::Scalar depth = (bottom - top) / GetHeight();
+    SetInLiquid(true);
+    if (depth > bodies->submerged[body]) bodies->submerged[body] = depth;
+}
+
+bool pf::PhysicsEntity::IsSleeping() {
+    return bodies->HasFlag(body, pf::Bodies::SLEEPING);
+}
+
+bool pf::PhysicsEntity::CanSleep() {
+    return bodies->HasFlag(body, pf::Bodies::CAN_SLEEP);
+}
+
+void pf::PhysicsEntity::SetCanSleep(bool canSleep) {
+    bodies->SetFlag(body, pf::Bodies::CAN_SLEEP, canSleep);
+    if (!canSleep) Wake();
+}
+
+void pf::PhysicsEntity::Wake() {
+    world->WakeBody(body);
 }
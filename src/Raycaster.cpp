@@ -0,0 +1,360 @@
+/*
+ * Raycaster.cpp
+ * Ray casts through a world's tiles and broadphase
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "Raycaster.h"
+#include "Bodies.h"
+#include "IJob.h"
+#include "JobPool.h"
+#include "PhysicsEntity.h"
+#include "SpatialHash.h"
+#include "Tileset.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // Steps through the cells of a grid that a segment passes through, in
+    // order (Amanatides and Woo)
+    class GridWalk {
+        public:
+            GridWalk(float x, float y, float offsetX, float offsetY, float cellSize) {
+                cellX = (int)std::floor(x / cellSize);
+                cellY = (int)std::floor(y / cellSize);
+                time = 0.f;
+                normalX = normalY = 0;
+
+                int endX = (int)std::floor((x + offsetX) / cellSize);
+                int endY = (int)std::floor((y + offsetY) / cellSize);
+                steps = std::abs(endX - cellX) + std::abs(endY - cellY);
+
+                stepX = offsetX > 0.f ? 1 : -1;
+                stepY = offsetY > 0.f ? 1 : -1;
+                deltaX = offsetX != 0.f ? cellSize / std::fabs(offsetX) : 2.f;
+                deltaY = offsetY != 0.f ? cellSize / std::fabs(offsetY) : 2.f;
+                nextX = offsetX != 0.f ? ((cellX + (stepX > 0 ? 1 : 0)) * cellSize - x) / offsetX : 2.f;
+                nextY = offsetY != 0.f ? ((cellY + (stepY > 0 ? 1 : 0)) * cellSize - y) / offsetY : 2.f;
+            }
+
+            // Moves into the next cell, returning false past the end
+            bool Next() {
+                if (steps-- <= 0) return false;
+
+                if (nextX < nextY) {
+                    time = nextX;
+                    nextX += deltaX;
+                    cellX += stepX;
+                    normalX = -stepX;
+                    normalY = 0;
+                } else {
+                    time = nextY;
+                    nextY += deltaY;
+                    cellY += stepY;
+                    normalX = 0;
+                    normalY = -stepY;
+                }
+                return true;
+            }
+
+            int cellX, cellY;
+            float time;             // Fraction of the offset where the cell starts
+            int normalX, normalY;   // Out of the side the cell was entered by
+
+        private:
+            int stepX, stepY, steps;
+            float deltaX, deltaY, nextX, nextY;
+    };
+
+    // Where a ray enters a box and leaves it, as fractions of its offset
+    inline void RayBox(float minX, float minY, float maxX, float maxY,
+                       float x, float y, float inverseX, float inverseY,
+                       float& entryX, float& entryY, float& exit) {
+        float x1 = (minX - x) * inverseX, x2 = (maxX - x) * inverseX;
+        float y1 = (minY - y) * inverseY, y2 = (maxY - y) * inverseY;
+        entryX = std::min(x1, x2);
+        entryY = std::min(y1, y2);
+        exit = std::min(std::max(x1, x2), std::max(y1, y2));
+    }
+
+    // Where a ray first enters the solid part of a shaped tile, one column
+    // at a time. Rays only hit one-way tiles coming down onto them.
+    bool RayShape(pf::TileCell tile, int tileX, int tileY, float x, float y, float offsetX, float offsetY,
+                  float inverseX, float inverseY, pf::SweepHit& result) {
+        const pf::Hit whole = pf::World::TileHit(tile, tileX, tileY);
+        if (pf::World::GetTileShape(tile) == pf::World::SHAPE_ONE_WAY && (offsetY <= 0.f || y > whole.y))
+            return false;
+
+        bool found = false;
+        float best = 1.f;
+        for (int column = 0; column < pf::World::TILE_SIZE; column++) {
+            pf::Hit span = whole;
+            pf::World::ShapeSpan(span, whole.x + column, whole.x + column + 1);
+            float minX = whole.x + column, maxX = minX + 1;
+            float minY = span.y, maxY = span.y + span.height;
+
+            // Rays along an axis are either in the column's span on the
+            // other one or not
+            if (offsetX == 0.f) {
+                if (x < minX || x >= maxX) continue;
+                minX = -1e30f;
+                maxX = 1e30f;
+            }
+            if (offsetY == 0.f) {
+                if (y < minY || y >= maxY) continue;
+                minY = -1e30f;
+                maxY = 1e30f;
+            }
+
+            float entryX, entryY, exit;
+            RayBox(minX, minY, maxX, maxY, x, y, inverseX, inverseY, entryX, entryY, exit);
+            float entry = std::max(entryX, entryY);
+            if (entry >= exit || exit <= 0.f || entry > best) continue;
+
+            best = std::max(entry, 0.f);
+            result.time = best;
+            result.normalX = result.normalY = 0.f;
+            if (entry > 0.f && entryX > entryY)
+                result.normalX = offsetX > 0.f ? -1.f : 1.f;
+            else if (entry > 0.f)
+                result.normalY = offsetY > 0.f ? -1.f : 1.f;
+            found = true;
+        }
+
+        return found;
+    }
+
+    // Finds the box in a run that the ray enters first, no later than best,
+    // and lowers best to where. Returns its index, or -1 if there's none.
+    // Touching an edge doesn't count as entering.
+    // The boxes' edges are kept one array each, so they can be tested four
+    // at a time.
+    int NearestBox(const float *minX, const float *minY, const float *maxX, const float *maxY, int count,
+                   float x, float y, float inverseX, float inverseY, float& best) {
+        int nearest = -1;
+        int i = 0;
+
+#ifdef __SSE2__
+        const __m128 originX = _mm_set1_ps(x), originY = _mm_set1_ps(y);
+        const __m128 invX = _mm_set1_ps(inverseX), invY = _mm_set1_ps(inverseY);
+        const __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= count; i += 4) {
+            __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(minX + i), originX), invX);
+            __m128 x2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(maxX + i), originX), invX);
+            __m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(minY + i), originY), invY);
+            __m128 y2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(maxY + i), originY), invY);
+            __m128 entry = _mm_max_ps(_mm_min_ps(x1, x2), _mm_min_ps(y1, y2));
+            __m128 exit = _mm_min_ps(_mm_max_ps(x1, x2), _mm_max_ps(y1, y2));
+
+            __m128 hit = _mm_and_ps(_mm_cmplt_ps(entry, exit), _mm_cmpgt_ps(exit, zero));
+            hit = _mm_and_ps(hit, _mm_cmple_ps(entry, _mm_set1_ps(best)));
+            int bits = _mm_movemask_ps(hit);
+            if (!bits) continue;
+
+            // Hits are rare, so the few there are get sorted out one by one
+            float entries[4];
+            _mm_storeu_ps(entries, entry);
+            for (int j = 0; j < 4; j++) {
+                if ((bits & (1 << j)) && entries[j] <= best) {
+                    best = std::max(entries[j], 0.f);
+                    nearest = i + j;
+                }
+            }
+        }
+#endif
+
+        for (; i < count; i++) {
+            float entryX, entryY, exit;
+            RayBox(minX[i], minY[i], maxX[i], maxY[i], x, y, inverseX, inverseY, entryX, entryY, exit);
+            float entry = std::max(entryX, entryY);
+            if (entry < exit && exit > 0.f && entry <= best) {
+                best = std::max(entry, 0.f);
+                nearest = i;
+            }
+        }
+
+        return nearest;
+    }
+}; // namespace
+
+// Casts a run of a batch of rays
+class pf::Raycaster::RayJob : public pf::IJob {
+    public:
+        RayJob(pf::Raycaster *raycaster) {
+            this->raycaster = raycaster;
+        }
+
+        void Run() {
+            pf::SweepHit scratch;
+            for (int i = begin; i < end; i++)
+                hits[i] = raycaster->Cast(rays[i], anyHit, results ? results[i] : scratch);
+        }
+
+        const pf::Ray *rays;
+        pf::SweepHit *results;
+        bool *hits;
+        bool anyHit;
+        int begin, end;
+
+    private:
+        pf::Raycaster *raycaster;
+};
+
+pf::Raycaster::Raycaster(pf::World *world, pf::Bodies *bodies) {
+    this->world = world;
+    this->bodies = bodies;
+    scratch.resize(1);
+}
+
+pf::Raycaster::~Raycaster() {
+    for (int i = 0; i < jobs.size(); i++)
+        delete jobs[i];
+}
+
+void pf::Raycaster::SetThreadCount(int threads) {
+    scratch.resize(threads);
+}
+
+void pf::Raycaster::CastBatch(const pf::Ray *rays, int count, bool anyHit, pf::SweepHit *results, bool *hits, pf::JobPool *pool) {
+    if (!pool) {
+        pf::SweepHit scratch;
+        for (int i = 0; i < count; i++)
+            hits[i] = Cast(rays[i], anyHit, results ? results[i] : scratch);
+        return;
+    }
+
+    jobList.clear();
+    for (int begin = 0; begin < count; begin += pf::World::RAYS_PER_JOB) {
+        if (jobList.size() == jobs.size())
+            jobs.push_back(new RayJob(this));
+        RayJob *job = jobs[jobList.size()];
+        job->rays = rays;
+        job->results = results;
+        job->hits = hits;
+        job->anyHit = anyHit;
+        job->begin = begin;
+        job->end = std::min(begin + pf::World::RAYS_PER_JOB, count);
+        jobList.push_back(job);
+    }
+    pool->Run(&jobList[0], jobList.size());
+}
+
+bool pf::Raycaster::Cast(const pf::Ray& ray, bool anyHit, pf::SweepHit& result) {
+    float x = ray.x, y = ray.y, offsetX = ray.offsetX, offsetY = ray.offsetY;
+    result.time = 1.f;
+    result.normalX = result.normalY = 0.f;
+    bool found = false;
+
+    const float huge = 1e30f;
+    float inverseX = offsetX != 0.f ? 1.f / offsetX : huge;
+    float inverseY = offsetY != 0.f ? 1.f / offsetY : huge;
+
+    // Tiles first, which gives the entities something to beat
+    if (world->GetWidth() > 0) {
+        GridWalk walk(x, y, offsetX, offsetY, pf::World::TILE_SIZE);
+        do {
+            pf::TileCell tile = world->GetTile(walk.cellX, walk.cellY);
+            if (!(tile & pf::World::TILE_SOLID) || !(pf::Tileset::Tiles[(tile & pf::World::TILE_INDEX) - 1].category & ray.mask))
+                continue;
+
+            result.time = walk.time;
+            result.normalX = walk.normalX;
+            result.normalY = walk.normalY;
+            if (!(tile & pf::World::TILE_SHAPE) ||
+                RayShape(tile, walk.cellX, walk.cellY, x, y, offsetX, offsetY, inverseX, inverseY, result)) {
+                result.hit = pf::World::TileHit(tile, walk.cellX, walk.cellY);
+                found = true;
+                break;
+            }
+        } while (walk.Next());
+    }
+    if (found && anyHit) return true;
+
+    // Then the entities in each broadphase cell along the way, until the
+    // cells start past the nearest hit so far
+    Scratch& boxes = scratch[pf::JobPool::GetThreadIndex()];
+
+    GridWalk walk(x, y, offsetX, offsetY, pf::SpatialHash::CELL_SIZE);
+    do {
+        if (walk.time > result.time) break;
+
+        boxes.found.clear();
+        world->QueryBroadphase(walk.cellX * pf::SpatialHash::CELL_SIZE, walk.cellY * pf::SpatialHash::CELL_SIZE, 0, 0, boxes.found);
+
+        boxes.minX.clear();
+        boxes.minY.clear();
+        boxes.maxX.clear();
+        boxes.maxY.clear();
+        boxes.entities.clear();
+        for (int i = 0; i < boxes.found.size(); i++) {
+            pf::PhysicsEntity *ent = boxes.found[i];
+            int body = ent->GetBody();
+            if (ent == ray.skip || !(bodies->category[body] & ray.mask)) continue;
+
+            float minX = pf::ToFloat(bodies->x[body]), maxX = minX + bodies->width[body];
+            float minY = pf::ToFloat(bodies->y[body]), maxY = minY + bodies->height[body];
+
+            // A ray along an axis is either inside the box's span on the
+            // other one or not, so that span is settled here
+            if (offsetX == 0.f) {
+                if (x <= minX || x >= maxX) continue;
+                minX = -huge;
+                maxX = huge;
+            }
+            if (offsetY == 0.f) {
+                if (y <= minY || y >= maxY) continue;
+                minY = -huge;
+                maxY = huge;
+            }
+
+            boxes.minX.push_back(minX);
+            boxes.minY.push_back(minY);
+            boxes.maxX.push_back(maxX);
+            boxes.maxY.push_back(maxY);
+            boxes.entities.push_back(ent);
+        }
+        if (boxes.entities.empty()) continue;
+
+        float best = result.time;
+        int nearest = NearestBox(&boxes.minX[0], &boxes.minY[0], &boxes.maxX[0], &boxes.maxY[0],
+                                 boxes.entities.size(), x, y, inverseX, inverseY, best);
+        if (nearest < 0) continue;
+
+        float entryX, entryY, exit;
+        RayBox(boxes.minX[nearest], boxes.minY[nearest], boxes.maxX[nearest], boxes.maxY[nearest],
+               x, y, inverseX, inverseY, entryX, entryY, exit);
+        result.time = best;
+        result.normalX = result.normalY = 0.f;
+        if (std::max(entryX, entryY) > 0.f) {
+            if (entryX > entryY)
+                result.normalX = offsetX > 0.f ? -1.f : 1.f;
+            else
+                result.normalY = offsetY > 0.f ? -1.f : 1.f;
+        }
+        result.hit = pf::World::EntityHit(boxes.entities[nearest]);
+        found = true;
+
+        if (anyHit) break;
+    } while (walk.Next());
+
+    return found;
+}
@@ -40,22 +40,36 @@ pf::Resource *pf::Resource::GetResource(char *name) {
 };
 
 pf::Resource *pf::Resource::GetOrLoadResource(char *name) {
-    char *windowsName = name;
     pf::Resource *resource = GetResource(name);
     if (resource) return resource;
 
+    char *data;
+    int length;
+    if (!ReadFile(name, data, length))
+        return NULL;
+
+    return new Resource(name, data, length);
+};
+
+bool pf::Resource::ReadFile(char *name, char *&data, int &length) {
+    char *windowsName = name;
+
 #ifdef _WIN32
     windowsName = ConvertToWindowsPath(name);
 #endif
 
     struct stat results;
-    int length;
 
     if (stat(windowsName, &results) == 0)
         length = results.st_size;
     else {
         pf::Logger::LogError("Failed to stat file: %s", windowsName);
-        return NULL;
+        return false;
+    }
+
+    if (length > MAX_LENGTH) {
+        pf::Logger::LogError("File is too big to be a resource: %s", windowsName);
+        return false;
     }
 
     char *buffer = new char[length];
@@ -67,7 +81,7 @@ pf::Resource *pf::Resource::GetOrLoadResource(char *name) {
         delete [] buffer;
         in_stream->close();
         delete in_stream;
-        return NULL;
+        return false;
     }
 
     in_stream->close();
@@ -75,13 +89,15 @@ pf::Resource *pf::Resource::GetOrLoadResource(char *name) {
 
     pf::Logger::LogInfo("Loaded resource: \"%s\" ( %d bytes )", name, length);
 
-    return new Resource(name, buffer, length);
-};
+    data = buffer;
+    return true;
+}
 
 pf::Resource::Resource(char *filename, char *data, int length) {
     this->filename = filename;
     this->length = length;
     this->data = data;
+    UpdateFileStamp();
     resources->insert(std::pair<std::string, pf::Resource*>(std::string(filename), this));
 #ifdef PLATFORMER_SERVER
     if (server) server->RequireResource(this);
@@ -94,6 +110,32 @@ pf::Resource::~Resource() {
     delete [] data;
 }
 
+void pf::Resource::UpdateFileStamp() {
+    struct stat results;
+    if (stat(filename, &results) == 0) {
+        fileModified = results.st_mtime;
+        fileSize = results.st_size;
+    } else {
+        fileModified = 0;
+        fileSize = -1;
+    }
+}
+
+bool pf::Resource::HasChangedOnDisk() {
+    struct stat results;
+    if (stat(filename, &results) != 0)
+        return false;
+
+    return results.st_mtime != fileModified || results.st_size != fileSize;
+}
+
+void pf::Resource::SetData(char *data, int length) {
+    delete [] this->data;
+    this->data = data;
+    this->length = length;
+    UpdateFileStamp();
+}
+
 char *pf::Resource::GetFilename() {
     return filename;
 }
@@ -0,0 +1,180 @@
+/*
+ * SensorGrid.cpp
+ * Boxes that note which entities overlap them
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "SensorGrid.h"
+#include "Bodies.h"
+#include "EntitySlots.h"
+#include "PhysicsEntity.h"
+#include "SpatialHash.h"
+#include <algorithm>
+
+pf::SensorGrid::SensorGrid(pf::EntitySlots *entities, pf::Bodies *bodies, pf::SpatialHash *broadphase) {
+    this->entities = entities;
+    this->bodies = bodies;
+    this->broadphase = broadphase;
+    index = new pf::SpatialHash();
+}
+
+pf::SensorGrid::~SensorGrid() {
+    delete index;
+}
+
+int pf::SensorGrid::Add(float x, float y, int width, int height, int kind, pf::CollisionMask mask, bool fromLevel) {
+    int sensor = index->Insert(NULL, x, y, width, height);
+    if (sensor >= sensors.size())
+        sensors.resize(sensor + 1);
+
+    Sensor& s = sensors[sensor];
+    s.x = x;
+    s.y = y;
+    s.width = width;
+    s.height = height;
+    s.kind = kind;
+    s.mask = mask;
+    s.used = true;
+    s.fromLevel = fromLevel;
+    MarkChanged(sensor);
+
+    return sensor;
+}
+
+void pf::SensorGrid::Remove(int sensor) {
+    if (sensor < 0 || sensor >= sensors.size() || !sensors[sensor].used) return;
+
+    index->Remove(sensor);
+    sensors[sensor].used = false;
+    MarkChanged(sensor);
+}
+
+void pf::SensorGrid::RemoveLevelSensors() {
+    for (int i = 0; i < sensors.size(); i++)
+        if (sensors[i].used && sensors[i].fromLevel)
+            Remove(i);
+}
+
+void pf::SensorGrid::SetBounds(int sensor, float x, float y, int width, int height) {
+    if (sensor < 0 || sensor >= sensors.size() || !sensors[sensor].used) return;
+
+    Sensor& s = sensors[sensor];
+    s.x = x;
+    s.y = y;
+    s.width = width;
+    s.height = height;
+    index->Update(sensor, x, y, width, height);
+    MarkChanged(sensor);
+}
+
+int pf::SensorGrid::GetKind(int sensor) {
+    if (sensor < 0 || sensor >= sensors.size() || !sensors[sensor].used) return 0;
+    return sensors[sensor].kind;
+}
+
+const std::vector<pf::World::SensorOverlap>& pf::SensorGrid::GetOverlaps() {
+    return overlaps;
+}
+
+const std::vector<pf::SensorEvent>& pf::SensorGrid::GetEvents() {
+    return events;
+}
+
+void pf::SensorGrid::Update() {
+    overlaps.swap(lastOverlaps);
+    overlaps.clear();
+    events.clear();
+
+    // Resting entities are still in whichever unchanged sensors they were in
+    for (int i = 0; i < lastOverlaps.size(); i++) {
+        const pf::World::SensorOverlap& overlap = lastOverlaps[i];
+        pf::Entity *ent = entities->Get(overlap.second);
+        if (ent && !sensors[overlap.first].changed && bodies->IsResting(ent->GetBody()))
+            overlaps.push_back(overlap);
+    }
+
+    // Everything else looks up the sensors around it
+    for (int i = 0; i < entities->GetCount(); i++) {
+        pf::Entity *ent = entities->GetAt(i);
+        if (!ent->IsType(pf::Entity::TYPE_PHYSICS) || ent->GetBroadphaseProxy() < 0) continue;
+
+        int body = ent->GetBody();
+        if (bodies->IsResting(body)) continue;
+
+        proxyScratch.clear();
+        index->QueryProxies(pf::ToFloat(bodies->x[body]), pf::ToFloat(bodies->y[body]), bodies->width[body], bodies->height[body], proxyScratch);
+        for (int j = 0; j < proxyScratch.size(); j++)
+            if (OverlapsBody(proxyScratch[j], body))
+                overlaps.push_back(pf::World::SensorOverlap(proxyScratch[j], ent->GetID()));
+    }
+
+    // and changed sensors look for the resting entities in them
+    for (int i = 0; i < changed.size(); i++) {
+        int sensor = changed[i];
+        Sensor& s = sensors[sensor];
+        s.changed = false;
+        if (!s.used) continue;
+
+        entityScratch.clear();
+        broadphase->Query(s.x, s.y, s.width, s.height, entityScratch);
+        for (int j = 0; j < entityScratch.size(); j++) {
+            int body = entityScratch[j]->GetBody();
+            if (bodies->IsResting(body) && OverlapsBody(sensor, body))
+                overlaps.push_back(pf::World::SensorOverlap(sensor, entityScratch[j]->GetID()));
+        }
+    }
+    changed.clear();
+
+    std::sort(overlaps.begin(), overlaps.end());
+
+    // Both lists are sorted, so the changes fall out of walking them together
+    int i = 0, j = 0;
+    while (i < lastOverlaps.size() || j < overlaps.size()) {
+        pf::SensorEvent event;
+        if (j == overlaps.size() || (i < lastOverlaps.size() && lastOverlaps[i] < overlaps[j])) {
+            event.sensor = lastOverlaps[i].first;
+            event.entity = lastOverlaps[i].second;
+            event.entered = false;
+            i++;
+        } else if (i == lastOverlaps.size() || overlaps[j] < lastOverlaps[i]) {
+            event.sensor = overlaps[j].first;
+            event.entity = overlaps[j].second;
+            event.entered = true;
+            j++;
+        } else {
+            i++;
+            j++;
+            continue;
+        }
+        events.push_back(event);
+    }
+}
+
+bool pf::SensorGrid::OverlapsBody(int sensor, int body) {
+    const Sensor& s = sensors[sensor];
+    if (!s.used || !(s.mask & bodies->category[body])) return false;
+
+    float x = pf::ToFloat(bodies->x[body]), y = pf::ToFloat(bodies->y[body]);
+    return x < s.x + s.width && s.x < x + bodies->width[body] &&
+           y < s.y + s.height && s.y < y + bodies->height[body];
+}
+
+void pf::SensorGrid::MarkChanged(int sensor) {
+    if (sensors[sensor].changed) return;
+    sensors[sensor].changed = true;
+    changed.push_back(sensor);
+}
@@ -25,14 +25,18 @@
 #include "ClientInstance.h"
 #include "CharacterSkin.h"
 #include "Character.h"
+#include "Elevator.h"
 #include "Packet.h"
 #include "Animation.h"
+#include "Latency.h"
+#include "Delta.h"
 #include <SFML/System.hpp>
 #include "cfgparser/cfgparser.h"
 #include "cfgparser/configwrapper.h"
 
 pf::Server::Server() {
     shouldQuit = false;
+    tick = 0;
 
     // Read config file
 
@@ -45,6 +49,8 @@ pf::Server::Server() {
     ConfigWrapper_t config(configLoader);
 
     std::string level, tileset, hostname;
+    bool regionSimulation = false;
+    int regionMargin = 1, marginInterval = 3;
 
     std::string section = "general";
     config.getInt(section, "port", (unsigned int&)serverPort);
@@ -52,6 +58,11 @@ pf::Server::Server() {
     config.getString(section, "tileset", tileset);
     config.getString(section, "hostname", hostname);
 
+    section = "regions";
+    config.getBool(section, "enabled", regionSimulation);
+    config.getInt(section, "margin", regionMargin);
+    config.getInt(section, "margin_interval", marginInterval);
+
     // Initialize properties
 
     pf::Logger::LogInfo("Loading default settings");
@@ -75,6 +86,20 @@ pf::Server::Server() {
 
     pf::Logger::LogInfo("Initializing world");
     world = new pf::World(levelResource, tilesetResource);
+    world->SetRegionSimulation(regionSimulation);
+    world->SetRegionMargin(regionMargin, marginInterval);
+
+    // Put an elevator on each path laid out in the level
+    pf::Resource *elevatorResource = pf::Resource::GetOrLoadResource("resources/step.bmp");
+    const std::vector<pf::LevelPath>& paths = world->GetLevelPaths();
+    for (int i = 0; i < paths.size(); i++) {
+        pf::Elevator *mover = new pf::Elevator(world, elevatorResource, paths[i].x[0], paths[i].y[0]);
+        for (int j = 1; j < paths[i].x.size(); j++)
+            mover->AddWaypoint(paths[i].x[j], paths[i].y[j]);
+        mover->SetPathMode(paths[i].loop ? pf::Elevator::PATH_LOOP : pf::Elevator::PATH_PING_PONG);
+        world->AddEntity(mover);
+        movers.push_back(mover);
+    }
 
     // Initialize network
 
@@ -90,12 +115,21 @@ pf::Server::Server() {
 
     pf::Logger::LogInfo("Listening on port %d", serverPort);
     sf::Clock *clock = new sf::Clock();
+    sf::Clock resourceClock;
+    std::vector<pf::LiquidDelta> liquidDeltas;
+    std::vector<pf::TileRun> tileRuns;
     float frametime;
     while (!shouldQuit) {
         // Get frame time
         frametime = clock->GetElapsedTime();
         clock->Reset();
 
+        // Patch clients' copies of any resources that changed on disk
+        if (resourceClock.GetElapsedTime() >= RESOURCE_CHECK_INTERVAL) {
+            resourceClock.Reset();
+            CheckResources();
+        }
+
         // Handle incoming connections/data
         int readySockets = socketSelector.Wait(0.01f);
         for (int i = 0; i < readySockets; i++) {
@@ -198,6 +232,11 @@ pf::Server::Server() {
                         pf::Packet::SpawnCharacter *spawnPacket = new pf::Packet::SpawnCharacter(client->GetCharacter());
                         SendToAll(spawnPacket, client);
 
+                        // Elevators are only sent once; their paths say where
+                        // they go from then on
+                        for (int i = 0; i < movers.size(); i++)
+                            client->EnqueuePacket(new pf::Packet::SpawnMover(movers[i], world));
+
                         // Spawn all characters
                         for (ClientMap::iterator it = clientMap.begin(); it != clientMap.end(); it++) {
                             client->EnqueuePacket(new pf::Packet::SpawnCharacter(it->second->GetCharacter()));
@@ -242,8 +281,9 @@ pf::Server::Server() {
                     case pf::Packet::AbsoluteMove::packetType: {
                         pf::Packet::AbsoluteMove packet(&socket);
                         client->GetCharacter()->SetPosition(packet.x, packet.y);
+                        client->GetLatency()->SetRemoteTick(packet.tick);
 
-                        SendToAll(new pf::Packet::TeleportEntity(client->GetCharacter()), client);
+                        SendToAll(new pf::Packet::TeleportEntity(tick, client->GetCharacter()), client);
 
                         break;
                     }
@@ -254,6 +294,20 @@ pf::Server::Server() {
                         SendToAll(new pf::Packet::Chat(message));
                         delete [] message;
 
+                        break;
+                    }
+                    case pf::Packet::Ping::packetType: {
+                        pf::Packet::Ping packet(&socket);
+                        pf::Packet::Pong(&packet, pf::Latency::GetTime(), tick).Send(&socket);
+
+                        break;
+                    }
+                    case pf::Packet::Pong::packetType: {
+                        pf::Packet::Pong packet(&socket);
+                        pf::Latency *latency = client->GetLatency();
+                        latency->AddSample(packet.pingTime, packet.time, pf::Latency::GetTime());
+                        latency->SetRemoteTick(packet.tick);
+
                         break;
                     }
                 }
@@ -264,15 +318,28 @@ pf::Server::Server() {
         for (ClientMap::iterator it = clientMap.begin(); it != clientMap.end(); it++) {
             pf::ClientInstance *client = it->second;
 
+            // Periodically ping the client to measure its latency
+            pf::Latency *latency = client->GetLatency();
+            if (!client->IsLoading() && latency->ShouldPing())
+                client->EnqueuePacket(new pf::Packet::Ping(latency->NextSequence(), pf::Latency::GetTime()));
+
             // Send packets as needed
             pf::Packet::BasePacket *packet;
             while (packet = client->DequeuePacket()) {
                 // Send packet
                 packet->Send(client->GetSocket());
 
-                // If finished loading, end loading
+                // If finished loading, end loading. Liquid has kept moving
+                // in the meantime, so the client is brought up to date
+                // before being sent changes with everyone else.
                 if (!client->QueuedPackets() && client->IsLoading()) {
                     client->EndLoading();
+                    world->GetTileSnapshot(tileRuns);
+                    if (!tileRuns.empty())
+                        client->EnqueuePacket(new pf::Packet::TileEdits(tileRuns, false));
+                    world->GetLiquidSnapshot(liquidDeltas);
+                    for (int i = 0; i < liquidDeltas.size(); i++)
+                        client->EnqueuePacket(new pf::Packet::LiquidChunk(liquidDeltas[i]));
                 }
 
                 // If loading, only send one packet per tick
@@ -281,8 +348,19 @@ pf::Server::Server() {
             }
         }
 
-        // Tick the world
+        // Tick the world, and send whatever tiles were edited (all in one
+        // packet) and whatever liquid moved. Tiles go first, so clients
+        // know where liquid can go. Clients keep their worlds on this clock.
+        world->SetClock(pf::Latency::GetTime() / 1000.0);
         world->Tick(frametime);
+        tick++;
+
+        world->TakeTileEdits(tileRuns);
+        if (!tileRuns.empty())
+            SendToAll(new pf::Packet::TileEdits(tileRuns, true));
+        world->TakeLiquidDeltas(liquidDeltas);
+        for (int i = 0; i < liquidDeltas.size(); i++)
+            SendToAll(new pf::Packet::LiquidChunk(liquidDeltas[i]));
     }
 }
 
@@ -310,6 +388,39 @@ void pf::Server::SendToAll(pf::Packet::BasePacket *packet, pf::ClientInstance *e
     }
 }
 
+uint32_t pf::Server::GetTick() {
+    return tick;
+}
+
+void pf::Server::CheckResources() {
+    for (std::vector<pf::Resource*>::iterator it = requiredResources.begin(); it != requiredResources.end(); it++) {
+        pf::Resource *resource = *it;
+        if (!resource->HasChangedOnDisk()) continue;
+
+        char *data;
+        int length;
+        if (!pf::Resource::ReadFile(resource->GetFilename(), data, length)) continue;
+
+        // Diff against the copy clients were sent, then swap it out
+        std::vector<char> patch;
+        uint32_t baseChecksum = pf::Delta::Checksum(resource->GetData(), resource->GetLength());
+        pf::Delta::Compute(resource->GetData(), resource->GetLength(), data, length, patch);
+        resource->SetData(data, length);
+
+        pf::Logger::LogInfo("Resource \"%s\" changed, sending %d byte patch ( %d bytes )",
+                            resource->GetFilename(), (int)patch.size(), length);
+
+        // Clients still loading get it too: if the resource was already sent
+        // they patch it, and if not it will go out in its new form anyway
+        pf::Packet::ResourcePatch *packet = new pf::Packet::ResourcePatch(resource, baseChecksum,
+                                                                          patch.empty() ? NULL : &patch[0], patch.size());
+        for (ClientMap::iterator client = clientMap.begin(); client != clientMap.end(); client++)
+            client->second->EnqueuePacket(packet);
+
+        world->ReloadResource(resource);
+    }
+}
+
 void pf::Server::RequireResource(pf::Resource *resource) {
     for (int i = 0; i < requiredResources.size(); i++)
         if (requiredResources.at(i) == resource)
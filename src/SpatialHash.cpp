@@ -0,0 +1,155 @@
+/*
+ * SpatialHash.cpp
+ * Uniform grid broadphase for entity collision queries
+ * Copyright (c) 2010-2011 Drew Gottlieb
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "SpatialHash.h"
+#include <cmath>
+#include <algorithm>
+
+pf::SpatialHash::SpatialHash()
+    : buckets(BUCKET_COUNT) {
+
+}
+
+pf::SpatialHash::~SpatialHash() {
+
+}
+
+int pf::SpatialHash::CellCoord(float position) {
+    return (int)std::floor(position / CELL_SIZE);
+}
+
+int pf::SpatialHash::Bucket(int cellX, int cellY) {
+    return ((unsigned int)cellX * 73856093u ^ (unsigned int)cellY * 19349663u) & (BUCKET_COUNT - 1);
+}
+
+int pf::SpatialHash::Insert(pf::PhysicsEntity *entity, float x, float y, float width, float height) {
+    int proxy;
+    if (freeProxies.empty()) {
+        proxy = proxies.size();
+        proxies.push_back(Proxy());
+    } else {
+        proxy = freeProxies.back();
+        freeProxies.pop_back();
+    }
+
+    Proxy& p = proxies[proxy];
+    p.entity = entity;
+    p.minX = CellCoord(x);
+    p.minY = CellCoord(y);
+    p.maxX = CellCoord(x + width);
+    p.maxY = CellCoord(y + height);
+    p.tag = ANY_TAG;
+    AddToCells(proxy);
+
+    return proxy;
+}
+
+void pf::SpatialHash::Update(int proxy, float x, float y, float width, float height) {
+    Proxy& p = proxies[proxy];
+    int minX = CellCoord(x), minY = CellCoord(y);
+    int maxX = CellCoord(x + width), maxY = CellCoord(y + height);
+
+    // Most moves stay within the same cells
+    if (minX == p.minX && minY == p.minY && maxX == p.maxX && maxY == p.maxY)
+        return;
+
+    RemoveFromCells(proxy);
+    p.minX = minX;
+    p.minY = minY;
+    p.maxX = maxX;
+    p.maxY = maxY;
+    AddToCells(proxy);
+}
+
+void pf::SpatialHash::Remove(int proxy) {
+    RemoveFromCells(proxy);
+    proxies[proxy].entity = NULL;
+    freeProxies.push_back(proxy);
+}
+
+void pf::SpatialHash::Query(float x, float y, float width, float height, std::vector<pf::PhysicsEntity*>& results) {
+    Query(x, y, width, height, ANY_TAG, results);
+}
+
+void pf::SpatialHash::Query(float x, float y, float width, float height, int tag, std::vector<pf::PhysicsEntity*>& results) {
+    int minX = CellCoord(x), minY = CellCoord(y);
+    int maxX = CellCoord(x + width), maxY = CellCoord(y + height);
+    int begin = results.size();
+
+    for (int cellX = minX; cellX <= maxX; cellX++) {
+        for (int cellY = minY; cellY <= maxY; cellY++) {
+            const std::vector<int>& bucket = buckets[Bucket(cellX, cellY)];
+            for (int i = 0; i < bucket.size(); i++) {
+                const Proxy& p = proxies[bucket[i]];
+                if (tag == ANY_TAG || p.tag == tag)
+                    results.push_back(p.entity);
+            }
+        }
+    }
+
+    // Entities spanning several cells (or sharing a bucket) are seen more
+    // than once. Dropping the repeats afterwards, rather than marking each
+    // proxy as it's seen, keeps queries from writing to the grid.
+    std::sort(results.begin() + begin, results.end());
+    results.erase(std::unique(results.begin() + begin, results.end()), results.end());
+}
+
+void pf::SpatialHash::QueryProxies(float x, float y, float width, float height, std::vector<int>& results) {
+    int minX = CellCoord(x), minY = CellCoord(y);
+    int maxX = CellCoord(x + width), maxY = CellCoord(y + height);
+    int begin = results.size();
+
+    for (int cellX = minX; cellX <= maxX; cellX++) {
+        for (int cellY = minY; cellY <= maxY; cellY++) {
+            const std::vector<int>& bucket = buckets[Bucket(cellX, cellY)];
+            results.insert(results.end(), bucket.begin(), bucket.end());
+        }
+    }
+
+    std::sort(results.begin() + begin, results.end());
+    results.erase(std::unique(results.begin() + begin, results.end()), results.end());
+}
+
+void pf::SpatialHash::SetTag(int proxy, int tag) {
+    proxies[proxy].tag = tag;
+}
+
+void pf::SpatialHash::AddToCells(int proxy) {
+    Proxy& p = proxies[proxy];
+    for (int cellX = p.minX; cellX <= p.maxX; cellX++)
+        for (int cellY = p.minY; cellY <= p.maxY; cellY++)
+            buckets[Bucket(cellX, cellY)].push_back(proxy);
+}
+
+void pf::SpatialHash::RemoveFromCells(int proxy) {
+    Proxy& p = proxies[proxy];
+    for (int cellX = p.minX; cellX <= p.maxX; cellX++) {
+        for (int cellY = p.minY; cellY <= p.maxY; cellY++) {
+            std::vector<int>& bucket = buckets[Bucket(cellX, cellY)];
+            for (int i = 0; i < bucket.size(); i++) {
+                if (bucket[i] == proxy) {
+                    bucket[i] = bucket.back();
+                    bucket.pop_back();
+                    break;
+                }
+            }
+        }
+    }
+}
@@ -1,6 +1,6 @@
 /*
  * World.cpp
- * Manages a world, including its entities, platforms, and related resources.
+ * Manages a world, including its entities, tiles, and related resources.
  * Copyright (c) 2010-2011 Drew Gottlieb
  *
  * This program is free software: you can redistribute it and/or modify
@@ -24,30 +24,364 @@
 #include "Tileset.h"
 #include "Entity.h"
 #include "PhysicsEntity.h"
-#include "Platform.h"
+#include "Elevator.h"
 #include "Logger.h"
 #include "Resource.h"
 #include "Character.h"
+#include "CharacterSkin.h"
+#include "SpatialHash.h"
+#include "Bodies.h"
+#include "EntitySlots.h"
+#include "JobPool.h"
+#include "IJob.h"
+#include "IHitVisitor.h"
+#include "IContactListener.h"
+#include "ParticleSystem.h"
+#include "LiquidGrid.h"
+#include "LightGrid.h"
+#include "SensorGrid.h"
+#include "Raycaster.h"
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+
+// Keeps query results in a fixed order, whatever buckets they came from
+static bool CompareEntityID(pf::PhysicsEntity *a, pf::PhysicsEntity *b) {
+    return a->GetID() < b->GetID();
+}
+
+static int TileCoord(float position) {
+    return (int)std::floor(position / pf::World::TILE_SIZE);
+}
+
+// How bright a tile with the given light is drawn
+static int LightTint(int level) {
+    return 48 + (255 - 48) * level / pf::World::LIGHT_MAX;
+}
+
+// Pixels of a tile, from the bottom up, that a fill level covers
+static int LiquidDepth(int level) {
+    return (level * pf::World::TILE_SIZE + pf::World::LIQUID_FULL - 1) / pf::World::LIQUID_FULL;
+}
+
+pf::Hit pf::World::EntityHit(pf::PhysicsEntity *entity) {
+    pf::Hit hit;
+    hit.entity = entity;
+    hit.tile = 0;
+    hit.x = entity->GetX();
+    hit.y = entity->GetY();
+    hit.width = entity->GetWidth();
+    hit.height = entity->GetHeight();
+    hit.liquid = false;
+    return hit;
+}
+
+pf::Hit pf::World::TileHit(pf::TileCell tile, int x, int y) {
+    pf::Hit hit;
+    hit.entity = NULL;
+    hit.tile = tile;
+    hit.x = x * pf::World::TILE_SIZE;
+    hit.y = y * pf::World::TILE_SIZE;
+    hit.width = hit.height = pf::World::TILE_SIZE;
+    hit.liquid = (tile & pf::World::TILE_LIQUID) != 0;
+    return hit;
+}
+
+namespace {
+    // Appends every hit to a vector
+    class VectorCollector : public pf::IHitVisitor {
+        public:
+            VectorCollector(std::vector<pf::Hit>& hits) : hits(hits) {}
+
+            bool Visit(const pf::Hit& hit) {
+                hits.push_back(hit);
+                return true;
+            }
+
+        private:
+            std::vector<pf::Hit>& hits;
+    };
+
+    // Fills a fixed-size buffer, stopping once it's full
+    class BufferCollector : public pf::IHitVisitor {
+        public:
+            BufferCollector(pf::Hit *buffer, int capacity) {
+                this->buffer = buffer;
+                this->capacity = capacity;
+                count = 0;
+            }
+
+            bool Visit(const pf::Hit& hit) {
+                if (count < capacity) buffer[count++] = hit;
+                return count < capacity;
+            }
+
+            int count;
+
+        private:
+            pf::Hit *buffer;
+            int capacity;
+    };
+
+    // Stops at the first hit, optionally ignoring liquids
+    class AnyHit : public pf::IHitVisitor {
+        public:
+            AnyHit(bool ignoreLiquid) {
+                this->ignoreLiquid = ignoreLiquid;
+                hit = false;
+            }
+
+            bool Visit(const pf::Hit& hit) {
+                if (ignoreLiquid && hit.liquid) return true;
+
+                this->hit = true;
+                return false;
+            }
+
+            bool hit;
+
+        private:
+            bool ignoreLiquid;
+    };
+
+    // Times at which a moving span starts and stops overlapping a still one.
+    // Returns false if they never overlap.
+    bool SweepSpan(float position, float size, float offset, float other, float otherSize, float& entry, float& exit) {
+        if (offset == 0.f) {
+            if (position >= other + otherSize || position + size <= other)
+                return false;
+            entry = -1e30f;
+            exit = 1e30f;
+            return true;
+        }
+
+        float touch = (other - (position + size)) / offset;
+        float leave = (other + otherSize - position) / offset;
+        entry = std::min(touch, leave);
+        exit = std::max(touch, leave);
+        return true;
+    }
+
+    // Which rows of each column of pixels are solid in each tile shape,
+    // from top (inclusive) to bottom (exclusive)
+    struct ShapeProfile {
+        uint8_t top[pf::World::TILE_SIZE];
+        uint8_t bottom[pf::World::TILE_SIZE];
+    };
+    ShapeProfile shapeProfiles[pf::World::SHAPE_COUNT];
+
+    void BuildShapeProfiles() {
+        const int size = pf::World::TILE_SIZE;
+        for (int column = 0; column < size; column++) {
+            for (int shape = 0; shape < pf::World::SHAPE_COUNT; shape++)
+                shapeProfiles[shape].bottom[column] = size;
+
+            shapeProfiles[pf::World::SHAPE_FULL].top[column] = 0;
+            shapeProfiles[pf::World::SHAPE_HALF].top[column] = size / 2;
+            shapeProfiles[pf::World::SHAPE_SLOPE_UP].top[column] = size - 1 - column;
+            shapeProfiles[pf::World::SHAPE_SLOPE_DOWN].top[column] = column;
+            shapeProfiles[pf::World::SHAPE_ONE_WAY].top[column] = 0;
+            shapeProfiles[pf::World::SHAPE_ONE_WAY].bottom[column] = pf::World::LEDGE_HEIGHT;
+        }
+    }
+
+    // Per-body solver state: which ways a body can't be pushed, and whether
+    // it's been touched this solve
+    const uint8_t SOLVER_TOUCHED = 0x10;
+
+    uint8_t BlockedBit(int axis, int dir) {
+        return 1 << (axis * 2 + (dir > 0 ? 0 : 1));
+    }
+
+    // Keeps the earliest solid hit along a move
+    class SweepVisitor : public pf::IHitVisitor {
+        public:
+            // Contacts up to this many pixels behind the start still count,
+            // so rounding can't let a resting body sink
+            const static float SLOP = 0.01f;
+
+            SweepVisitor(float x, float y, float width, float height, float offsetX, float offsetY) {
+                this->x = x;
+                this->y = y;
+                this->width = width;
+                this->height = height;
+                this->offsetX = offsetX;
+                this->offsetY = offsetY;
+                result.time = 1.f;
+                result.normalX = result.normalY = 0.f;
+                found = false;
+            }
+
+            bool Visit(const pf::Hit& tileHit) {
+                if (tileHit.liquid) return true;
+
+                // One-way tiles can only be landed on
+                int shape = pf::World::GetTileShape(tileHit.tile);
+                if (!tileHit.entity && shape == pf::World::SHAPE_ONE_WAY &&
+                    (offsetX != 0.f || offsetY <= 0.f || y + height > tileHit.y + SLOP))
+                    return true;
+
+                // Moving sideways into any other shaped tile, only the part
+                // under the columns it's met at stops the body. If that's
+                // no taller above its feet than the move is long, it can
+                // walk up it, which Move sorts out. Nothing taller than a
+                // half tile is walked up however long the move, so faces
+                // and stacked tiles can't be skipped through.
+                pf::Hit hit = tileHit;
+                if (!hit.entity && shape != pf::World::SHAPE_FULL && offsetX != 0.f) {
+                    hit = pf::World::TileHit(tileHit.tile, TileCoord(tileHit.x), TileCoord(tileHit.y));
+                    float left, right;
+                    if (offsetX > 0.f) {
+                        left = std::max(x, hit.x);
+                        right = std::max(x + width, hit.x + 1.f);
+                    } else {
+                        left = std::min(x, hit.x + hit.width - 1.f);
+                        right = std::min(x + width, hit.x + (float)hit.width);
+                    }
+                    float climb = std::min(std::fabs(offsetX), pf::World::TILE_SIZE / 2.f) + 1.f;
+                    if (!pf::World::ShapeSpan(hit, left, right) || (y + height) - hit.y <= climb)
+                        return true;
+                }
+
+                float entryX, exitX, entryY, exitY;
+                if (!SweepSpan(x, width, offsetX, hit.x, hit.width, entryX, exitX) ||
+                    !SweepSpan(y, height, offsetY, hit.y, hit.height, entryY, exitY))
+                    return true;
+
+                float entry = std::max(entryX, entryY), exit = std::min(exitX, exitY);
+                if (entry >= exit || entry >= result.time) return true;
+
+                // Already overlapping, so it's for the caller to sort out
+                float length = std::max(std::fabs(offsetX), std::fabs(offsetY));
+                if (entry * length < -SLOP) return true;
+
+                result.time = std::max(entry, 0.f);
+                result.normalX = result.normalY = 0.f;
+                if (entryX > entryY)
+                    result.normalX = offsetX > 0.f ? -1.f : 1.f;
+                else
+                    result.normalY = offsetY > 0.f ? -1.f : 1.f;
+                result.hit = hit;
+                found = true;
+                return true;
+            }
+
+            pf::SweepHit result;
+            bool found;
+
+        private:
+            float x, y, width, height;
+            float offsetX, offsetY;
+    };
+
+}; // namespace
+
+// Ticks a run of the tick order. A job never splits an island.
+class pf::World::IslandJob : public pf::IJob {
+    public:
+        IslandJob(pf::World *world) {
+            this->world = world;
+        }
+
+        void Run() {
+            world->TickEntities(begin, end);
+        }
+
+        int begin, end;
+
+    private:
+        pf::World *world;
+};
 
 pf::World::World(pf::Resource *levelImageResource, pf::Resource *tilesetResource) {
-    // Load level layout
-    levelImage = new sf::Image();
-    if (!(levelImage->LoadFromMemory(levelImageResource->GetData(), levelImageResource->GetLength()))) return;
+    this->levelImageResource = levelImageResource;
+    this->tilesetResource = tilesetResource;
+
+    BuildShapeProfiles();
+
+    // Initialize entities
+    entities = new pf::EntitySlots();
+    bodies = new pf::Bodies();
+    broadphase = new pf::SpatialHash();
+    sensors = new pf::SensorGrid(entities, bodies, broadphase);
+    raycaster = new pf::Raycaster(this, bodies);
+#ifdef PLATFORMER_CLIENT
+    particles = new pf::ParticleSystem();
+#else
+    particles = NULL;   // Nothing's drawn on the server
+#endif
+    liquid = new pf::LiquidGrid();
+    lighting = new pf::LightGrid();
+
+    // The pool isn't started until there's enough to tick to need it
+    ticking = parallel = false;
+    tickMargin = 0.f;
+    processorCount = pf::JobPool::GetProcessorCount();
+    pool = NULL;
+    queryScratch.resize(1);
+    threadIsland.resize(1);
+    threadContacts.resize(1);
+    threadAdvances.resize(1);
+
+    regionSimulation = false;
+    regionMargin = 1;
+    marginInterval = 3;
+    tickCount = 0;
+    time = clock = 0.0;
+    clocked = false;
+    stepCredit = 0.f;
+
+    LoadLevel();
+}
+
+void pf::World::LoadLevel() {
+    tiles = NULL;
+    tileset = NULL;
+    tileSprites = NULL;
+    width = height = 0;
+    regionsX = regionsY = 0;
+    regionLevel.clear();
+    regionTime.clear();
+    regionStep.clear();
+    liquid->Load(NULL, 0, 0, 0);
+    lighting->Load(NULL, 0, 0);
+    tileEdits.clear();
+    unsentTiles.clear();
+    touchedTiles.clear();
+
+    // Load level layout. The image is only needed while the tiles are built.
+    sf::Image levelImage;
+    if (!(levelImage.LoadFromMemory(levelImageResource->GetData(), levelImageResource->GetLength()))) return;
 
     // Set level width
-    width = levelImage->GetWidth();
-    height = levelImage->GetHeight();
+    width = levelImage.GetWidth();
+    height = levelImage.GetHeight();
 
-    // Initialize platform array
-    platforms = (pf::Platform**)new void*[width * height];
-    if (!platforms) return;
+    // Initialize tile array
+    tiles = new pf::TileCell[width * height];
 
-    // Load platform tileset
-    sf::Image *tileset = new sf::Image();
+    // Load tileset and a sprite for each tile type
+    tileset = new sf::Image();
     tileset->LoadFromMemory(tilesetResource->GetData(), tilesetResource->GetLength());
-    if (!tileset) return;
     tileset->CreateMaskFromColor(sf::Color::Magenta);
+    tileset->SetSmooth(false);
+
+    tileSprites = new sf::Sprite[Tileset::Count];
+    for (int i = 0; i < Tileset::Count; i++) {
+        tileSprites[i].SetImage(*tileset);
+        tileSprites[i].SetSubRect(Tileset::Tiles[i].coords);
+        tileSprites[i].Resize(TILE_SIZE, TILE_SIZE);
+        tileSprites[i].SetColor(sf::Color(255, 255, 255, (int)(Tileset::Tiles[i].alpha * 255)));
+    }
+
+    // Start every region awake
+    regionsX = (width + REGION_SIZE - 1) / REGION_SIZE;
+    regionsY = (height + REGION_SIZE - 1) / REGION_SIZE;
+    regionLevel.assign(regionsX * regionsY, REGION_ACTIVE);
+    regionTime.assign(regionsX * regionsY, 0.f);
+    regionStep.assign(regionsX * regionsY, 0.f);
 
     // Set default spawn point
     spawnX = spawnY = TILE_SIZE;
@@ -55,23 +389,15 @@ pf::World::World(pf::Resource *levelImageResource, pf::Resource *tilesetResource
     // Create tiles
     for (int x = 0; x < width; x++) {
         for (int y = 0; y < height; y++) {
-            platforms[xy(x, y)] = NULL;
-            sf::Color levelColor = levelImage->GetPixel(x, y);
+            tiles[xy(x, y)] = 0;
+            sf::Color levelColor = levelImage.GetPixel(x, y);
             if (Tileset::Spawn == levelColor) {
                 spawnX = x * TILE_SIZE;
                 spawnY = y * TILE_SIZE;
             } else {
                 for (int i = 0; i < Tileset::Count; i++) {
                     if (Tileset::Tiles[i].levelColor == levelColor) {
-                        platforms[xy(x, y)] = new pf::Platform(
-                                                this,
-                                                *tileset,
-                                                Tileset::Tiles[i].coords,
-                                                x * TILE_SIZE,
-                                                y * TILE_SIZE,
-                                                Tileset::Tiles[i].alpha,
-                                                Tileset::Tiles[i].liquid);
-                        platforms[xy(x, y)]->SetSolid(Tileset::Tiles[i].solid);
+                        tiles[xy(x, y)] = MakeTile(i);
                         break;
                     }
                 }
@@ -79,47 +405,577 @@ pf::World::World(pf::Resource *levelImageResource, pf::Resource *tilesetResource
         }
     }
 
-    // Initialize entities
-    entityMap = new EntityMap();
+    // Liquid flowing into an empty tile becomes the tileset's first liquid
+    pf::TileCell liquidTile = 0;
+    for (int i = 0; i < Tileset::Count && !liquidTile; i++)
+        if (Tileset::Tiles[i].liquid)
+            liquidTile = MakeTile(i);
+    liquid->Load(tiles, width, height, liquidTile);
+    tileEdits.assign(width * height, 0);
+
+    AddLevelSensors(levelImage);
+    AddLevelPaths(levelImage);
+    AddLevelLights(levelImage);
+    lighting->Load(tiles, width, height);
+}
+
+void pf::World::AddLevelSensors(const sf::Image& levelImage) {
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width;) {
+            const Tileset::Marker *marker = NULL;
+            for (int i = 0; i < Tileset::MarkerCount && !marker; i++)
+                if (Tileset::Markers[i].levelColor == levelImage.GetPixel(x, y))
+                    marker = &Tileset::Markers[i];
+            if (!marker) {
+                x++;
+                continue;
+            }
+
+            // One sensor for the whole run
+            int end = x + 1;
+            while (end < width && levelImage.GetPixel(end, y) == marker->levelColor)
+                end++;
+
+            sensors->Add(x * TILE_SIZE, y * TILE_SIZE, (end - x) * TILE_SIZE, TILE_SIZE, marker->kind, pf::CATEGORY_ALL, true);
+            x = end;
+        }
+    }
+}
+
+void pf::World::AddLevelPaths(const sf::Image& levelImage) {
+    const int stepX[] = { 1, 0, -1, 0 }, stepY[] = { 0, 1, 0, -1 };
+
+    for (int startY = 0; startY < height; startY++) {
+        for (int startX = 0; startX < width; startX++) {
+            if (levelImage.GetPixel(startX, startY) != Tileset::MoverStart) continue;
+
+            pf::LevelPath path;
+            path.loop = false;
+            path.x.push_back(startX * TILE_SIZE);
+            path.y.push_back(startY * TILE_SIZE);
+
+            // Follow the track, noting a waypoint wherever it turns
+            int x = startX, y = startY, direction = -1;
+            for (int steps = 0; steps < width * height; steps++) {
+                int next = -1;
+                for (int i = 0; i < 4 && next < 0; i++) {
+                    if (direction >= 0 && i == (direction + 2) % 4) continue;
+                    int nextX = x + stepX[i], nextY = y + stepY[i];
+                    if (nextX < 0 || nextY < 0 || nextX >= width || nextY >= height) continue;
+
+                    sf::Color color = levelImage.GetPixel(nextX, nextY);
+                    if (color == Tileset::MoverTrack || (direction >= 0 && steps > 1 && nextX == startX && nextY == startY))
+                        next = i;
+                }
+                if (next < 0) break;
+
+                if (direction >= 0 && next != direction) {
+                    path.x.push_back(x * TILE_SIZE);
+                    path.y.push_back(y * TILE_SIZE);
+                }
+                direction = next;
+                x += stepX[next];
+                y += stepY[next];
+
+                if (x == startX && y == startY) {
+                    path.loop = true;
+                    break;
+                }
+            }
+            if (!path.loop && (x != startX || y != startY)) {
+                path.x.push_back(x * TILE_SIZE);
+                path.y.push_back(y * TILE_SIZE);
+            }
+
+            levelPaths.push_back(path);
+        }
+    }
+}
+
+void pf::World::UnloadLevel() {
+    levelPaths.clear();
+    lighting->RemoveLevelLights();
+    sensors->RemoveLevelSensors();
+
+    if (tiles) {
+        delete [] tiles;
+        tiles = NULL;
+    }
+    if (tileSprites) {
+        delete [] tileSprites;
+        tileSprites = NULL;
+    }
+    if (tileset) {
+        delete tileset;
+        tileset = NULL;
+    }
+}
+
+void pf::World::ReloadResource(pf::Resource *resource) {
+    if (resource == levelImageResource || resource == tilesetResource) {
+        pf::Logger::LogInfo("Reloading level");
+        UnloadLevel();
+        LoadLevel();
+    }
+
+    // Reload the sprite sheet of every character wearing a changed skin
+    CharacterSkinMap *skins = pf::CharacterSkin::GetCharacterSkinMap();
+    for (CharacterSkinMap::iterator it = skins->begin(); it != skins->end(); it++) {
+        pf::CharacterSkin *skin = it->second;
+        if (skin->GetResource() != resource) continue;
+
+        skin->Reload();
+        for (int i = 0; i < entities->GetCount(); i++) {
+            pf::Entity *ent = entities->GetAt(i);
+            if (!ent->IsType(pf::Entity::TYPE_CHARACTER)) continue;
+
+            pf::Character *character = static_cast<pf::Character*>(ent);
+            if (character->GetSkin() == skin)
+                character->ReloadSkin();
+        }
+    }
 }
 
 void pf::World::Tick(float frametime) {
-    for (EntityMap::iterator it = entityMap->begin(); it != entityMap->end(); it++)
-        it->second->Tick(frametime);
+#ifdef PLATFORMER_FIXED_POINT
+    // However long the frame took, the world moves in identical steps, and
+    // drops time it can't catch up on rather than falling further behind.
+    // The clock isn't dropped: the last step lands on it.
+    stepCredit = std::min(stepCredit + frametime, FIXED_STEP * MAX_FIXED_STEPS);
+    int steps = 0;
+    for (; stepCredit >= FIXED_STEP; steps++)
+        stepCredit -= FIXED_STEP;
+    for (int i = 0; i < steps; i++) {
+        time = clocked ? clock - (steps - 1 - i) * (double)FIXED_STEP : time + FIXED_STEP;
+        Step(FIXED_STEP);
+    }
+#else
+    time = clocked ? clock : time + frametime;
+    Step(frametime);
+#endif
+}
+
+void pf::World::Step(float frametime) {
+    UpdateMovers(frametime);
+    AssignSteps(frametime);
+
+    // Forces and free movement run as passes over the component arrays
+    bodies->ApplyForces(pf::PhysicsEntity::GRAVITY);
+    bodies->IntegrateNonSolid();
+
+    int count = bodies->GetCount();
+    for (int i = 0; i < count; i++) {
+        if ((bodies->flags[i] & (pf::Bodies::ACTIVE | pf::Bodies::SOLID)) == pf::Bodies::ACTIVE &&
+            (bodies->veloX[i] != 0.f || bodies->veloY[i] != 0.f))
+            UpdateEntity(*bodies->owner[i]);
+    }
+
+    // Solid bodies collide as they move and entities run their own
+    // behaviour, so that still goes entity by entity, spread over the pool
+    // when there are enough of them
+    parallel = processorCount > 1 && entities->GetCount() >= PARALLEL_THRESHOLD;
+    if (parallel) StartPool();
+
+    BuildIslands();
+
+    ticking = true;
+    if (parallel)
+        pool->Run(&jobList[0], jobList.size());
+    else
+        TickEntities(0, tickOrder.size());
+    ticking = false;
+
+    // Sync point: catch the grid up with everything that moved and carry
+    // out whatever was put off during the tick. Entities removed during the
+    // tick are still in the slot map, and may have been deleted, but their
+    // bodies are no longer active.
+    if (parallel) {
+        parallel = false;
+        count = bodies->GetCount();
+        for (int i = 0; i < count; i++)
+            if (bodies->flags[i] & pf::Bodies::ACTIVE)
+                UpdateEntity(*bodies->owner[i]);
+    }
+    ApplyCommands();
+    SolveContacts();
+    UpdateTouching();
+    sensors->Update();
+
+    bodies->ClipVelocities();
+    bodies->UpdateSleep();
+
+    StepLiquid(frametime);
+    lighting->Update();
+#ifdef PLATFORMER_CLIENT
+    particles->Tick(frametime, tiles, width, height);
+#endif
+
+    DispatchContacts();
+}
+
+void pf::World::StartPool() {
+    if (pool) return;
+
+    pool = new pf::JobPool(processorCount);
+    queryScratch.resize(pool->GetThreadCount());
+    raycaster->SetThreadCount(pool->GetThreadCount());
+    threadIsland.resize(pool->GetThreadCount());
+    threadContacts.resize(pool->GetThreadCount());
+    threadAdvances.resize(pool->GetThreadCount());
+}
+
+void pf::World::BuildIslands() {
+    tickOrder.clear();
+    jobList.clear();
+
+    if (!parallel) {
+        // One island holding everyone, in the usual order
+        for (int i = 0; i < entities->GetCount(); i++)
+            tickOrder.push_back(entities->GetAt(i)->GetBody());
+        return;
+    }
+
+    int count = bodies->GetCount();
+    bodyIsland.resize(count);
+    for (int i = 0; i < count; i++)
+        bodyIsland[i] = i;
+
+    // Nothing moves further than the fastest body is going as the tick
+    // starts, plus a stair step and the pixel the ground check looks below
+    float fastest = 0.f;
+    for (int i = 0; i < count; i++) {
+        if ((bodies->flags[i] & (pf::Bodies::ACTIVE | pf::Bodies::SOLID)) != (pf::Bodies::ACTIVE | pf::Bodies::SOLID))
+            continue;
+        float step = pf::ToFloat((pf::Abs(bodies->veloX[i]) + pf::Abs(bodies->veloY[i])) * bodies->step[i]);
+        if (step > fastest) fastest = step;
+    }
+    tickMargin = fastest + STEP_HEIGHT + 1;
+
+    // Solid bodies that could come within reach of each other share an island
+    std::vector<pf::PhysicsEntity*>& scratch = queryScratch[0];
+    for (int i = 0; i < entities->GetCount(); i++) {
+        if (!entities->GetAt(i)->IsType(pf::Entity::TYPE_PHYSICS)) continue;
+        pf::PhysicsEntity *ent = static_cast<pf::PhysicsEntity*>(entities->GetAt(i));
+        if (ent->GetBroadphaseProxy() < 0 || !ent->IsSolid()) continue;
+
+        // Sleeping, frozen and kinematic bodies don't move during the
+        // tick, so whatever could reach them finds them
+        if (ent->IsSleeping() || bodies->step[ent->GetBody()] == 0.f ||
+            bodies->HasFlag(ent->GetBody(), pf::Bodies::KINEMATIC))
+            continue;
+
+        scratch.clear();
+        broadphase->Query(ent->GetX() - tickMargin,
+                          ent->GetY() - tickMargin,
+                          ent->GetWidth() + tickMargin * 2,
+                          ent->GetHeight() + tickMargin * 2,
+                          scratch);
+        for (int j = 0; j < scratch.size(); j++) {
+            if (scratch[j] == ent || !scratch[j]->IsSolid()) continue;
+
+            int a = FindIsland(ent->GetBody()), b = FindIsland(scratch[j]->GetBody());
+            if (a != b) bodyIsland[std::max(a, b)] = std::min(a, b);
+        }
+    }
+    scratch.clear();
+
+    // Order everyone by island, keeping the usual order within each, and
+    // only let queries see their own island
+    std::vector< std::pair<int, int> > order;
+    for (int i = 0; i < entities->GetCount(); i++) {
+        pf::Entity *ent = entities->GetAt(i);
+        int island = FindIsland(ent->GetBody());
+        order.push_back(std::pair<int, int>(island, i));
+        if (ent->GetBroadphaseProxy() >= 0)
+            broadphase->SetTag(ent->GetBroadphaseProxy(), island);
+    }
+    std::sort(order.begin(), order.end());
+
+    for (int i = 0; i < order.size(); i++)
+        tickOrder.push_back(entities->GetAt(order[i].second)->GetBody());
+
+    // Flatten, so bodyIsland holds each body's island from here on
+    for (int i = 0; i < count; i++)
+        FindIsland(i);
+
+    // Pack islands into jobs
+    int begin = 0;
+    for (int i = 1; i <= order.size(); i++) {
+        if (i < order.size() && (i - begin < ENTITIES_PER_JOB || order[i].first == order[i - 1].first))
+            continue;
+
+        if (jobList.size() == islandJobs.size())
+            islandJobs.push_back(new IslandJob(this));
+        IslandJob *job = islandJobs[jobList.size()];
+        job->begin = begin;
+        job->end = i;
+        jobList.push_back(job);
+        begin = i;
+    }
+}
+
+int pf::World::FindIsland(int body) {
+    int root = body;
+    while (bodyIsland[root] != root)
+        root = bodyIsland[root];
+
+    // Point everything on the way straight at the root
+    while (bodyIsland[body] != root) {
+        int next = bodyIsland[body];
+        bodyIsland[body] = root;
+        body = next;
+    }
+
+    return root;
+}
+
+void pf::World::TickEntities(int begin, int end) {
+    int thread = pf::JobPool::GetThreadIndex();
+
+    for (int i = begin; i < end; i++) {
+        int body = tickOrder[i];
+
+        // Removed (or destroyed) earlier in the tick, asleep, or frozen
+        if ((bodies->flags[body] & (pf::Bodies::ACTIVE | pf::Bodies::SLEEPING)) != pf::Bodies::ACTIVE ||
+            bodies->step[body] == 0.f)
+            continue;
+
+        if (parallel) threadIsland[thread] = bodyIsland[body];
+        bodies->owner[body]->Tick(pf::ToFloat(bodies->step[body]));
+    }
+}
+
+void pf::World::AssignSteps(float frametime) {
+    int count = bodies->GetCount();
+    if (!count) return;
+    pf::Scalar *step = &bodies->step[0];
+
+    if (!regionSimulation || regionLevel.empty()) {
+        std::fill(step, step + count, frametime);
+        return;
+    }
+
+    // Everything's frozen but the regions around the anchors
+    std::fill(regionLevel.begin(), regionLevel.end(), REGION_FROZEN);
+    for (int i = 0; i < anchors.size();) {
+        pf::Entity *anchor = entities->Get(anchors[i]);
+        if (!anchor) {
+            anchors[i] = anchors.back();
+            anchors.pop_back();
+            continue;
+        }
+
+        int regionX = TileCoord(anchor->GetX() + anchor->GetWidth() / 2) / REGION_SIZE;
+        int regionY = TileCoord(anchor->GetY() + anchor->GetHeight() / 2) / REGION_SIZE;
+        int reach = 1 + regionMargin;
+        for (int y = std::max(regionY - reach, 0); y <= std::min(regionY + reach, regionsY - 1); y++) {
+            for (int x = std::max(regionX - reach, 0); x <= std::min(regionX + reach, regionsX - 1); x++) {
+                int distance = std::max(std::abs(x - regionX), std::abs(y - regionY));
+                uint8_t level = distance <= 1 ? REGION_ACTIVE : REGION_MARGIN;
+                uint8_t& current = regionLevel[y * regionsX + x];
+                if (level > current) current = level;
+            }
+        }
+        i++;
+    }
+
+    // Regions bank time while they wait, and spend it in bounded steps. The
+    // margin regions take turns so they don't all land on the same tick.
+    const float maxStep = MAX_REGION_STEP, maxCatchUp = MAX_CATCH_UP;
+    tickCount++;
+    for (int i = 0; i < regionLevel.size(); i++) {
+        regionTime[i] += frametime;
+        regionStep[i] = 0.f;
+
+        if (regionLevel[i] == REGION_ACTIVE ||
+            (regionLevel[i] == REGION_MARGIN && (tickCount + i) % marginInterval == 0)) {
+            regionStep[i] = std::min(regionTime[i], maxStep);
+            regionTime[i] -= regionStep[i];
+        }
+        regionTime[i] = std::min(regionTime[i], maxCatchUp);
+    }
+
+    // Bodies go with the region their middle is in
+    const pf::Scalar *x = &bodies->x[0], *y = &bodies->y[0];
+    const int *width = &bodies->width[0], *height = &bodies->height[0];
+    for (int i = 0; i < count; i++) {
+        int regionX = TileCoord(pf::ToFloat(x[i] + width[i] / 2)) / REGION_SIZE;
+        int regionY = TileCoord(pf::ToFloat(y[i] + height[i] / 2)) / REGION_SIZE;
+        regionX = std::min(std::max(regionX, 0), regionsX - 1);
+        regionY = std::min(std::max(regionY, 0), regionsY - 1);
+        step[i] = regionStep[regionY * regionsX + regionX];
+    }
+}
+
+void pf::World::UpdateMovers(float frametime) {
+    if (movers.empty()) return;
+
+    // Whatever's standing on something, grouped by what it's standing on
+    riders.clear();
+    const uint16_t standing = pf::Bodies::ACTIVE | pf::Bodies::ON_GROUND;
+    for (int i = 0; i < bodies->GetCount(); i++) {
+        if ((bodies->flags[i] & standing) == standing && bodies->support[i] >= 0)
+            riders.push_back(std::pair<int, int>(bodies->support[i], i));
+    }
+    std::sort(riders.begin(), riders.end());
+
+    for (int i = 0; i < movers.size();) {
+        pf::Entity *ent = entities->Get(movers[i]);
+        if (!ent) {
+            movers[i] = movers.back();
+            movers.pop_back();
+            continue;
+        }
+        i++;
+
+        pf::Elevator *mover = static_cast<pf::Elevator*>(ent);
+        int body = mover->GetBody();
+        float x, y;
+        mover->GetPathPosition(time, x, y);
+
+        // Its velocity isn't used to move it, but the tick looks at it to
+        // see how far things can get
+        pf::Scalar offsetX = pf::Scalar(x) - bodies->x[body], offsetY = pf::Scalar(y) - bodies->y[body];
+        bodies->veloX[body] = frametime > 0.f ? offsetX / frametime : pf::Scalar(0.f);
+        bodies->veloY[body] = frametime > 0.f ? offsetY / frametime : pf::Scalar(0.f);
+        if (offsetX == pf::Scalar(0.f) && offsetY == pf::Scalar(0.f)) continue;
+
+        CarryRiders(body, offsetX, offsetY);
+        bodies->x[body] = x;
+        bodies->y[body] = y;
+        UpdateEntity(*mover);
+    }
+}
+
+void pf::World::CarryRiders(int body, pf::Scalar offsetX, pf::Scalar offsetY) {
+    // Riders are moved without looking for anything in their way, so paths
+    // need headroom for whatever rides them
+    carryStack.clear();
+    carryStack.push_back(body);
+    while (!carryStack.empty()) {
+        int support = carryStack.back();
+        carryStack.pop_back();
+
+        // Only what's still on top of it. Positions are as of the end of
+        // the last tick, before anything was carried.
+        pf::Scalar left = bodies->x[support], right = left + bodies->width[support], top = bodies->y[support];
+        std::vector< std::pair<int, int> >::iterator it =
+            std::lower_bound(riders.begin(), riders.end(), std::pair<int, int>(support, -1));
+        for (; it != riders.end() && it->first == support; it++) {
+            int rider = it->second;
+            if (pf::Abs(bodies->y[rider] + bodies->height[rider] - top) > CONTACT_MARGIN ||
+                bodies->x[rider] >= right || bodies->x[rider] + bodies->width[rider] <= left)
+                continue;
+
+            carryStack.push_back(rider);
+        }
+
+        if (support == body) continue;
+        bodies->x[support] += offsetX;
+        bodies->y[support] += offsetY;
+        UpdateEntity(*bodies->owner[support]);
+    }
+}
+
+void pf::World::SetRegionSimulation(bool enabled) {
+    regionSimulation = enabled;
+}
+
+void pf::World::SetRegionMargin(int regions, int interval) {
+    regionMargin = std::max(regions, 0);
+    marginInterval = std::max(interval, 1);
+}
+
+void pf::World::AddRegionAnchor(pf::Entity *entity) {
+    if (entity->GetID() && std::find(anchors.begin(), anchors.end(), entity->GetID()) == anchors.end())
+        anchors.push_back(entity->GetID());
 }
 
 void pf::World::Render(sf::RenderTarget& target) {
-    std::vector<pf::Platform*> liquidPlatforms;
-
-    // Draw platforms
-    for (int x = 0; x < width; x++)
-        for (int y = 0; y < height; y++)
-            if (platforms[xy(x, y)])
-                if (platforms[xy(x, y)]->IsLiquid())
-                    liquidPlatforms.push_back(platforms[xy(x, y)]);
-                else
-                    target.Draw((sf::Sprite)*(platforms[xy(x, y)]));
+    if (!tiles) return;
+
+    // Only draw the tiles in view
+    sf::FloatRect viewRect = target.GetView().GetRect();
+    int minX = std::max(TileCoord(viewRect.Left), 0), maxX = std::min(TileCoord(viewRect.Right), width - 1);
+    int minY = std::max(TileCoord(viewRect.Top), 0), maxY = std::min(TileCoord(viewRect.Bottom), height - 1);
+
+    // Draw tiles
+    for (int x = minX; x <= maxX; x++)
+        for (int y = minY; y <= maxY; y++)
+            if (tiles[xy(x, y)] && !(tiles[xy(x, y)] & TILE_LIQUID))
+                DrawTile(target, x, y, tiles[xy(x, y)]);
 
     // Draw renderable entities
-    for (EntityMap::iterator it = entityMap->begin(); it != entityMap->end(); it++) {
-        pf::IRenderable *ent = dynamic_cast<IRenderable*>(it->second);
-        if (ent) ent->Render(target);
+    for (int i = 0; i < entities->GetCount(); i++) {
+        pf::Entity *ent = entities->GetAt(i);
+        if (ent->IsType(pf::Entity::TYPE_PHYSICS))
+            static_cast<pf::PhysicsEntity*>(ent)->Render(target);
+    }
+
+    if (particles) particles->Render(target);
+
+    // Draw front-most tiles
+    for (int x = minX; x <= maxX; x++)
+        for (int y = minY; y <= maxY; y++)
+            if (tiles[xy(x, y)] & TILE_LIQUID)
+                DrawTile(target, x, y, tiles[xy(x, y)]);
+}
+
+void pf::World::DrawTile(sf::RenderTarget& target, int x, int y, pf::TileCell tile) {
+    int index = (tile & TILE_INDEX) - 1;
+    sf::Sprite& sprite = tileSprites[index];
+
+    // Liquid fills a tile from the bottom, and gets darker the fuller it is
+    int tint = LightTint(lighting->GetLevel(x, y));
+    if (tile & TILE_LIQUID) {
+        int level = liquid->GetLevel(x, y), depth = LiquidDepth(level);
+        tint = tint * (255 - level * 100 / LIQUID_FULL) / 255;
+        const sf::IntRect& coords = Tileset::Tiles[index].coords;
+        sprite.SetColor(sf::Color(tint, tint, tint, (int)(Tileset::Tiles[index].alpha * 255)));
+        sprite.SetSubRect(sf::IntRect(coords.Left, coords.Bottom - depth, coords.Right, coords.Bottom));
+        sprite.Resize(TILE_SIZE, depth);
+        sprite.SetPosition(x * TILE_SIZE, y * TILE_SIZE + TILE_SIZE - depth);
+        target.Draw(sprite);
+        sprite.SetSubRect(coords);
+        sprite.Resize(TILE_SIZE, TILE_SIZE);
+        return;
+    }
+    sprite.SetColor(sf::Color(tint, tint, tint, (int)(Tileset::Tiles[index].alpha * 255)));
+
+    if (!(tile & TILE_SHAPE)) {
+        sprite.SetPosition(x * TILE_SIZE, y * TILE_SIZE);
+        target.Draw(sprite);
+        return;
     }
 
-    // Draw front-most platforms
-    for (int i = 0; i < liquidPlatforms.size(); i++)
-        target.Draw((sf::Sprite)*(liquidPlatforms.at(i)));
+    // Shaped tiles are drawn a run of equally tall columns at a time
+    const ShapeProfile& profile = shapeProfiles[GetTileShape(tile)];
+    const sf::IntRect& coords = Tileset::Tiles[index].coords;
+    for (int begin = 0, end; begin < TILE_SIZE; begin = end) {
+        end = begin + 1;
+        while (end < TILE_SIZE && profile.top[end] == profile.top[begin] && profile.bottom[end] == profile.bottom[begin])
+            end++;
+
+        sprite.SetSubRect(sf::IntRect(coords.Left + begin, coords.Top + profile.top[begin],
+                                      coords.Left + end, coords.Top + profile.bottom[begin]));
+        sprite.Resize(end - begin, profile.bottom[begin] - profile.top[begin]);
+        sprite.SetPosition(x * TILE_SIZE + begin, y * TILE_SIZE + profile.top[begin]);
+        target.Draw(sprite);
+    }
+    sprite.SetSubRect(coords);
+    sprite.Resize(TILE_SIZE, TILE_SIZE);
 }
 
 void pf::World::RenderOverlays(sf::RenderTarget& target) {
     // Draw renderable entities
-    for (EntityMap::iterator it = entityMap->begin(); it != entityMap->end(); it++) {
-        pf::IRenderable *ent = dynamic_cast<IRenderable*>(it->second);
-        if (ent) ent->RenderOverlays(target);
+    for (int i = 0; i < entities->GetCount(); i++) {
+        pf::Entity *ent = entities->GetAt(i);
+        if (ent->IsType(pf::Entity::TYPE_PHYSICS))
+            static_cast<pf::PhysicsEntity*>(ent)->RenderOverlays(target);
     }
 }
 
-std::vector<pf::Entity*> pf::World::HitsLevel(pf::Entity& entity) {
+std::vector<pf::Hit> pf::World::HitsLevel(pf::Entity& entity) {
     return HitsLevel(entity.GetX(),
                      entity.GetY(),
                      entity.GetWidth(),
@@ -127,150 +983,1036 @@ std::vector<pf::Entity*> pf::World::HitsLevel(pf::Entity& entity) {
                      &entity);
 }
 
-std::vector<pf::Entity*> pf::World::HitsLevel(float x, float y, float width, float height, pf::Entity *skip) {
-    std::vector<pf::Entity*> retVec;
-    pf::PhysicsEntity *physEnt = skip ? dynamic_cast<pf::PhysicsEntity*>(skip) : NULL;
+std::vector<pf::Hit> pf::World::HitsLevel(float x, float y, float width, float height, pf::Entity *skip) {
+    std::vector<pf::Hit> retVec;
+    VectorCollector collector(retVec);
+    VisitLevel(x, y, width, height, skip, collector);
+    return retVec;
+}
+
+int pf::World::HitsLevel(float x, float y, float width, float height, pf::Entity *skip, pf::Hit *buffer, int capacity) {
+    BufferCollector collector(buffer, capacity);
+    VisitLevel(x, y, width, height, skip, collector);
+    return collector.count;
+}
+
+bool pf::World::HitsLevelAny(float x, float y, float width, float height, pf::Entity *skip, bool ignoreLiquid) {
+    AnyHit visitor(ignoreLiquid);
+    VisitLevel(x, y, width, height, skip, visitor);
+    return visitor.hit;
+}
+
+bool pf::World::VisitLevel(float x, float y, float width, float height, pf::Entity *skip, pf::IHitVisitor& visitor) {
+    pf::CollisionMask mask = skip ? bodies->mask[skip->GetBody()] : pf::CATEGORY_ALL;
+
+    // Check entities in the grid cells the area overlaps for collisions.
+    // Candidates go on the end of this thread's scratch stack and are popped
+    // off afterwards, so a visitor can run queries of its own without
+    // clobbering them, and the stack's memory is reused from call to call.
+    std::vector<pf::PhysicsEntity*>& scratch = queryScratch[pf::JobPool::GetThreadIndex()];
+    int begin = scratch.size();
+    QueryBroadphase(x, y, width, height, scratch);
+    int end = scratch.size();
+    std::sort(scratch.begin() + begin, scratch.begin() + end, CompareEntityID);
+
+    bool stopped = false;
+    for (int i = begin; i < end && !stopped; i++) {
+        pf::PhysicsEntity *ent = scratch[i];
+        if ((bodies->category[ent->GetBody()] & mask) && ent != skip && ent->HitTest(x, y, width, height))
+            stopped = !visitor.Visit(EntityHit(ent));
+    }
+    scratch.resize(begin);
+    if (stopped) return true;
+
+    return VisitTiles(x, y, width, height, visitor, mask);
+}
+
+bool pf::World::SweepLevel(float x, float y, float width, float height, float offsetX, float offsetY, pf::Entity *skip, pf::SweepHit& result) {
+    SweepVisitor sweep(x, y, width, height, offsetX, offsetY);
+
+    // Everything the box passes over on the way
+    VisitLevel(std::min(x, x + offsetX),
+               std::min(y, y + offsetY),
+               width + std::fabs(offsetX),
+               height + std::fabs(offsetY),
+               skip, sweep);
+
+    result = sweep.result;
+    return sweep.found;
+}
+
+bool pf::World::SweepTiles(float x, float y, float width, float height, float offsetX, float offsetY, pf::SweepHit& result) {
+    SweepVisitor sweep(x, y, width, height, offsetX, offsetY);
+    VisitTiles(std::min(x, x + offsetX),
+               std::min(y, y + offsetY),
+               width + std::fabs(offsetX),
+               height + std::fabs(offsetY),
+               sweep);
+
+    result = sweep.result;
+    return sweep.found;
+}
+
+bool pf::World::Raycast(const pf::Ray& ray, pf::SweepHit& result) {
+    return raycaster->Cast(ray, false, result);
+}
+
+bool pf::World::HasLineOfSight(const pf::Ray& ray) {
+    pf::SweepHit result;
+    return !raycaster->Cast(ray, true, result);
+}
+
+void pf::World::RaycastBatch(const pf::Ray *rays, int count, pf::SweepHit *results, bool *hits) {
+    CastRays(rays, count, false, results, hits);
+}
+
+void pf::World::LineOfSightBatch(const pf::Ray *rays, int count, bool *blocked) {
+    CastRays(rays, count, true, NULL, blocked);
+}
+
+void pf::World::CastRays(const pf::Ray *rays, int count, bool anyHit, pf::SweepHit *results, bool *hits) {
+    // Jobs can't submit batches of their own, so rays cast mid-tick stay on
+    // the thread that cast them
+    if (ticking || processorCount < 2 || count < RAYS_PER_JOB * 2) {
+        raycaster->CastBatch(rays, count, anyHit, results, hits, NULL);
+        return;
+    }
+
+    StartPool();
+    raycaster->CastBatch(rays, count, anyHit, results, hits, pool);
+}
+
+void pf::World::QueryBroadphase(float x, float y, float width, float height, std::vector<pf::PhysicsEntity*>& results) {
+    if (!parallel) {
+        broadphase->Query(x, y, width, height, results);
+        return;
+    }
+
+    // The grid still has everyone where they were when the tick started, so
+    // look as far out as anything could have moved since. Only the island
+    // being ticked on this thread can be reached.
+    broadphase->Query(x - tickMargin,
+                      y - tickMargin,
+                      width + tickMargin * 2,
+                      height + tickMargin * 2,
+                      threadIsland[pf::JobPool::GetThreadIndex()],
+                      results);
+}
 
-    // Starting test tile for top-left of entity
-    int baseX = x / TILE_SIZE, baseY = y / TILE_SIZE;
+std::vector<pf::Hit> pf::World::HitsLevel(float x, float y, pf::Entity *skip) {
+    std::vector<pf::Hit> retVec;
+    pf::CollisionMask mask = skip ? bodies->mask[skip->GetBody()] : pf::CATEGORY_ALL;
 
-    // Loop through all entities and check for collisions
-    for (EntityMap::iterator it = entityMap->begin(); it != entityMap->end(); it++) {
-        pf::PhysicsEntity *ent = dynamic_cast<pf::PhysicsEntity*>(it->second);
-        if (ent && ent != skip && ent->HitTest(x, y, width, height) && ((!physEnt) || physEnt->CanCollideWith(ent)))
-            retVec.push_back((pf::Entity*)ent);
+    // Check entities in the grid cell the point is in for collisions
+    std::vector<pf::PhysicsEntity*>& scratch = queryScratch[pf::JobPool::GetThreadIndex()];
+    int begin = scratch.size();
+    QueryBroadphase(x, y, 0, 0, scratch);
+    std::sort(scratch.begin() + begin, scratch.end(), CompareEntityID);
+    for (int i = begin; i < scratch.size(); i++) {
+        pf::PhysicsEntity *ent = scratch[i];
+        if ((bodies->category[ent->GetBody()] & mask) && ent != skip && ent->HitTest(x, y))
+            retVec.push_back(EntityHit(ent));
     }
+    scratch.resize(begin);
+
+    // Check the tile the point is in
+    int tileX = TileCoord(x), tileY = TileCoord(y);
+    pf::TileCell tile = GetTile(tileX, tileY);
+    if ((tile & TILE_SOLID) && (Tileset::Tiles[(tile & TILE_INDEX) - 1].category & mask))
+        retVec.push_back(TileHit(tile, tileX, tileY));
+
+    return retVec;
+}
 
-    // Loop through all tile indices that entity it touching
-    for (int i = 0; i < width / TILE_SIZE + 2; i++) {
-        for (int j = 0; j < height / TILE_SIZE + 2; j++) {
-            if (xy(baseX + i, baseY + j) < 0 || xy(baseX + i, baseY + j) >= this->width * this->height)
+std::vector<pf::Hit> pf::World::HitsTiles(pf::Entity& entity) {
+    return HitsTiles(entity.GetX(),
+                     entity.GetY(),
+                     entity.GetWidth(),
+                     entity.GetHeight());
+}
+
+std::vector<pf::Hit> pf::World::HitsTiles(float x, float y, float width, float height) {
+    std::vector<pf::Hit> retVec;
+    VectorCollector collector(retVec);
+    VisitTiles(x, y, width, height, collector);
+    return retVec;
+}
+
+int pf::World::HitsTiles(float x, float y, float width, float height, pf::Hit *buffer, int capacity) {
+    BufferCollector collector(buffer, capacity);
+    VisitTiles(x, y, width, height, collector);
+    return collector.count;
+}
+
+bool pf::World::VisitTiles(float x, float y, float width, float height, pf::IHitVisitor& visitor, pf::CollisionMask mask) {
+    // Range of tiles the area touches, clipped to the level
+    int minX = std::max(TileCoord(x), 0), maxX = std::min(TileCoord(x + width), this->width - 1);
+    int minY = std::max(TileCoord(y), 0), maxY = std::min(TileCoord(y + height), this->height - 1);
+
+    for (int tileX = minX; tileX <= maxX; tileX++) {
+        for (int tileY = minY; tileY <= maxY; tileY++) {
+            pf::TileCell tile = tiles[xy(tileX, tileY)];
+            if (!(tile & TILE_SOLID) || !(Tileset::Tiles[(tile & TILE_INDEX) - 1].category & mask)) continue;
+
+            // Touching edges don't count as overlapping
+            float left = tileX * TILE_SIZE, top = tileY * TILE_SIZE;
+            if (x >= left + TILE_SIZE || y >= top + TILE_SIZE || x + width <= left || y + height <= top)
+                continue;
+
+            // Only the solid part of a shaped tile under the area counts,
+            // and only the filled part of a liquid one
+            pf::Hit hit = TileHit(tile, tileX, tileY);
+            if ((tile & TILE_SHAPE) &&
+                (!ShapeSpan(hit, x, x + width) || y >= hit.y + hit.height || y + height <= hit.y))
                 continue;
-            pf::Platform *platform = platforms[xy(baseX + i, baseY + j)];
-            if (platform && platform != skip && platform->HitTest(x, y, width, height) && ((!physEnt) || physEnt->CanCollideWith(platform)))
-                retVec.push_back((pf::Entity*)platform);
+            if (tile & TILE_LIQUID) {
+                hit.height = LiquidDepth(liquid->GetLevel(tileX, tileY));
+                hit.y += TILE_SIZE - hit.height;
+                if (y + height <= hit.y) continue;
+            }
+
+            if (!visitor.Visit(hit)) return true;
         }
     }
 
+    return false;
+}
+
+std::vector<pf::Hit> pf::World::HitsTiles(float x, float y) {
+    std::vector<pf::Hit> retVec;
+    int tileX = TileCoord(x), tileY = TileCoord(y);
+    pf::TileCell tile = GetTile(tileX, tileY);
+
+    if (tile & TILE_SOLID)
+        retVec.push_back(TileHit(tile, tileX, tileY));
+
     return retVec;
 }
 
-std::vector<pf::Entity*> pf::World::HitsLevel(float x, float y, pf::Entity *skip) {
-    std::vector<pf::Entity*> retVec;
-    pf::PhysicsEntity *physEnt = skip ? dynamic_cast<pf::PhysicsEntity*>(skip) : NULL;
+void pf::World::AddEntity(pf::Entity *entity) {
+    pf::EntityHandle id = entity->GetID();
+    if (id && entities->Get(id) == entity)
+        return;
 
-    // Starting test tile for top-left of entity
-    int baseX = x / TILE_SIZE, baseY = y / TILE_SIZE;
+    if (ticking) {
+        Command command;
+        command.type = Command::ADD;
+        command.entity = entity;
+        QueueCommand(command);
+        return;
+    }
 
-    // Loop through all entities and check for collisions
-    for (EntityMap::iterator it = entityMap->begin(); it != entityMap->end(); it++) {
-        pf::PhysicsEntity *ent = dynamic_cast<pf::PhysicsEntity*>(it->second);
-        if (ent && ent != skip && ent->HitTest(x, y) && ((!physEnt) || physEnt->CanCollideWith(ent)))
-            retVec.push_back((pf::Entity*)ent);
+    if (id) {
+        // Use the handle the entity was given. Anything already in that
+        // slot (only ever an entity of our own, on the client) moves aside.
+        pf::Entity *displaced;
+        if (!entities->InsertAt(id, entity, displaced))
+            return;
+        if (displaced)
+            displaced->SetID(entities->Insert(displaced));
+    } else {
+        id = entities->Insert(entity);
+        if (!id) return;
+        entity->SetID(id);
     }
 
-    // Loop through all tile indices that entity it touching
-    for (int i = 0; i < width / TILE_SIZE + 2; i++) {
-        for (int j = 0; j < height / TILE_SIZE + 2; j++) {
-            if (xy(baseX + i, baseY + j) < 0 || xy(baseX + i, baseY + j) >= this->width * this->height)
-                continue;
-            pf::Platform *platform = platforms[xy(baseX + i, baseY + j)];
-            if (platform && platform != skip && platform->HitTest(x, y) && ((!physEnt) || physEnt->CanCollideWith(platform)))
-                retVec.push_back((pf::Entity*)platform);
+    bodies->SetFlag(entity->GetBody(), pf::Bodies::ACTIVE, true);
+    if (entity->IsType(pf::Entity::TYPE_PLATFORM))
+        movers.push_back(id);
+
+    // Only physics entities can be collided with, so only they are tracked
+    if (!entity->IsType(pf::Entity::TYPE_PHYSICS)) return;
+    pf::PhysicsEntity *physEnt = static_cast<pf::PhysicsEntity*>(entity);
+    if (physEnt->GetBroadphaseProxy() < 0)
+        physEnt->SetBroadphaseProxy(broadphase->Insert(physEnt,
+                                                       physEnt->GetX(),
+                                                       physEnt->GetY(),
+                                                       physEnt->GetWidth(),
+                                                       physEnt->GetHeight()));
+}
+
+pf::Entity *pf::World::GetEntity(pf::EntityHandle id) {
+    return entities->Get(id);
+}
+
+pf::EntitySlots *pf::World::GetEntities() {
+    return entities;
+}
+
+bool pf::World::RemoveEntity(pf::Entity& entity) {
+    if (entities->Get(entity.GetID()) != &entity)
+        return false;
+
+    if (ticking) {
+        // Stop ticking the entity and hide it from queries now, since it may
+        // be about to be deleted; the slot map and the grid catch up later
+        Command command;
+        command.type = Command::REMOVE;
+        command.entity = &entity;
+        command.id = entity.GetID();
+        command.proxy = entity.GetBroadphaseProxy();
+        if (command.proxy >= 0 && !parallel) {
+            broadphase->Remove(command.proxy);
+            command.proxy = -1;
+        } else if (command.proxy >= 0) {
+            broadphase->SetTag(command.proxy, pf::SpatialHash::HIDDEN_TAG);
         }
+        QueueCommand(command);
+
+        entity.SetID(0);
+        entity.SetBroadphaseProxy(-1);
+        bodies->SetFlag(entity.GetBody(), pf::Bodies::ACTIVE, false);
+        return true;
     }
 
-    return retVec;
+    entities->Remove(entity.GetID());
+    entity.SetID(0);
+    bodies->SetFlag(entity.GetBody(), pf::Bodies::ACTIVE, false);
+
+    if (entity.GetBroadphaseProxy() >= 0) {
+        broadphase->Remove(entity.GetBroadphaseProxy());
+        entity.SetBroadphaseProxy(-1);
+    }
+
+    return true;
+}
+
+void pf::World::UpdateEntity(pf::Entity& entity) {
+    // Other threads are reading the grid; it's caught up after the tick
+    if (parallel || entity.GetBroadphaseProxy() < 0) return;
+
+    broadphase->Update(entity.GetBroadphaseProxy(),
+                       entity.GetX(),
+                       entity.GetY(),
+                       entity.GetWidth(),
+                       entity.GetHeight());
+}
+
+void pf::World::DestroyBody(int body) {
+    if (!ticking) {
+        bodies->Destroy(body);
+        return;
+    }
+
+    bodies->SetFlag(body, pf::Bodies::ACTIVE, false);
+
+    Command command;
+    command.type = Command::DESTROY;
+    command.body = body;
+    QueueCommand(command);
+}
+
+bool pf::World::IsTicking() {
+    return ticking;
+}
+
+bool pf::World::DeferPush(pf::PhysicsEntity *entity, float offsetX, float offsetY) {
+    if (!parallel || bodyIsland[entity->GetBody()] == threadIsland[pf::JobPool::GetThreadIndex()])
+        return false;
+
+    Command command;
+    command.type = Command::PUSH;
+    command.id = entity->GetID();
+    command.offsetX = offsetX;
+    command.offsetY = offsetY;
+    QueueCommand(command);
+    return true;
+}
+
+void pf::World::WakeBody(int body) {
+    if (!bodies->HasFlag(body, pf::Bodies::SLEEPING)) {
+        bodies->restTime[body] = 0.f;
+        return;
+    }
+
+    Command command;
+    command.type = Command::WAKE;
+    command.body = body;
+
+    // Another island's bodies are off limits until the sync point
+    if (parallel) {
+        if (bodyIsland[body] == threadIsland[pf::JobPool::GetThreadIndex()])
+            bodies->SetFlag(body, pf::Bodies::SLEEPING, false);
+        QueueCommand(command);
+        return;
+    }
+
+    bodies->SetFlag(body, pf::Bodies::SLEEPING, false);
+    bodies->restTime[body] = 0.f;
+
+    // Whatever it was holding up has to find out whether it still is
+    WakeArea(pf::ToFloat(bodies->x[body]), pf::ToFloat(bodies->y[body]) - 1, bodies->width[body], 1);
+}
+
+void pf::World::WakeArea(float x, float y, float width, float height) {
+    std::vector<pf::PhysicsEntity*>& scratch = queryScratch[pf::JobPool::GetThreadIndex()];
+    int begin = scratch.size();
+    QueryBroadphase(x, y, width, height, scratch);
+
+    // Waking can query again, growing the stack past begin
+    for (int i = begin; i < scratch.size(); i++) {
+        pf::PhysicsEntity *ent = scratch[i];
+        if (ent->IsSleeping() && ent->HitTest(x, y, width, height))
+            WakeBody(ent->GetBody());
+    }
+    scratch.resize(begin);
 }
 
-std::vector<pf::Entity*> pf::World::HitsPlatform(pf::Entity& entity) {
-    return HitsPlatform(entity.GetX(),
-                        entity.GetY(),
-                        entity.GetWidth(),
-                        entity.GetHeight());
+void pf::World::QueueCommand(const Command& command) {
+    commandLock.Lock();
+    commands.push_back(command);
+    commandLock.Unlock();
 }
 
-std::vector<pf::Entity*> pf::World::HitsPlatform(float x, float y, float width, float height) {
-    std::vector<pf::Entity*> retVec;
+void pf::World::ApplyCommands() {
+    for (int i = 0; i < commands.size(); i++) {
+        Command& command = commands[i];
+        switch (command.type) {
+            case Command::ADD:
+                AddEntity(command.entity);
+                break;
+            case Command::REMOVE:
+                // The entity may be gone by now, so it's only compared against
+                if (entities->Get(command.id) == command.entity)
+                    entities->Remove(command.id);
+                if (command.proxy >= 0)
+                    broadphase->Remove(command.proxy);
+                break;
+            case Command::DESTROY:
+                bodies->Destroy(command.body);
+                break;
+            case Command::PUSH: {
+                pf::Entity *ent = entities->Get(command.id);
+                if (ent && ent->IsType(pf::Entity::TYPE_PHYSICS))
+                    static_cast<pf::PhysicsEntity*>(ent)->Push(command.offsetX, command.offsetY);
+                break;
+            }
+            case Command::WAKE: {
+                int body = command.body;
+                if (!bodies->owner[body]) break;
+
+                bodies->SetFlag(body, pf::Bodies::SLEEPING, false);
+                bodies->restTime[body] = 0.f;
+                WakeArea(pf::ToFloat(bodies->x[body]), pf::ToFloat(bodies->y[body]) - 1, bodies->width[body], 1);
+                break;
+            }
+        }
+    }
+    commands.clear();
+}
+
+void pf::World::AddContact(pf::PhysicsEntity *pusher, pf::PhysicsEntity *pushed, int axis, int dir) {
+    Contact contact;
+    contact.a = pusher->GetBody();
+    contact.b = pushed->GetBody();
+    contact.axis = axis;
+    contact.dir = dir;
+    contact.island = 0;
+    threadContacts[pf::JobPool::GetThreadIndex()].push_back(contact);
+}
+
+void pf::World::DeferAdvance(pf::PhysicsEntity *entity, int axis, float distance) {
+    Advance advance;
+    advance.body = entity->GetBody();
+    advance.axis = axis;
+    advance.distance = distance;
+    advance.island = 0;
+    threadAdvances[pf::JobPool::GetThreadIndex()].push_back(advance);
+}
+
+void pf::World::SolveContacts() {
+    contacts.clear();
+    advances.clear();
+    for (int i = 0; i < threadContacts.size(); i++) {
+        contacts.insert(contacts.end(), threadContacts[i].begin(), threadContacts[i].end());
+        advances.insert(advances.end(), threadAdvances[i].begin(), threadAdvances[i].end());
+        threadContacts[i].clear();
+        threadAdvances[i].clear();
+    }
+    if (contacts.empty()) return;
+
+    // Bodies pressing on each other, however indirectly, share an island
+    int count = bodies->GetCount();
+    bodyIsland.resize(count);
+    solverFlags.resize(count, 0);
+    for (int i = 0; i < contacts.size(); i++) {
+        bodyIsland[contacts[i].a] = contacts[i].a;
+        bodyIsland[contacts[i].b] = contacts[i].b;
+    }
+    for (int i = 0; i < advances.size(); i++)
+        bodyIsland[advances[i].body] = advances[i].body;
+    for (int i = 0; i < contacts.size(); i++) {
+        int a = FindIsland(contacts[i].a), b = FindIsland(contacts[i].b);
+        if (a != b) bodyIsland[std::max(a, b)] = std::min(a, b);
+    }
+    for (int i = 0; i < contacts.size(); i++)
+        contacts[i].island = FindIsland(contacts[i].a);
+    for (int i = 0; i < advances.size(); i++)
+        advances[i].island = FindIsland(advances[i].body);
+    std::sort(contacts.begin(), contacts.end());
+    std::sort(advances.begin(), advances.end());
+
+    int nextAdvance = 0;
+    for (int begin = 0; begin < contacts.size();) {
+        int island = contacts[begin].island, end = begin;
+        while (end < contacts.size() && contacts[end].island == island)
+            end++;
+        islandContacts.assign(contacts.begin() + begin, contacts.begin() + end);
+        begin = end;
+
+        // Carry the pushers on into what they pushed
+        for (; nextAdvance < advances.size() && advances[nextAdvance].island <= island; nextAdvance++) {
+            const Advance& advance = advances[nextAdvance];
+            if (advance.island < island || !(bodies->flags[advance.body] & pf::Bodies::ACTIVE)) continue;
+
+            (advance.axis == AXIS_X ? bodies->x : bodies->y)[advance.body] += advance.distance;
+            UpdateEntity(*bodies->owner[advance.body]);
+            if (!(solverFlags[advance.body] & SOLVER_TOUCHED)) {
+                solverFlags[advance.body] |= SOLVER_TOUCHED;
+                solverTouched.push_back(advance.body);
+            }
+        }
+
+        // Sweep back and forth, so a push can run down a row of bodies and
+        // whatever stops it can run back up
+        for (int pass = 0; pass < SOLVER_ITERATIONS; pass++) {
+            bool changed = false;
+            if (pass % 2 == 0) {
+                for (int i = 0; i < islandContacts.size(); i++)
+                    changed |= RelaxContact(islandContacts[i]);
+            } else {
+                for (int i = islandContacts.size() - 1; i >= 0; i--)
+                    changed |= RelaxContact(islandContacts[i]);
+            }
+            if (!changed) break;
+        }
+
+        for (int i = 0; i < solverTouched.size(); i++) {
+            int body = solverTouched[i];
+            solverFlags[body] = 0;
+            if (bodies->owner[body]) WakeBody(body);
+        }
+        solverTouched.clear();
+    }
+}
+
+bool pf::World::RelaxContact(const Contact& contact) {
+    // Copied, since finding contacts can move islandContacts
+    int a = contact.a, b = contact.b, axis = contact.axis, dir = contact.dir;
+    const uint16_t active = pf::Bodies::ACTIVE | pf::Bodies::SOLID;
+    if ((bodies->flags[a] & active) != active || (bodies->flags[b] & active) != active)
+        return false;
+
+    std::vector<pf::Scalar>& along = axis == AXIS_X ? bodies->x : bodies->y;
+    std::vector<pf::Scalar>& across = axis == AXIS_X ? bodies->y : bodies->x;
+    std::vector<int>& length = axis == AXIS_X ? bodies->width : bodies->height;
+    std::vector<int>& breadth = axis == AXIS_X ? bodies->height : bodies->width;
+
+    // Only bodies still side by side can press on each other
+    if (across[a] >= across[b] + breadth[b] || across[a] + breadth[a] <= across[b])
+        return false;
+    pf::Scalar depth = dir > 0 ? along[a] + length[a] - along[b] : along[b] + length[b] - along[a];
+    if (depth <= 0.001f) return false;
+
+    uint8_t blocked = BlockedBit(axis, dir);
+    int touched[2] = { a, b };
+    for (int i = 0; i < 2; i++) {
+        if (!(solverFlags[touched[i]] & SOLVER_TOUCHED)) {
+            solverFlags[touched[i]] |= SOLVER_TOUCHED;
+            solverTouched.push_back(touched[i]);
+        }
+    }
+
+    // Anything standing on something is as good as the ground
+    if (!(bodies->flags[b] & pf::Bodies::PUSHABLE) ||
+        (axis == AXIS_Y && dir > 0 && (bodies->flags[b] & pf::Bodies::ON_GROUND)))
+        solverFlags[b] |= blocked;
+
+    // b goes as far as the tiles let it, running into whatever's next
+    pf::Scalar moved = 0.f;
+    if (!(solverFlags[b] & blocked)) {
+        pf::SweepHit sweep;
+        float offset = pf::ToFloat(dir * depth);
+        moved = depth;
+        if (SweepTiles(pf::ToFloat(bodies->x[b]), pf::ToFloat(bodies->y[b]), bodies->width[b], bodies->height[b],
+                       axis == AXIS_X ? offset : 0.f, axis == AXIS_Y ? offset : 0.f, sweep)) {
+            moved = depth * sweep.time;
+            solverFlags[b] |= blocked;
+        }
+
+        if (moved > pf::Scalar(0.f)) {
+            along[b] += dir * moved;
+            if (axis == AXIS_X)
+                bodies->veloX[b] += dir * moved;
+            else
+                bodies->veloY[b] = 0.f;
+            UpdateEntity(*bodies->owner[b]);
+            FindContacts(b, a, axis, dir);
+        }
+    }
+
+    // a backs off by whatever b couldn't take, and can't get any further
+    // that way itself
+    if (depth - moved > 0.001f) {
+        along[a] -= dir * (depth - moved);
+        solverFlags[a] |= blocked;
+        UpdateEntity(*bodies->owner[a]);
+    }
+
+    return true;
+}
+
+void pf::World::FindContacts(int body, int pusher, int axis, int dir) {
+    pf::Entity *ent = bodies->owner[body];
+    if (!ent || !ent->IsType(pf::Entity::TYPE_PHYSICS) || islandContacts.size() >= MAX_SOLVER_CONTACTS) return;
+
+    float x = pf::ToFloat(bodies->x[body]), y = pf::ToFloat(bodies->y[body]);
+    int width = bodies->width[body], height = bodies->height[body];
+    float middle = axis == AXIS_X ? x + width / 2.f : y + height / 2.f;
+
+    std::vector<pf::PhysicsEntity*>& scratch = queryScratch[0];
+    int begin = scratch.size();
+    QueryBroadphase(x, y, width, height, scratch);
+    std::sort(scratch.begin() + begin, scratch.end(), CompareEntityID);
 
-    // Starting test tile for top-left of entity
-    int baseX = x / TILE_SIZE, baseY = y / TILE_SIZE;
+    for (int i = begin; i < scratch.size() && islandContacts.size() < MAX_SOLVER_CONTACTS; i++) {
+        pf::PhysicsEntity *other = scratch[i];
+        if (other == ent || other->GetBody() == pusher ||
+            !ent->CanCollideWith(other) || !other->HitTest(x, y, width, height))
+            continue;
 
-    // Loop through all tile indices that entity it touching
-    for (int i = 0; i < width / TILE_SIZE + 2; i++) {
-        for (int j = 0; j < height / TILE_SIZE + 2; j++) {
-            if (xy(baseX + i, baseY + j) < 0 || xy(baseX + i, baseY + j) >= this->width * this->height)
+        // Only what's ahead gets pushed along
+        float otherMiddle = axis == AXIS_X
+            ? other->GetX() + other->GetWidth() / 2.f
+            : other->GetY() + other->GetHeight() / 2.f;
+        if ((otherMiddle - middle) * dir <= 0.f) continue;
+
+        Contact contact;
+        contact.a = body;
+        contact.b = other->GetBody();
+        contact.axis = axis;
+        contact.dir = dir;
+        contact.island = islandContacts[0].island;
+        if (std::find(islandContacts.begin(), islandContacts.end(), contact) == islandContacts.end())
+            islandContacts.push_back(contact);
+    }
+    scratch.resize(begin);
+}
+
+void pf::World::AddContactListener(pf::IContactListener *listener) {
+    if (std::find(contactListeners.begin(), contactListeners.end(), listener) == contactListeners.end())
+        contactListeners.push_back(listener);
+}
+
+void pf::World::RemoveContactListener(pf::IContactListener *listener) {
+    std::vector<pf::IContactListener*>::iterator it = std::find(contactListeners.begin(), contactListeners.end(), listener);
+    if (it != contactListeners.end())
+        contactListeners.erase(it);
+}
+
+bool pf::World::IsTouching(pf::Entity *a, pf::Entity *b) {
+    TouchingPair pair(std::min(a->GetID(), b->GetID()), std::max(a->GetID(), b->GetID()));
+    return std::binary_search(touching.begin(), touching.end(), pair);
+}
+
+void pf::World::UpdateTouching() {
+    touching.swap(lastTouching);
+    touching.clear();
+
+    // Nothing resting has moved, so pairs of resting bodies still touch
+    for (int i = 0; i < lastTouching.size(); i++) {
+        pf::Entity *a = entities->Get(lastTouching[i].first);
+        pf::Entity *b = entities->Get(lastTouching[i].second);
+        if (a && b && bodies->IsResting(a->GetBody()) && bodies->IsResting(b->GetBody()))
+            touching.push_back(lastTouching[i]);
+    }
+
+    // Everything else looks around itself again
+    std::vector<pf::PhysicsEntity*>& scratch = queryScratch[0];
+    for (int i = 0; i < entities->GetCount(); i++) {
+        pf::Entity *ent = entities->GetAt(i);
+        if (!ent->IsType(pf::Entity::TYPE_PHYSICS) || ent->GetBroadphaseProxy() < 0) continue;
+
+        int body = ent->GetBody();
+        if (bodies->IsResting(body)) continue;
+
+        float x = pf::ToFloat(bodies->x[body]), y = pf::ToFloat(bodies->y[body]);
+        int width = bodies->width[body], height = bodies->height[body];
+
+        int begin = scratch.size();
+        broadphase->Query(x - CONTACT_MARGIN,
+                          y - CONTACT_MARGIN,
+                          width + CONTACT_MARGIN * 2,
+                          height + CONTACT_MARGIN * 2,
+                          scratch);
+
+        for (int j = begin; j < scratch.size(); j++) {
+            pf::PhysicsEntity *other = scratch[j];
+            if (other == ent) continue;
+
+            // Two moving bodies find each other, so only one keeps the pair
+            if (!bodies->IsResting(other->GetBody()) && other->GetID() < ent->GetID()) continue;
+            if (!ent->CanCollideWith(other) && !other->CanCollideWith(ent)) continue;
+
+            float otherX = other->GetX(), otherY = other->GetY();
+            if (otherX > x + width + CONTACT_MARGIN || otherX + other->GetWidth() < x - CONTACT_MARGIN ||
+                otherY > y + height + CONTACT_MARGIN || otherY + other->GetHeight() < y - CONTACT_MARGIN)
                 continue;
-            pf::Platform *platform = platforms[xy(baseX + i, baseY + j)];
-            if (platform && platform->HitTest(x, y, width, height))
-                retVec.push_back((pf::Entity*)platform);
+
+            touching.push_back(TouchingPair(std::min(ent->GetID(), other->GetID()),
+                                            std::max(ent->GetID(), other->GetID())));
         }
+        scratch.resize(begin);
     }
 
-    return retVec;
+    std::sort(touching.begin(), touching.end());
 }
 
-std::vector<pf::Entity*> pf::World::HitsPlatform(float x, float y) {
-    std::vector<pf::Entity*> retVec;
+void pf::World::DispatchContacts() {
+    if (contactListeners.empty()) return;
 
-    // Starting test tile for top-left of entity
-    int baseX = x / TILE_SIZE, baseY = y / TILE_SIZE;
+    // Both lists are sorted, so walk them together
+    int i = 0, j = 0;
+    while (i < lastTouching.size() || j < touching.size()) {
+        bool ended = j == touching.size() || (i < lastTouching.size() && lastTouching[i] < touching[j]);
+        bool began = !ended && (i == lastTouching.size() || touching[j] < lastTouching[i]);
+        TouchingPair pair = ended ? lastTouching[i] : touching[j];
 
-    // Loop through all tile indices that entity it touching
-    for (int i = 0; i < width / TILE_SIZE + 2; i++) {
-        for (int j = 0; j < height / TILE_SIZE + 2; j++) {
-            if (xy(baseX + i, baseY + j) < 0 || xy(baseX + i, baseY + j) >= this->width * this->height)
+        for (int k = 0; k < contactListeners.size(); k++) {
+            if (ended) {
+                contactListeners[k]->ContactEnd(pair.first, pair.second);
                 continue;
-            pf::Platform *platform = platforms[xy(baseX + i, baseY + j)];
+            }
 
-            if (platform && platform->HitTest(x, y))
-                retVec.push_back((pf::Entity*)platform);
+            // An earlier listener may have removed either of them
+            pf::Entity *a = entities->Get(pair.first), *b = entities->Get(pair.second);
+            if (!a || !b) break;
+
+            if (began)
+                contactListeners[k]->ContactBegin(a, b);
+            else
+                contactListeners[k]->ContactStay(a, b);
         }
+
+        if (!began) i++;
+        if (!ended) j++;
     }
+}
 
-    return retVec;
+int pf::World::AddSensor(float x, float y, int width, int height, int kind, pf::CollisionMask mask) {
+    return sensors->Add(x, y, width, height, kind, mask);
 }
 
-void pf::World::AddEntity(pf::Entity *entity) {
-    entityMap->insert(std::pair<int, pf::Entity*>(entity->GetID(), entity));
+void pf::World::RemoveSensor(int sensor) {
+    sensors->Remove(sensor);
 }
 
-pf::Entity *pf::World::GetEntity(int id) {
-    EntityMap::iterator iter = entityMap->find(id);
+void pf::World::SetSensorBounds(int sensor, float x, float y, int width, int height) {
+    sensors->SetBounds(sensor, x, y, width, height);
+}
 
-    if (iter == entityMap->end())
-        return NULL;
+int pf::World::GetSensorKind(int sensor) {
+    return sensors->GetKind(sensor);
+}
 
-    return iter->second;
+const std::vector<pf::World::SensorOverlap>& pf::World::GetSensorOverlaps() {
+    return sensors->GetOverlaps();
 }
 
-bool pf::World::RemoveEntity(pf::Entity& entity) {
-    entityMap->erase(entity.GetID());
+const std::vector<pf::SensorEvent>& pf::World::GetSensorEvents() {
+    return sensors->GetEvents();
 }
 
-void pf::World::RemovePlatform(pf::Platform& platform) {
-    platforms[xy((int)platform.GetX() / TILE_SIZE, (int)platform.GetY() / TILE_SIZE)] = 0;
+double pf::World::GetTime() {
+    return time;
+}
+
+void pf::World::SetClock(double seconds) {
+    clock = seconds;
+    clocked = true;
+}
+
+const std::vector<pf::LevelPath>& pf::World::GetLevelPaths() {
+    return levelPaths;
+}
+
+pf::Bodies *pf::World::GetBodies() {
+    return bodies;
+}
+
+pf::ParticleSystem *pf::World::GetParticles() {
+    return particles;
+}
+
+pf::TileCell pf::World::MakeTile(int index) {
+    pf::TileCell tile = index + 1;
+    if (Tileset::Tiles[index].solid) tile |= TILE_SOLID;
+    if (Tileset::Tiles[index].liquid) tile |= TILE_LIQUID;
+    tile |= Tileset::Tiles[index].shape << TILE_SHAPE_SHIFT;
+    return tile;
+}
+
+int pf::World::GetTileShape(pf::TileCell tile) {
+    return (tile & TILE_SHAPE) >> TILE_SHAPE_SHIFT;
+}
+
+bool pf::World::ShapeSpan(pf::Hit& hit, float left, float right) {
+    int first = std::max((int)std::floor(left - hit.x), 0);
+    int last = std::min((int)std::ceil(right - hit.x) - 1, TILE_SIZE - 1);
+    if (first > last) return false;
+
+    const ShapeProfile& profile = shapeProfiles[GetTileShape(hit.tile)];
+    int top = profile.top[first], bottom = profile.bottom[first];
+    for (int column = first + 1; column <= last; column++) {
+        top = std::min(top, (int)profile.top[column]);
+        bottom = std::max(bottom, (int)profile.bottom[column]);
+    }
+
+    hit.y += top;
+    hit.height = bottom - top;
+    return true;
+}
+
+pf::TileCell pf::World::GetTile(int x, int y) {
+    if (!tiles || x < 0 || y < 0 || x >= width || y >= height)
+        return 0;
+
+    return tiles[xy(x, y)];
+}
+
+void pf::World::SetTile(int x, int y, int index) {
+    if (!tiles || x < 0 || y < 0 || x >= width || y >= height)
+        return;
+    if (index < -1 || index >= Tileset::Count || (index >= 0 && Tileset::Tiles[index].liquid))
+        return;
+    if (!EditTile(x, y, index < 0 ? 0 : MakeTile(index))) return;
+
+    // Anything resting on or against the tile may have lost its support,
+    // and liquid beside it may be able to flow in
+    WakeArea(x * TILE_SIZE - 1, y * TILE_SIZE - 1, TILE_SIZE + 2, TILE_SIZE + 2);
+    liquid->Activate(x, y, x, y);
+}
+
+void pf::World::RemoveTile(int x, int y) {
+    if (!GetTile(x, y)) return;
+
+    SetTile(x, y, -1);
+    CrumbleTile(x, y, 24);
+}
+
+int pf::World::RemoveTiles(float x, float y, float radius) {
+    if (!tiles || radius <= 0.f) return 0;
+
+    int minX = std::max(TileCoord(x - radius), 0), maxX = std::min(TileCoord(x + radius), width - 1);
+    int minY = std::max(TileCoord(y - radius), 0), maxY = std::min(TileCoord(y + radius), height - 1);
+    int removed = 0;
+    for (int tileY = minY; tileY <= maxY; tileY++) {
+        for (int tileX = minX; tileX <= maxX; tileX++) {
+            pf::TileCell tile = tiles[xy(tileX, tileY)];
+            if (!tile || (tile & TILE_LIQUID)) continue;
+
+            float offsetX = (tileX + 0.5f) * TILE_SIZE - x, offsetY = (tileY + 0.5f) * TILE_SIZE - y;
+            if (offsetX * offsetX + offsetY * offsetY > radius * radius) continue;
+
+            EditTile(tileX, tileY, 0);
+            CrumbleTile(tileX, tileY, 4);
+            removed++;
+        }
+    }
+    if (!removed) return 0;
+
+    // One wake and one round of liquid chunks for the whole blast
+    WakeArea(minX * TILE_SIZE - 1, minY * TILE_SIZE - 1,
+             (maxX - minX + 1) * TILE_SIZE + 2, (maxY - minY + 1) * TILE_SIZE + 2);
+    liquid->Activate(minX, minY, maxX, maxY);
+
+    return removed;
+}
+
+void pf::World::TakeTileEdits(std::vector<pf::TileRun>& runs) {
+    for (int i = 0; i < unsentTiles.size(); i++)
+        tileEdits[unsentTiles[i]] &= ~EDIT_UNSENT;
+
+    GetTileRuns(unsentTiles, runs);
+    unsentTiles.clear();
+}
+
+void pf::World::GetTileSnapshot(std::vector<pf::TileRun>& runs) {
+    GetTileRuns(touchedTiles, runs);
+}
+
+bool pf::World::EditTile(int x, int y, pf::TileCell tile) {
+    int cell = xy(x, y);
+    if (tiles[cell] == tile) return false;
+
+    // The edit drains the tile on clients too, so any liquid that flows
+    // back in has to be sent again
+    liquid->Drain(x, y);
+    tiles[cell] = tile;
+
+    if (!(tileEdits[cell] & EDIT_UNSENT)) unsentTiles.push_back(cell);
+    if (!(tileEdits[cell] & EDIT_TOUCHED)) touchedTiles.push_back(cell);
+    tileEdits[cell] |= EDIT_UNSENT | EDIT_TOUCHED;
+
+    lighting->TileChanged(x, y);
+    return true;
+}
+
+void pf::World::CrumbleTile(int x, int y, int pieces) {
+    // Debris is only for show. The server's edits reach clients as crumbling
+    // TileEdits, so clients make their own.
+#ifdef PLATFORMER_CLIENT
+    for (int i = 0; i < pieces; i++) {
+        particles->Emit((x + sf::Randomizer::Random(0.f, 1.f)) * TILE_SIZE,
+                        (y + sf::Randomizer::Random(0.f, 1.f)) * TILE_SIZE,
+                        sf::Randomizer::Random(-60.f, 60.f),
+                        sf::Randomizer::Random(-120.f, 0.f),
+                        sf::Randomizer::Random(0.5f, 1.5f),
+                        1.f, 0.3f, sf::Color(120, 100, 80));
+    }
+#endif
+}
+
+void pf::World::GetTileRuns(std::vector<int>& edited, std::vector<pf::TileRun>& runs) {
+    runs.clear();
+    std::sort(edited.begin(), edited.end());
+
+    for (int i = 0; i < edited.size(); i++) {
+        pf::TileCell tile = tiles[edited[i]];
+        int index = (!tile || (tile & TILE_LIQUID)) ? -1 : (tile & TILE_INDEX) - 1;
+
+        // Neighbouring tiles set alike extend the last run
+        if (!runs.empty() && runs.back().start + runs.back().count == edited[i] && runs.back().index == index) {
+            runs.back().count++;
+            continue;
+        }
+
+        pf::TileRun run;
+        run.start = edited[i];
+        run.count = 1;
+        run.index = index;
+        runs.push_back(run);
+    }
+}
+
+int pf::World::GetLiquid(int x, int y) {
+    if (!tiles || x < 0 || y < 0 || x >= width || y >= height)
+        return 0;
+
+    return liquid->GetLevel(x, y);
+}
+
+void pf::World::SetLiquid(int x, int y, int level) {
+    if (!tiles) return;
+
+    // Filling or emptying the tile changes what overlaps it
+    if (liquid->SetLevel(x, y, level))
+        WakeArea(x * TILE_SIZE - 1, y * TILE_SIZE - 1, TILE_SIZE + 2, TILE_SIZE + 2);
+}
+
+void pf::World::SetLiquidSimulation(bool enabled) {
+    liquid->SetSimulation(enabled);
+}
+
+void pf::World::TakeLiquidDeltas(std::vector<pf::LiquidDelta>& deltas) {
+    liquid->TakeDeltas(deltas);
+}
+
+void pf::World::GetLiquidSnapshot(std::vector<pf::LiquidDelta>& deltas) {
+    liquid->GetSnapshot(deltas);
+}
+
+void pf::World::StepLiquid(float frametime) {
+    // Enough moving chunks are worth spreading over the pool
+    if (processorCount > 1 && liquid->GetActiveCount() >= LIQUID_CHUNKS_PER_JOB * 2)
+        StartPool();
+    liquid->Step(frametime, pool, flippedChunks);
+
+    // Whatever's asleep where liquid arrived or drained away has to notice
+    int chunksX = (width + LIQUID_CHUNK - 1) / LIQUID_CHUNK;
+    for (int i = 0; i < flippedChunks.size(); i++) {
+        int chunkX = flippedChunks[i] % chunksX, chunkY = flippedChunks[i] / chunksX;
+        WakeArea(chunkX * LIQUID_CHUNK * TILE_SIZE - 1, chunkY * LIQUID_CHUNK * TILE_SIZE - 1,
+                 LIQUID_CHUNK * TILE_SIZE + 2, LIQUID_CHUNK * TILE_SIZE + 2);
+    }
+    flippedChunks.clear();
+}
+
+void pf::World::AddLevelLights(const sf::Image& levelImage) {
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (levelImage.GetPixel(x, y) != Tileset::LightSource) continue;
+
+            lighting->AddLight(x, y, LIGHT_MAX, true);
+        }
+    }
+}
+
+int pf::World::AddLight(float x, float y, int level) {
+    return lighting->AddLight(TileCoord(x), TileCoord(y), level);
+}
+
+void pf::World::SetLightPosition(int light, float x, float y) {
+    lighting->SetLightPosition(light, TileCoord(x), TileCoord(y));
+}
+
+void pf::World::RemoveLight(int light) {
+    lighting->RemoveLight(light);
+}
+
+int pf::World::GetLight(int x, int y) {
+    if (!tiles || x < 0 || y < 0 || x >= width || y >= height)
+        return 0;
+
+    return lighting->GetLevel(x, y);
 }
 
 void pf::World::SpawnCharacter(pf::Character *character) {
     AddEntity(character);
+    AddRegionAnchor(character);
     character->SetPosition(spawnX, spawnY);
 }
 
 pf::World::~World() {
-    if (entityMap) {
-        entityMap->empty();
-        delete entityMap;
-        entityMap = NULL;
+    UnloadLevel();
+    if (entities) {
+        delete entities;
+        entities = NULL;
+    }
+    if (broadphase) {
+        delete broadphase;
+        broadphase = NULL;
+    }
+    if (sensors) {
+        delete sensors;
+        sensors = NULL;
+    }
+    if (raycaster) {
+        delete raycaster;
+        raycaster = NULL;
+    }
+    if (bodies) {
+        delete bodies;
+        bodies = NULL;
+    }
+    if (particles) {
+        delete particles;
+        particles = NULL;
+    }
+    if (liquid) {
+        delete liquid;
+        liquid = NULL;
     }
-    if (levelImage) {
-        delete levelImage;
-        levelImage = NULL;
+    if (lighting) {
+        delete lighting;
+        lighting = NULL;
     }
-    if (platforms) {
-        delete [] platforms;
-        platforms = NULL;
+    if (pool) {
+        delete pool;
+        pool = NULL;
     }
+    for (int i = 0; i < islandJobs.size(); i++)
+        delete islandJobs[i];
 }
 
 int pf::World::GetPixelWidth() {